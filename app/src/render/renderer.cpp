@@ -11,9 +11,10 @@ namespace Render {
 Renderer::Renderer(Kernel::Tree e, std::map<Kernel::Tree::Id, float> vars)
     : next(QMatrix4x4(), {0,0}, 0), todo(NOTHING)
 {
+    auto program = std::make_shared<Kernel::Program>(e);
     for (int i=0; i < 8; ++i)
     {
-        evaluators.push_back(new Kernel::Evaluator(e, vars));
+        evaluators.push_back(new Kernel::Evaluator(program, vars));
     }
     connect(&watcher, &QFutureWatcher<Result>::finished,
             this, &Renderer::onRenderFinished);
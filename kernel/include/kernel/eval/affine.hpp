@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+
+#include "kernel/eval/interval.hpp"
+
+namespace Kernel {
+
+/*
+ *  Affine is a reduced affine form
+ *      c + dx·ex + dy·ey + dz·ez + err·e
+ *  where ex, ey, ez are noise symbols in [-1, 1] that are shared by every
+ *  value in an evaluation (one per axis of the input box), and e is a noise
+ *  symbol in [-1, 1] that is private to this value, which soaks up any
+ *  nonlinear and rounding error.
+ *
+ *  Since the shared symbols are carried through linear operations, values
+ *  that are correlated with each other cancel out (e.g. x - x is zero, and
+ *  the coordinates of a rotated box don't grow), which interval arithmetic
+ *  can't do.
+ *
+ *  Operations are computed in double precision, then rounded to float with
+ *  the rounding error (plus a margin for error in the double-precision
+ *  arithmetic) added to err, so bounds() always contains the exact range.
+ */
+class Affine
+{
+public:
+    Affine(float v=0) : c(v), d{{0, 0, 0}}, err(0) {}
+
+    /*
+     *  Returns the affine form of a*x + b*y + c*z + d,
+     *  where x, y, and z are the axes of the given box
+     */
+    static Affine transform(const std::array<Interval, 3>& box,
+                            float a, float b, float c, float d);
+
+    /*
+     *  Returns a form with no correlation to anything else
+     *  that covers the given interval
+     */
+    static Affine fromInterval(Interval i);
+
+    /*
+     *  Returns a form that covers the whole real line
+     */
+    static Affine whole();
+
+    /*
+     *  Returns the interval covered by this form
+     */
+    Interval bounds() const;
+
+    /*
+     *  Checks whether this form is a single value
+     */
+    bool isConstant() const
+        { return err == 0 && d[0] == 0 && d[1] == 0 && d[2] == 0; }
+
+    friend Affine operator+(const Affine& a, const Affine& b);
+    friend Affine operator-(const Affine& a);
+    friend Affine operator-(const Affine& a, const Affine& b);
+    friend Affine operator*(const Affine& a, const Affine& b);
+    friend Affine square(const Affine& a);
+
+protected:
+    /*
+     *  Rounds a form computed in double precision to floats,
+     *  adding the rounding error to err
+     */
+    static Affine round(double c, double dx, double dy, double dz,
+                        double err);
+
+    /*
+     *  Returns the sum of the magnitudes of all noise terms
+     */
+    double radius() const;
+
+    float c;
+    std::array<float, 3> d;
+    float err;
+};
+
+}   // namespace Kernel
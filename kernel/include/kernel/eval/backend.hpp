@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernel/eval/fused.hpp"
+#include "kernel/tree/opcode.hpp"
+
+namespace Kernel {
+
+/*
+ *  A Backend is a set of clause kernels for a particular instruction set.
+ *
+ *  Every backend that the compiler can build is linked into the kernel
+ *  library (each one in its own translation unit, compiled with its own
+ *  target flags), then the widest one that the running CPU supports is
+ *  picked at startup.  Setting the STRAYLIGHT_BACKEND environment variable
+ *  to a backend's name overrides this choice.
+ *
+ *  Counts are in floats; vectorized kernels round them up to a whole
+ *  number of vectors (which is safe, as Result rows are padded).
+ */
+struct Backend
+{
+    typedef uint32_t Index;
+
+    /*  Human-readable name, e.g. "avx2"  */
+    const char* name;
+
+    /*  Number of floats processed per instruction  */
+    unsigned width;
+
+    /*
+     *  Evaluates a single clause, populating the out array
+     */
+    void (*values)(Opcode::Opcode op,
+                   const float* __restrict a, const float* __restrict b,
+                   float* __restrict out, Index count);
+
+    /*
+     *  Evaluates a superinstruction (anything but Fused::CLAUSE),
+     *  populating the out array.  Unlike in the other kernels, out may
+     *  alias the arguments, since the rows of clauses that were folded
+     *  into the superinstruction can be reused for its output.
+     */
+    void (*fused)(Fused::Op op, const float* a, const float* b,
+                  const float* c, float* out, Index count);
+
+    /*
+     *  Evaluates a single clause and its derivatives (X, Y, Z)
+     */
+    void (*derivs)(Opcode::Opcode op,
+        const float* __restrict av,  const float* __restrict adx,
+        const float* __restrict ady, const float* __restrict adz,
+
+        const float* __restrict bv,  const float* __restrict bdx,
+        const float* __restrict bdy, const float* __restrict bdz,
+
+        float* __restrict ov,  float* __restrict odx,
+        float* __restrict ody, float* __restrict odz,
+        Index count);
+
+    /*
+     *  Sets out to 1 in lanes where a == b (leaving other lanes alone),
+     *  which marks points where a min or max clause is ambiguous
+     */
+    void (*ambiguous)(const float* __restrict a, const float* __restrict b,
+                      float* __restrict out, Index count);
+
+    /*
+     *  Accumulates a clause's adjoint d into its arguments' adjoints
+     *  (for reverse-mode gradients), given its argument and output values:
+     *      da += d * dout/da
+     *      db += d * dout/db
+     *  Lanes where d is zero are left unchanged.  da and db may alias,
+     *  since a clause can read the same argument twice.
+     */
+    void (*adjoints)(Opcode::Opcode op,
+        const float* __restrict av, const float* __restrict bv,
+        const float* __restrict ov, const float* __restrict d,
+        float* da, float* db, Index count);
+
+    /*
+     *  Evaluates a single interval clause across a batch of boxes, where
+     *  each box's bounds are stored in one lane of the lo / hi arrays.
+     *  Results are rounded outwards, so they always contain the exact range.
+     *
+     *  Returns false (without writing anything) if this backend has no
+     *  batched kernel for the given opcode, in which case the caller
+     *  should fall back to evaluating boxes one at a time.
+     */
+    bool (*intervals)(Opcode::Opcode op,
+        const float* __restrict alo, const float* __restrict ahi,
+        const float* __restrict blo, const float* __restrict bhi,
+        float* __restrict olo, float* __restrict ohi, Index count);
+
+    /*
+     *  Applies a (column-major) 4x4 matrix to the given coordinate rows
+     */
+    void (*transform)(const float* M, float* __restrict x,
+                      float* __restrict y, float* __restrict z, Index count);
+
+    /*
+     *  Returns the backend used by newly-constructed evaluators
+     */
+    static const Backend& active();
+
+    /*
+     *  Sets the backend used by newly-constructed evaluators.
+     *
+     *  Returns false (leaving the active backend unchanged) if there's
+     *  no backend with that name or the CPU doesn't support it.
+     */
+    static bool select(const std::string& name);
+
+    /*
+     *  Looks up a backend by name, returning nullptr if it is
+     *  missing or not supported by this CPU
+     */
+    static const Backend* find(const std::string& name);
+
+    /*
+     *  Returns every backend supported by this CPU, widest first
+     *  (the last item is always the scalar backend)
+     */
+    static std::vector<const Backend*> available();
+
+    /*
+     *  Returns the scalar (non-vectorized) backend
+     */
+    static const Backend& scalar();
+};
+
+}   // namespace Kernel
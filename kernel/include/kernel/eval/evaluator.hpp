@@ -1,9 +1,7 @@
 #pragma once
 
-#ifdef __AVX__
-    #include "evaluator_avx.hpp"
-    #define Evaluator EvaluatorAVX
-#else
-    #include "evaluator_base.hpp"
-    #define Evaluator EvaluatorBase
-#endif
+#include "kernel/eval/evaluator_base.hpp"
+
+// Vectorized evaluation is selected at runtime (see backend.hpp),
+// so there's a single Evaluator class for every instruction set
+#define Evaluator EvaluatorBase
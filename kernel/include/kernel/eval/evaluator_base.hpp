@@ -1,16 +1,23 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 #include <map>
 
 #include <glm/mat4x4.hpp>
-#include <boost/bimap.hpp>
 
+#include "kernel/eval/affine.hpp"
+#include "kernel/eval/backend.hpp"
+#include "kernel/eval/jit.hpp"
+#include "kernel/eval/program.hpp"
 #include "kernel/eval/result.hpp"
 #include "kernel/eval/interval.hpp"
 #include "kernel/eval/feature.hpp"
+#include "kernel/eval/fused.hpp"
 #include "kernel/eval/clause.hpp"
 #include "kernel/tree/tree.hpp"
 
@@ -30,6 +37,56 @@ public:
     EvaluatorBase(const Tree root, const std::map<Tree::Id, float>& vars)
         : EvaluatorBase(root, glm::mat4(), vars) {}
 
+    /*
+     *  Construct an evaluator with one output per tree, which evaluates
+     *  subexpressions shared between the trees once (see Program)
+     */
+    EvaluatorBase(const std::vector<Tree>& roots,
+                  const glm::mat4& M=glm::mat4(),
+                  const std::map<Tree::Id, float>& vars=
+                        std::map<Tree::Id, float>());
+
+    /*
+     *  Construct an evaluator for a program, which may be shared with
+     *  other evaluators (e.g. one per thread).  This only allocates
+     *  the evaluator's own results and tape stack.
+     */
+    EvaluatorBase(std::shared_ptr<const Program> program,
+                  const glm::mat4& M=glm::mat4(),
+                  const std::map<Tree::Id, float>& vars=
+                        std::map<Tree::Id, float>());
+    EvaluatorBase(std::shared_ptr<const Program> program,
+                  const std::map<Tree::Id, float>& vars)
+        : EvaluatorBase(program, glm::mat4(), vars) {}
+
+    /*
+     *  Returns the program that this evaluator runs
+     */
+    std::shared_ptr<const Program> getProgram() const { return program; }
+
+    /*
+     *  Returns the number of outputs (one per tree)
+     */
+    size_t outputs() const { return program->outputs(); }
+
+    /*
+     *  Switches to a new tree (or set of trees), which is usually an edited
+     *  version of the current one.  The program is patched rather than
+     *  rebuilt (see Program::update), so this is much cheaper than building
+     *  a new evaluator when most of the tree is unchanged.  If the program
+     *  is shared with other evaluators, they keep the old version.
+     *
+     *  Variables keep their current values unless they're in vars, which
+     *  must include every variable that's new to the tree.
+     *
+     *  Must be called when the evaluator isn't pushed into any tapes.
+     */
+    void setTree(const Tree root, const std::map<Tree::Id, float>& vars=
+                                        std::map<Tree::Id, float>());
+    void setTrees(const std::vector<Tree>& roots,
+                  const std::map<Tree::Id, float>& vars=
+                        std::map<Tree::Id, float>());
+
     /*
      *  Single-argument evaluation
      */
@@ -42,6 +99,22 @@ public:
      */
     const float* values(Result::Index count);
 
+    /*
+     *  Evaluates every point on a regular grid, which is the product of
+     *  the given X, Y, and Z positions (up to Result::N points in total).
+     *  Positions are transformed by M, as in set.
+     *
+     *  Results are stored in X-major order, with Z changing fastest, so
+     *  point (i, j, k) is at index (i * ny + j) * nz + k.
+     *
+     *  Each clause is only evaluated over the axes that it depends on,
+     *  then broadcast, so (for example) a shape that's extruded along Z
+     *  costs one evaluation per column rather than one per voxel.
+     */
+    const float* grid(const float* xs, Result::Index nx,
+                      const float* ys, Result::Index ny,
+                      const float* zs, Result::Index nz);
+
     /*
      *  Helper struct when returning derivatives
      */
@@ -50,13 +123,19 @@ public:
         const float* dx;
         const float* dy;
         const float* dz;
+
+        /*  Nonzero at points where a min or max clause had equal branches,
+         *  so the derivatives depend on which branch is picked  */
+        const float* ambiguous;
     };
 
     /*
      *  Evaluate a set of gradients, returning a tuple
      *      value, dx, dy, dz
      *
-     *  Values must have been previously loaded by set
+     *  Values must have been previously loaded by set.  Derivative rows
+     *  are only allocated on the first call, so evaluators that never
+     *  need derivatives don't pay for them.
      */
     Derivs derivs(Result::Index count);
 
@@ -65,11 +144,52 @@ public:
      */
     std::map<Tree::Id, float> gradient(float x, float y, float z);
 
+    /*
+     *  Evaluates the gradient with respect to the given variables at
+     *  count points (which have been loaded with set) in a single pass
+     *  through the tape.
+     *
+     *  out is a dense vars.size() x count matrix, where out[k * count + i]
+     *  is the partial derivative with respect to vars[k] at point i.
+     *  Variables that aren't in the tree have a gradient of zero.
+     */
+    void gradients(const std::vector<Tree::Id>& vars,
+                   Result::Index count, float* out);
+
     /*
      *  Evaluates a single interval (stored with set)
      */
     Interval interval();
 
+    /*
+     *  Helper struct when returning batched intervals
+     */
+    struct Intervals {
+        const float* lower;
+        const float* upper;
+    };
+
+    /*
+     *  Evaluates a batch of intervals (which have been loaded with set),
+     *  in lanes first through first + count - 1, with a single pass
+     *  through the tape.
+     *
+     *  The returned arrays are indexed by lane (starting from 0, not first).
+     *  Other lanes are left untouched, so callers can keep results from
+     *  an outer evaluation in lower lanes while evaluating higher ones.
+     */
+    Intervals intervals(Result::Index count, Result::Index first=0);
+
+    /*
+     *  values, derivs, interval, and intervals return the first output.
+     *  These return the given output from the most recent call to each
+     *  (outputs dropped by push are meaningless until the matching pop).
+     */
+    const float* valuesOf(size_t output) const;
+    Derivs derivsOf(size_t output) const;
+    Interval intervalOf(size_t output) const;
+    Intervals intervalsOf(size_t output) const;
+
     /*
      *  Stores the given value in the result arrays
      *  (inlined for efficiency)
@@ -101,11 +221,30 @@ public:
      */
     void set(Interval X, Interval Y, Interval Z);
 
+    /*
+     *  Stores the given interval in a lane for batched evaluation
+     */
+    void set(Interval X, Interval Y, Interval Z, Result::Index index);
+
     /*
      *  Pushes into a subinterval, disabling inactive nodes
      */
     void push();
 
+    /*
+     *  Pushes into the subinterval stored in the given lane,
+     *  which must have been evaluated with intervals()
+     */
+    void push(Result::Index index);
+
+    /*
+     *  Pushes into a subinterval like push(), also dropping every output
+     *  whose entry in keep is false (e.g. because the output is known to
+     *  be empty or filled in this subinterval), so clauses that are only
+     *  used by dropped outputs aren't evaluated.
+     */
+    void push(const std::vector<bool>& keep);
+
     /*
      *  Pushes into a tree based on the given feature
      *
@@ -173,24 +312,173 @@ public:
 
     /*
      *  Returns a list of ambiguous items from indices 0 to i
+     *
+     *  This walks the whole tape, so it's cheaper to use the ambiguity
+     *  that derivs() records as it goes (see Derivs::ambiguous).
      */
     std::set<Result::Index> getAmbiguous(Result::Index i) const;
 
+    /*
+     *  Chooses the set of clause kernels used by values, derivs,
+     *  intervals, and applyTransform (by default, Backend::active())
+     */
+    void setBackend(const Backend& b);
+    const Backend& getBackend() const { return *backend; }
+
+    /*
+     *  Turns the JIT on or off for values (by default, Jit::enabled()).
+     *  When it's on, each tape is compiled once it has been evaluated
+     *  Jit::THRESHOLD times, falling back to the clause kernels if it
+     *  can't be compiled (or if the backend is SCALAR).
+     */
+    void setJit(bool j) { jit = j; }
+    bool getJit() const { return jit; }
+
+    /*  The scalar backend, which wraps eval_clause_values and friends  */
+    static const Backend SCALAR;
+
+    /*
+     *  Ways that interval() and intervals() can bound each clause
+     */
+    enum IntervalMode {
+        /*  Plain interval arithmetic (the default)  */
+        INTERVAL_ARITHMETIC,
+
+        /*  Reduced affine arithmetic (see Affine), which tracks how each
+         *  clause depends on the axes of the input box.  Each evaluation
+         *  is slower, but bounds on rotated or otherwise correlated
+         *  coordinates are much tighter, so fewer regions are subdivided.
+         *  Each clause's bounds are intersected with the interval
+         *  arithmetic result, so they're never looser.  */
+        AFFINE_ARITHMETIC,
+
+        /*  Interval arithmetic, which also carries interval derivatives
+         *  through the tape, then tightens the root with the mean value
+         *  form f(c) + f'(box) * (box - c) (where c is the box's center).
+         *  This is much tighter on small boxes over smooth fields, at the
+         *  cost of roughly two extra interval passes.  */
+        MEAN_VALUE,
+    };
+    void setIntervalMode(IntervalMode m) { mode = m; }
+    IntervalMode getIntervalMode() const { return mode; }
+
+    /*
+     *  Counts of evaluations since construction (or resetCounts),
+     *  for measuring how much work a render needed
+     */
+    struct Counts {
+        /*  Boxes evaluated by interval() or intervals()  */
+        uint64_t intervals;
+        /*  Points evaluated by values() or derivs()  */
+        uint64_t points;
+        /*  Calls to push() that reused a cached tape  */
+        uint64_t tape_hits;
+        /*  Calls to push() that built a new tape  */
+        uint64_t tape_misses;
+    };
+    const Counts& getCounts() const { return counts; }
+    void resetCounts() { counts = {0, 0, 0, 0}; }
+
+    /*
+     *  Sets the maximum total number of clauses in tapes cached by push(),
+     *  dropping the least recently used tapes if necessary.
+     *  A size of zero turns the cache off.
+     */
+    void setTapeCacheSize(size_t clauses);
+
+    /*  Default size of the tape cache, in clauses  */
+    static constexpr size_t TAPE_CACHE_SIZE = 1 << 18;
+
 protected:
     /*  This is our evaluation tape type */
     struct Tape {
         std::vector<Clause> t;
         Clause::Id i;
+
+        /*  Root clause of each output (with roots[0] == i), which is 0
+         *  (the dummy clause) for outputs that have been dropped  */
+        std::vector<Clause::Id> roots;
+
+        /*  t as run by values(), with common chains of clauses fused into
+         *  superinstructions (built the first time that t is evaluated)  */
+        std::vector<Fused> fused;
+
+        /*  Compiled version of t (shared between copies of an Evaluator,
+         *  as it's immutable) and the number of times t was evaluated  */
+        std::shared_ptr<const Jit> jit;
+        unsigned evals=0;
+
+        /*  Identifies t in the tape cache (the root tape is 0), or NONE
+         *  if t wasn't built by push() from a tape with an id  */
+        uint64_t id=0;
+        static constexpr uint64_t NONE = UINT64_MAX;
+
+        /*  The cache entry that t was built from or copied to, which gets
+         *  this tape's compiled code and evaluation count on pop  */
+        std::shared_ptr<Tape> cached;
     };
 
+    /*
+     *  Loads the program's tape, constants, and variables (with values
+     *  from vs) into the bottom of the tape stack and the results
+     */
+    void loadProgram(const std::map<Tree::Id, float>& vs);
+
+    /*
+     *  Evaluates the program's prelude (its location-agnostic clauses),
+     *  storing the results as constants.  This must be called whenever
+     *  a variable changes.
+     */
+    void runPrelude();
+
+    /*
+     *  Allocates derivative rows in the results on first use,
+     *  then seeds them for X, Y, Z
+     */
+    void prepareDerivs();
+
+    /*
+     *  Allocates batched interval rows (plus affine and interval
+     *  derivative storage) in the results on first use
+     */
+    void prepareIntervals();
+
+    /*
+     *  Moves to the next tape on the stack (allocating it if necessary)
+     *  and empties it, returning the previous tape
+     */
+    Tape* nextTape();
+
     /*
      *  Pushes a new tape onto the stack, storing it in tape
      *
-     *  Requires disabled and remap both to contain useful data; this is used
-     *  when deciding which clauses to push into the new tape.
+     *  Requires disabled, remap, and live to contain useful data; this is
+     *  used when deciding which clauses to push into the new tape.
      */
     void pushTape();
 
+    /*
+     *  Resets disabled, remap, and bound, then marks the roots of outputs
+     *  in live as active (the first step of push and friends).
+     *
+     *  Only entries that the current tape can touch (its clauses, their
+     *  arguments, and its roots) are reset, so this is proportional to
+     *  the size of the current tape rather than the whole program.
+     */
+    void markRoots();
+
+    /*
+     *  Pushes into a subinterval, keeping the outputs in live
+     */
+    void pushLive();
+
+    /*
+     *  Pushes a new tape like pushTape, but copies it from the tape cache
+     *  if the current tape has been pushed with the same MIN / MAX choices
+     *  before.  choices must be populated by the caller.
+     */
+    void pushCached();
+
     /*
      *  Evaluate a single clause, populating the out array
      */
@@ -198,6 +486,13 @@ protected:
         const float* __restrict a, const float* __restrict b,
         float* __restrict out, Result::Index count);
 
+    /*
+     *  Evaluate a superinstruction, populating the out array
+     *  (which may alias the arguments)
+     */
+    static void eval_fused(Fused::Op op, const float* a, const float* b,
+                           const float* c, float* out, Result::Index count);
+
     /*
      *  Evaluate a set of derivatives (X, Y, Z)
      */
@@ -213,13 +508,86 @@ protected:
         Result::Index count);
 
     /*
-     *  Evaluate the tree's values and Jacobian
-     *  with respect to all its variables
+     *  Marks lanes where a min or max clause's branches are equal
+     *  (see Backend::ambiguous)
+     */
+    static void eval_ambiguous(
+        const float* __restrict a, const float* __restrict b,
+        float* __restrict out, Result::Index count);
+
+    /*
+     *  Accumulates a clause's adjoint into its arguments' adjoints
+     *  (see Backend::adjoints)
+     */
+    static void eval_clause_adjoints(Opcode::Opcode op,
+        const float* __restrict av, const float* __restrict bv,
+        const float* __restrict ov, const float* __restrict d,
+        float* da, float* db, Result::Index count);
+
+    /*
+     *  Evaluates a batch of Interval clauses, one lane at a time
+     */
+    static bool eval_clause_intervals(Opcode::Opcode op,
+        const float* __restrict alo, const float* __restrict ahi,
+        const float* __restrict blo, const float* __restrict bhi,
+        float* __restrict olo, float* __restrict ohi, Result::Index count);
+
+    /*
+     *  Stores the given box in result.i, applying M
+     */
+    void load(const std::array<Interval, 3>& box);
+
+    /*
+     *  Evaluates the tape in interval arithmetic on the bounds in result.i
+     */
+    Interval plain();
+
+    /*
+     *  Evaluates the tape with interval derivatives for the box stored in
+     *  the given lane (or Result::NI), storing each clause's bounds in
+     *  result.i with the root tightened by the mean value form
+     */
+    Interval meanValue(Result::Index lane);
+
+    /*
+     *  Evaluates the derivatives of a single Interval clause with respect
+     *  to the box's axes, given its arguments, their derivatives, and its
+     *  interval result.  Derivatives of discontinuous clauses are whole.
+     */
+    static std::array<Interval, 3> eval_clause_interval_derivs(
+        Opcode::Opcode op, const Interval& a, const Interval& b,
+        const std::array<Interval, 3>& da, const std::array<Interval, 3>& db,
+        const Interval& out);
+
+    /*
+     *  Evaluates the tape in affine arithmetic for the box stored in the
+     *  given lane (or Result::NI for the box stored by set without a lane),
+     *  storing each clause's bounds in result.i
+     */
+    Interval affine(Result::Index lane);
+
+    /*
+     *  Evaluates a single Affine clause.  ia and ib are the arguments'
+     *  bounds and out is the clause's interval arithmetic result,
+     *  which is used for opcodes without an affine rule.
+     */
+    static Affine eval_clause_affine(Opcode::Opcode op,
+        const Affine& a, const Affine& b,
+        const Interval& ia, const Interval& ib, const Interval& out);
+
+    /*
+     *  Applies a column-major matrix to a set of coordinates
+     */
+    static void eval_transform(const float* M, float* __restrict x,
+                               float* __restrict y, float* __restrict z,
+                               Result::Index count);
+
+    /*
+     *  Returns the partial derivatives of a clause's output (which has
+     *  already been evaluated) with respect to each of its arguments
      */
-    static float eval_clause_jacobians(Opcode::Opcode op,
-        const float av,  std::vector<float>& aj,
-        const float bv,  std::vector<float>& bj,
-                         std::vector<float>& oj);
+    static std::array<float, 2> eval_clause_partials(Opcode::Opcode op,
+        const float av, const float bv, const float out);
 
     /*
      *  Evaluates a single Interval clause
@@ -231,29 +599,78 @@ protected:
     glm::mat4 M;
     glm::mat4 Mi;
 
-    /*  Indices of X, Y, Z coordinates */
-    Clause::Id X, Y, Z;
-
-    /*  Map of variables (in terms of where they live in this Evaluator) to
-     *  their ids in their respective Tree (e.g. what you get when calling
-     *  Tree::var().id() */
-    boost::bimap<Clause::Id, Tree::Id> vars;
-    /*  We also store shared-pointer handles to var Trees, so we can
-     *  reconstruct a proper Tree from the Evaluator  */
-    std::map<Tree::Id, Tree> var_handles;
+    /*  Rows in result for X, Y, Z coordinates (copied from program)  */
+    Result::Index X, Y, Z;
 
-    /*  Tape containing our opcodes in reverse order */
-    std::list<Tape> tapes;
-    std::list<Tape>::iterator tape;
+    /*  The flattened tree, clause-to-row map, and variables  */
+    std::shared_ptr<const Program> program;
 
-    /*  Store the root opcode explicitly so that we can convert back into
-     *  a tree even if there's nothing in the tape  */
-    const Opcode::Opcode root_op;
+    /*  Stack of tapes containing our opcodes in reverse order, stored
+     *  contiguously (and never shrunk, so that each level keeps its
+     *  allocations), with tape pointing at the active one  */
+    std::vector<Tape> tapes;
+    Tape* tape;
 
     std::vector<uint8_t> disabled;
     std::vector<Clause::Id> remap;
 
+    /*  Used by push() to prune chains of MIN (or MAX) clauses as a whole.
+     *  For a MIN clause, this is the largest value that any of its readers
+     *  still cares about: if an operand's lower bound is above it, that
+     *  operand can't change the result at the top of the chain.  For MAX
+     *  clauses, it's the negated smallest value, so that in both cases
+     *  +infinity means "unconstrained" and readers are combined with max.  */
+    std::vector<float> bound;
+
+    /*  Axes that each clause depends on (as a bitmask, with X = 1,
+     *  Y = 2, and Z = 4), plus two scratch rows for broadcasting
+     *  arguments, used by grid()  */
+    std::vector<uint8_t> grid_axes;
+    Result::Rows grid_rows;
+
+    /*  Values and adjoints of each clause (by id, not row), used by
+     *  gradients() for its reverse-mode pass  */
+    std::vector<float, _AlignedAllocator<float>> clause_values;
+    std::vector<float, _AlignedAllocator<float>> clause_adjoints;
+
+    /*  Outputs kept by the next push (one per output)  */
+    std::vector<uint8_t> live;
+
+    /*  Key for the tape cache, built by push(): the current tape's id
+     *  (as 8 bytes), then live, then one byte per MIN / MAX clause in the
+     *  current tape, which is 0 if both branches are kept, 1 if only a is
+     *  kept, and 2 if only b is kept.  This determines the pushed tape.  */
+    std::vector<uint8_t> choices;
+
+    /*  Tapes built by push(), most recently used first, indexed by their
+     *  keys (see choices).  Their total size is bounded by
+     *  tape_cache_size (in clauses).  */
+    typedef std::pair<std::vector<uint8_t>, std::shared_ptr<Tape>> CacheEntry;
+    std::list<CacheEntry> tape_cache;
+    std::map<std::vector<uint8_t>, std::list<CacheEntry>::iterator> tape_index;
+    size_t tape_cache_clauses=0;
+    size_t tape_cache_size=TAPE_CACHE_SIZE;
+
+    /*  Next id for a tape added to the cache  */
+    uint64_t next_tape_id=1;
+
     Result result;
+
+    /*  Kernels used for values, derivs, intervals, and applyTransform  */
+    const Backend* backend;
+
+    /*  Whether values uses compiled tapes  */
+    bool jit;
+
+    /*  How interval() and intervals() bound clauses  */
+    IntervalMode mode=INTERVAL_ARITHMETIC;
+
+    /*  Untransformed boxes stored by set, indexed by lane (with the box
+     *  for single-interval evaluation at Result::NI), which are needed
+     *  to apply M exactly in affine arithmetic  */
+    std::array<std::array<Interval, 3>, Result::NI + 1> boxes;
+
+    Counts counts={0, 0, 0, 0};
 };
 
 }   // namespace Kernel
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "kernel/eval/backend.hpp"
+#include "kernel/eval/simd.hpp"
+
+namespace Kernel {
+
+/*
+ *  EvaluatorSIMD holds vectorized clause kernels, templated on a width
+ *  policy from simd.hpp (which sets the number of lanes per instruction).
+ *
+ *  It is instantiated in one translation unit per instruction set
+ *  (evaluator_sse.cpp, evaluator_avx.cpp, ...), each compiled with the
+ *  matching target flags, which then exposes its kernels as a Backend.
+ *
+ *  Those translation units must only call code that is private to them:
+ *  an inline function from a shared header could be emitted there with
+ *  wider instructions, then picked by the linker for every caller.
+ */
+template <class W>
+struct EvaluatorSIMD
+{
+    typedef typename W::V V;
+    typedef typename W::M M;
+    typedef Backend::Index Index;
+
+    static void values(Opcode::Opcode op,
+            const float* __restrict a, const float* __restrict b,
+                  float* __restrict out, Index count);
+
+    static void fused(Fused::Op op, const float* a, const float* b,
+                      const float* c, float* out, Index count);
+
+    static void derivs(Opcode::Opcode op,
+        const float* __restrict av,  const float* __restrict adx,
+        const float* __restrict ady, const float* __restrict adz,
+
+        const float* __restrict bv,  const float* __restrict bdx,
+        const float* __restrict bdy, const float* __restrict bdz,
+
+        float* __restrict ov,  float* __restrict odx,
+        float* __restrict ody, float* __restrict odz,
+        Index count);
+
+    static void adjoints(Opcode::Opcode op,
+        const float* __restrict av, const float* __restrict bv,
+        const float* __restrict ov, const float* __restrict d,
+        float* da, float* db, Index count);
+
+    static void ambiguous(const float* __restrict a,
+                          const float* __restrict b,
+                          float* __restrict out, Index count);
+
+    static bool intervals(Opcode::Opcode op,
+        const float* __restrict alo, const float* __restrict ahi,
+        const float* __restrict blo, const float* __restrict bhi,
+        float* __restrict olo, float* __restrict ohi, Index count);
+
+    static void transform(const float* M, float* __restrict x,
+                          float* __restrict y, float* __restrict z,
+                          Index count);
+
+protected:
+    static void eval_clause_values(Opcode::Opcode op,
+            const V* __restrict a, const V* __restrict b,
+                  V* __restrict out, Index count);
+
+    static void eval_fused(Fused::Op op, const V* a, const V* b,
+                           const V* c, V* out, Index count);
+
+    static void eval_clause_derivs(Opcode::Opcode op,
+        const V* __restrict av,  const V* __restrict adx,
+        const V* __restrict ady, const V* __restrict adz,
+
+        const V* __restrict bv,  const V* __restrict bdx,
+        const V* __restrict bdy, const V* __restrict bdz,
+
+        V* __restrict ov,  V* __restrict odx,
+        V* __restrict ody, V* __restrict odz,
+        Index count);
+
+    /*
+     *  Evaluates the partial derivatives of one vector of clause lanes
+     *  with respect to each argument, given the argument and output values
+     */
+    static void eval_clause_partials(Opcode::Opcode op, V a, V b, V out,
+                                     V& pa, V& pb);
+
+    static void eval_clause_adjoints(Opcode::Opcode op,
+        const V* __restrict av, const V* __restrict bv,
+        const V* __restrict ov, const V* __restrict d,
+        V* da, V* db, Index count);
+
+    /*
+     *  Evaluates one vector of interval lanes, returning false
+     *  if there's no vectorized kernel for this opcode
+     */
+    static bool eval_clause_interval(Opcode::Opcode op,
+        V alo, V ahi, V blo, V bhi, V& olo, V& ohi);
+
+    /*
+     *  Rounds a count of floats up to a count of vectors
+     */
+    static Index vectors(Index count)
+        { return (count + W::WIDTH - 1) / W::WIDTH; }
+};
+
+}   // namespace Kernel
@@ -0,0 +1,1198 @@
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#include "kernel/eval/evaluator_simd.hpp"
+
+namespace Kernel {
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Vectorized transcendental functions
+//
+//  These are ports of the single-precision Cephes routines (range reduction
+//  followed by a minimax polynomial), in the style of sse_mathfun, written
+//  against the width policies in simd.hpp.  They're accurate to a few ulp
+//  over the ranges we care about, which is checked against the scalar backend
+//  in kernel/test/avx.cpp
+//
+////////////////////////////////////////////////////////////////////////////////
+
+template <class W>
+struct SIMDMath
+{
+    typedef typename W::V V;
+    typedef typename W::M M;
+
+    /*
+     *  Evaluates sin(x) and cos(x) with a shared range reduction
+     */
+    static void sincos(V x, V* s, V* c)
+    {
+        const V xa = W::abs(x);
+
+        // Find the octant j (rounded up to an even number) and reduce x
+        // into [-pi/4, pi/4] using extended-precision modular arithmetic
+        V j = W::floor(W::mul(xa, W::set(4 / M_PI)));
+        j = W::mul(W::set(2), W::floor(
+                W::mul(W::add(j, W::set(1)), W::set(0.5f))));
+
+        V xr = W::sub(xa, W::mul(j, W::set(0.78515625f)));
+        xr = W::sub(xr, W::mul(j, W::set(2.4187564849853515625e-4f)));
+        xr = W::sub(xr, W::mul(j, W::set(3.77489497744594108e-8f)));
+
+        // Octant (in the set {0, 2, 4, 6})
+        const V q = W::sub(j, W::mul(W::set(8),
+                    W::floor(W::mul(j, W::set(0.125f)))));
+        const M swap = W::eq(
+                W::sub(q, W::mul(W::set(4),
+                    W::floor(W::mul(q, W::set(0.25f))))), W::set(2));
+        const M sin_flip = W::ge(q, W::set(4));
+        const M cos_flip = W::maskAnd(W::ge(q, W::set(2)),
+                                      W::le(q, W::set(4)));
+
+        const V z = W::mul(xr, xr);
+
+        // Cosine polynomial on [-pi/4, pi/4]
+        V pc = W::set(2.443315711809948e-5f);
+        pc = W::add(W::mul(pc, z), W::set(-1.388731625493765e-3f));
+        pc = W::add(W::mul(pc, z), W::set(4.166664568298827e-2f));
+        pc = W::mul(W::mul(pc, z), z);
+        pc = W::sub(pc, W::mul(z, W::set(0.5f)));
+        pc = W::add(pc, W::set(1));
+
+        // Sine polynomial on [-pi/4, pi/4]
+        V ps = W::set(-1.9515295891e-4f);
+        ps = W::add(W::mul(ps, z), W::set(8.3321608736e-3f));
+        ps = W::add(W::mul(ps, z), W::set(-1.6666654611e-1f));
+        ps = W::add(W::mul(W::mul(ps, z), xr), xr);
+
+        const V neg = W::set(-0.0f);
+        *s = W::bitXor(W::blend(ps, pc, swap), W::bitXor(W::sign(x),
+                W::blend(W::zero(), neg, sin_flip)));
+        *c = W::bitXor(W::blend(pc, ps, swap),
+                W::blend(W::zero(), neg, cos_flip));
+    }
+
+    static V sin(V x)
+    {
+        V s, c;
+        sincos(x, &s, &c);
+        return s;
+    }
+
+    static V cos(V x)
+    {
+        V s, c;
+        sincos(x, &s, &c);
+        return c;
+    }
+
+    static V tan(V x)
+    {
+        V s, c;
+        sincos(x, &s, &c);
+        return W::div(s, c);
+    }
+
+    static V exp(V x)
+    {
+        // Clamp to a range where the result is representable (or flushes
+        // cleanly to 0 / inf), which also keeps 2^n in range below
+        const M nan = W::unord(x, x);
+        V xc = W::min(W::max(x, W::set(-104.0f)), W::set(89.0f));
+
+        // exp(x) = 2^n * exp(r), where r is in [-ln(2)/2, ln(2)/2]
+        const V n = W::floor(W::add(
+                    W::mul(xc, W::set(1.44269504088896341f)), W::set(0.5f)));
+        xc = W::sub(xc, W::mul(n, W::set(0.693359375f)));
+        xc = W::sub(xc, W::mul(n, W::set(-2.12194440e-4f)));
+
+        const V z = W::mul(xc, xc);
+        V p = W::set(1.9875691500e-4f);
+        p = W::add(W::mul(p, xc), W::set(1.3981999507e-3f));
+        p = W::add(W::mul(p, xc), W::set(8.3334519073e-3f));
+        p = W::add(W::mul(p, xc), W::set(4.1665795894e-2f));
+        p = W::add(W::mul(p, xc), W::set(1.6666665459e-1f));
+        p = W::add(W::mul(p, xc), W::set(5.0000001201e-1f));
+        p = W::add(W::add(W::mul(p, z), xc), W::set(1));
+
+        // Apply 2^n in two steps, so that both factors stay normal
+        const V n1 = W::floor(W::mul(n, W::set(0.5f)));
+        const V n2 = W::sub(n, n1);
+        p = W::mul(W::mul(p, W::pow2n(n1)), W::pow2n(n2));
+
+        return W::blend(p, x, nan);
+    }
+
+    static V log(V x)
+    {
+        const M invalid = W::lt(x, W::zero());
+        const M zero = W::eq(x, W::zero());
+        const M inf = W::eq(x, W::set(INFINITY));
+
+        // Flush denormals to the smallest normal number
+        V e;
+        V m = W::frexp(W::max(x, W::set(1.17549435e-38f)), &e);
+
+        // Shift the mantissa into [sqrt(0.5), sqrt(2))
+        const M small = W::lt(m, W::set(0.707106781186547524f));
+        e = W::sub(e, W::blend(W::zero(), W::set(1), small));
+        m = W::sub(W::add(m, W::blend(W::zero(), m, small)), W::set(1));
+
+        const V z = W::mul(m, m);
+        V p = W::set(7.0376836292e-2f);
+        p = W::add(W::mul(p, m), W::set(-1.1514610310e-1f));
+        p = W::add(W::mul(p, m), W::set(1.1676998740e-1f));
+        p = W::add(W::mul(p, m), W::set(-1.2420140846e-1f));
+        p = W::add(W::mul(p, m), W::set(1.4249322787e-1f));
+        p = W::add(W::mul(p, m), W::set(-1.6668057665e-1f));
+        p = W::add(W::mul(p, m), W::set(2.0000714765e-1f));
+        p = W::add(W::mul(p, m), W::set(-2.4999993993e-1f));
+        p = W::add(W::mul(p, m), W::set(3.3333331174e-1f));
+        p = W::mul(W::mul(p, m), z);
+
+        p = W::add(p, W::mul(e, W::set(-2.12194440e-4f)));
+        p = W::sub(p, W::mul(z, W::set(0.5f)));
+        p = W::add(W::add(m, p), W::mul(e, W::set(0.693359375f)));
+
+        // Handle special cases (and propagate NaN inputs)
+        p = W::blend(p, W::set(-INFINITY), zero);
+        p = W::blend(p, W::set(INFINITY), inf);
+        p = W::blend(p, W::set(NAN), invalid);
+        return W::blend(p, x, W::unord(x, x));
+    }
+
+    /*
+     *  Matches the semantics of std::pow for the cases that we care about:
+     *  negative bases are only allowed with integral exponents.
+     */
+    static V pow(V a, V b)
+    {
+        V out = exp(W::mul(b, log(W::abs(a))));
+
+        // For negative bases, the exponent must be an integer (otherwise the
+        // result is NaN); odd exponents flip the sign of the result
+        const M integral = W::eq(W::floor(b), b);
+        const V half = W::mul(b, W::set(0.5f));
+        const M odd = W::maskAndNot(W::eq(W::floor(half), half), integral);
+        const M neg = W::lt(a, W::zero());
+
+        out = W::blend(out, W::bitXor(out, W::set(-0.0f)),
+                       W::maskAnd(neg, odd));
+        out = W::blend(out, W::set(NAN), W::maskAndNot(integral, neg));
+
+        // Anything to the zeroth power is one
+        return W::blend(out, W::set(1), W::eq(b, W::zero()));
+    }
+
+    /*
+     *  Polynomial core of atan, valid for x in [-tan(pi/8), tan(pi/8)]
+     */
+    static V atanPoly(V x)
+    {
+        const V z = W::mul(x, x);
+        V p = W::set(8.05374449538e-2f);
+        p = W::add(W::mul(p, z), W::set(-1.38776856032e-1f));
+        p = W::add(W::mul(p, z), W::set(1.99777106478e-1f));
+        p = W::add(W::mul(p, z), W::set(-3.33329491539e-1f));
+        return W::add(W::mul(W::mul(p, z), x), x);
+    }
+
+    static V atan(V x)
+    {
+        const V xa = W::abs(x);
+
+        // Range reduction, using
+        //      atan(x) = pi/2 - atan(1/x)
+        //      atan(x) = pi/4 + atan((x - 1) / (x + 1))
+        const M big = W::gt(xa, W::set(2.414213562373095f));
+        const M mid = W::maskAndNot(big, W::gt(xa, W::set(0.4142135623730950f)));
+
+        V y = W::blend(W::zero(), W::set(M_PI / 4), mid);
+        y = W::blend(y, W::set(M_PI / 2), big);
+
+        V xr = W::blend(xa, W::div(W::sub(xa, W::set(1)),
+                                   W::add(xa, W::set(1))), mid);
+        xr = W::blend(xr, W::div(W::set(-1), xa), big);
+
+        return W::bitXor(W::add(y, atanPoly(xr)), W::sign(x));
+    }
+
+    static V atan2(V y, V x)
+    {
+        V out = atan(W::div(y, x));
+
+        // In the left half-plane, shift by pi in the direction of y's sign
+        const M left = W::lt(x, W::zero());
+        const V pi = W::bitOr(W::set(M_PI), W::sign(y));
+        out = W::blend(out, W::add(out, pi), left);
+
+        // On the Y axis, pick +/-pi/2 (or 0 / pi at the origin)
+        const M xzero = W::eq(x, W::zero());
+        const M yzero = W::eq(y, W::zero());
+        // (x | 1.0 is negative exactly when x has its sign bit set)
+        const V origin = W::bitOr(W::blend(W::zero(), W::set(M_PI),
+                    W::lt(W::bitOr(x, W::set(1)), W::zero())), W::sign(y));
+        out = W::blend(out, W::blend(W::bitOr(W::set(M_PI / 2), W::sign(y)),
+                                     origin, yzero), xzero);
+        return out;
+    }
+
+    /*
+     *  Polynomial core of asin, valid for z = x^2 in [0, 0.25] (with s = x)
+     */
+    static V asinPoly(V z, V s)
+    {
+        V p = W::set(4.2163199048e-2f);
+        p = W::add(W::mul(p, z), W::set(2.4181311049e-2f));
+        p = W::add(W::mul(p, z), W::set(4.5470025998e-2f));
+        p = W::add(W::mul(p, z), W::set(7.4953002686e-2f));
+        p = W::add(W::mul(p, z), W::set(1.6666752422e-1f));
+        return W::add(W::mul(W::mul(p, z), s), s);
+    }
+
+    static V asin(V x)
+    {
+        const V xa = W::abs(x);
+
+        // For |x| > 0.5, use asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2))
+        const M big = W::gt(xa, W::set(0.5f));
+        const V zb = W::mul(W::set(0.5f), W::sub(W::set(1), xa));
+        const V z = W::blend(W::mul(xa, xa), zb, big);
+        const V s = W::blend(xa, W::sqrt(zb), big);
+
+        V p = asinPoly(z, s);
+        p = W::blend(p, W::sub(W::set(M_PI / 2), W::add(p, p)), big);
+        return W::bitXor(p, W::sign(x));
+    }
+
+    static V acos(V x)
+    {
+        const V xa = W::abs(x);
+
+        // For |x| > 0.5, use acos(x) = 2 asin(sqrt((1 - x) / 2))
+        // (reflected about pi/2 for negative x); otherwise, pi/2 - asin(x)
+        const M big = W::gt(xa, W::set(0.5f));
+        const V zb = W::mul(W::set(0.5f), W::sub(W::set(1), xa));
+        const V z = W::blend(W::mul(x, x), zb, big);
+        const V s = W::blend(x, W::sqrt(zb), big);
+
+        const V p = asinPoly(z, s);
+        const V r = W::add(p, p);
+        const M neg = W::lt(x, W::zero());
+
+        return W::blend(W::sub(W::set(M_PI / 2), p),
+                        W::blend(r, W::sub(W::set(M_PI), r), neg), big);
+    }
+
+    /*
+     *  Floored modulo, matching the scalar evaluator for positive b
+     */
+    static V mod(V a, V b)
+    {
+        const V q = W::floor(W::div(a, b));
+        V out = W::sub(a, W::mul(q, b));
+
+        // Fix up results that were pushed out of [0, b) by rounding error
+        out = W::blend(out, W::add(out, b), W::lt(out, W::zero()));
+        out = W::blend(out, W::sub(out, b), W::ge(out, b));
+        return out;
+    }
+
+    static V nanfill(V a, V b)
+    {
+        return W::blend(a, b, W::unord(a, a));
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define EVAL_LOOP for (Index i=0; i < count; ++i)
+
+template <class W>
+void EvaluatorSIMD<W>::eval_clause_values(Opcode::Opcode op,
+        const V* __restrict a, const V* __restrict b,
+              V* __restrict out, Index count)
+{
+    typedef SIMDMath<W> Math;
+
+    switch (op) {
+        case Opcode::ADD:
+            EVAL_LOOP
+            out[i] = W::add(a[i], b[i]);
+            break;
+        case Opcode::MUL:
+            EVAL_LOOP
+            out[i] = W::mul(a[i], b[i]);
+            break;
+        case Opcode::MIN:
+            EVAL_LOOP
+            out[i] = W::min(a[i], b[i]);
+            break;
+        case Opcode::MAX:
+            EVAL_LOOP
+            out[i] = W::max(a[i], b[i]);
+            break;
+        case Opcode::SUB:
+            EVAL_LOOP
+            out[i] = W::sub(a[i], b[i]);
+            break;
+        case Opcode::DIV:
+            EVAL_LOOP
+            out[i] = W::div(a[i], b[i]);
+            break;
+        case Opcode::ATAN2:
+            EVAL_LOOP
+            out[i] = Math::atan2(a[i], b[i]);
+            break;
+        case Opcode::POW:
+            EVAL_LOOP
+            out[i] = Math::pow(a[i], b[i]);
+            break;
+        case Opcode::NTH_ROOT:
+            EVAL_LOOP
+            out[i] = Math::pow(a[i], W::div(W::set(1), b[i]));
+            break;
+        case Opcode::MOD:
+            EVAL_LOOP
+            out[i] = Math::mod(a[i], b[i]);
+            break;
+        case Opcode::NANFILL:
+            EVAL_LOOP
+            out[i] = Math::nanfill(a[i], b[i]);
+            break;
+
+        case Opcode::SQUARE:
+            EVAL_LOOP
+            out[i] = W::mul(a[i], a[i]);
+            break;
+        case Opcode::SQRT:
+            EVAL_LOOP
+            out[i] = W::sqrt(a[i]);
+            break;
+        case Opcode::NEG:
+            EVAL_LOOP
+            out[i] = W::sub(W::zero(), a[i]);
+            break;
+        case Opcode::SIN:
+            EVAL_LOOP
+            out[i] = Math::sin(a[i]);
+            break;
+        case Opcode::COS:
+            EVAL_LOOP
+            out[i] = Math::cos(a[i]);
+            break;
+        case Opcode::TAN:
+            EVAL_LOOP
+            out[i] = Math::tan(a[i]);
+            break;
+        case Opcode::ASIN:
+            EVAL_LOOP
+            out[i] = Math::asin(a[i]);
+            break;
+        case Opcode::ACOS:
+            EVAL_LOOP
+            out[i] = Math::acos(a[i]);
+            break;
+        case Opcode::ATAN:
+            EVAL_LOOP
+            out[i] = Math::atan(a[i]);
+            break;
+        case Opcode::EXP:
+            EVAL_LOOP
+            out[i] = Math::exp(a[i]);
+            break;
+        case Opcode::ABS:
+            EVAL_LOOP
+            out[i] = W::abs(a[i]);
+            break;
+        case Opcode::RECIP:
+            EVAL_LOOP
+            out[i] = W::div(W::set(1), a[i]);
+            break;
+        case Opcode::RSQRT:
+            EVAL_LOOP
+            out[i] = W::div(W::set(1), W::sqrt(a[i]));
+            break;
+
+        case Opcode::CONST_VAR:
+            EVAL_LOOP
+            out[i] = a[i];
+            break;
+
+        case Opcode::INVALID:
+        case Opcode::CONST:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR:
+        case Opcode::LAST_OP: assert(false);
+    }
+}
+
+template <class W>
+void EvaluatorSIMD<W>::eval_fused(Fused::Op op, const V* a, const V* b,
+                                  const V* c, V* out, Index count)
+{
+    // Each lane is read before it's written, so out may alias the arguments
+    switch (op) {
+        case Fused::MULADD:
+            // This rounds twice (rather than using W::fma), to match the
+            // JIT and the unfused kernels bit-for-bit
+            EVAL_LOOP
+            out[i] = W::add(W::mul(a[i], b[i]), c[i]);
+            break;
+        case Fused::SQDIST:
+            EVAL_LOOP
+            {
+                const V d = W::sub(a[i], b[i]);
+                out[i] = W::mul(d, d);
+            }
+            break;
+        case Fused::SUMSQ:
+            EVAL_LOOP
+            out[i] = W::add(W::mul(a[i], a[i]), W::mul(b[i], b[i]));
+            break;
+        case Fused::HYPOT2:
+            EVAL_LOOP
+            out[i] = W::sqrt(W::add(W::mul(a[i], a[i]), W::mul(b[i], b[i])));
+            break;
+        case Fused::HYPOT3:
+            EVAL_LOOP
+            out[i] = W::sqrt(W::add(W::add(W::mul(a[i], a[i]),
+                                           W::mul(b[i], b[i])),
+                                    W::mul(c[i], c[i])));
+            break;
+
+        case Fused::CLAUSE: assert(false);
+    }
+}
+
+template <class W>
+void EvaluatorSIMD<W>::eval_clause_derivs(Opcode::Opcode op,
+        const V* __restrict av,  const V* __restrict adx,
+        const V* __restrict ady, const V* __restrict adz,
+
+        const V* __restrict bv,  const V* __restrict bdx,
+        const V* __restrict bdy, const V* __restrict bdz,
+
+        V* __restrict ov,  V* __restrict odx,
+        V* __restrict ody, V* __restrict odz,
+        Index count)
+{
+    typedef SIMDMath<W> Math;
+
+    // Evaluate the base operations in a single pass
+    eval_clause_values(op, av, bv, ov, count);
+
+    switch (op) {
+        case Opcode::ADD:
+            EVAL_LOOP
+            {
+                odx[i] = W::add(adx[i], bdx[i]);
+                ody[i] = W::add(ady[i], bdy[i]);
+                odz[i] = W::add(adz[i], bdz[i]);
+            }
+            break;
+        case Opcode::MUL:
+            EVAL_LOOP
+            {   // Product rule
+                odx[i] = W::add(W::mul(av[i], bdx[i]), W::mul(adx[i], bv[i]));
+                ody[i] = W::add(W::mul(av[i], bdy[i]), W::mul(ady[i], bv[i]));
+                odz[i] = W::add(W::mul(av[i], bdz[i]), W::mul(adz[i], bv[i]));
+            }
+            break;
+        case Opcode::MIN:
+            EVAL_LOOP
+            {
+                const typename W::M cmp = W::lt(av[i], bv[i]);
+                odx[i] = W::blend(bdx[i], adx[i], cmp);
+                ody[i] = W::blend(bdy[i], ady[i], cmp);
+                odz[i] = W::blend(bdz[i], adz[i], cmp);
+            }
+            break;
+        case Opcode::MAX:
+            EVAL_LOOP
+            {
+                const typename W::M cmp = W::lt(av[i], bv[i]);
+                odx[i] = W::blend(adx[i], bdx[i], cmp);
+                ody[i] = W::blend(ady[i], bdy[i], cmp);
+                odz[i] = W::blend(adz[i], bdz[i], cmp);
+            }
+            break;
+        case Opcode::SUB:
+            EVAL_LOOP
+            {
+                odx[i] = W::sub(adx[i], bdx[i]);
+                ody[i] = W::sub(ady[i], bdy[i]);
+                odz[i] = W::sub(adz[i], bdz[i]);
+            }
+            break;
+        case Opcode::DIV:
+            EVAL_LOOP
+            {
+                const V p = W::mul(bv[i], bv[i]);
+                odx[i] = W::div(W::sub(W::mul(bv[i], adx[i]),
+                                       W::mul(av[i], bdx[i])), p);
+                ody[i] = W::div(W::sub(W::mul(bv[i], ady[i]),
+                                       W::mul(av[i], bdy[i])), p);
+                odz[i] = W::div(W::sub(W::mul(bv[i], adz[i]),
+                                       W::mul(av[i], bdz[i])), p);
+            }
+            break;
+        case Opcode::ATAN2:
+            EVAL_LOOP
+            {
+                const V d = W::add(W::mul(av[i], av[i]),
+                                   W::mul(bv[i], bv[i]));
+                odx[i] = W::div(W::sub(W::mul(adx[i], bv[i]),
+                                       W::mul(av[i], bdx[i])), d);
+                ody[i] = W::div(W::sub(W::mul(ady[i], bv[i]),
+                                       W::mul(av[i], bdy[i])), d);
+                odz[i] = W::div(W::sub(W::mul(adz[i], bv[i]),
+                                       W::mul(av[i], bdz[i])), d);
+            }
+            break;
+        case Opcode::POW:
+            EVAL_LOOP
+            {
+                // As in the scalar evaluator, we skip the log(a) * db term,
+                // since b must be constant
+                const V m = W::mul(bv[i],
+                        Math::pow(av[i], W::sub(bv[i], W::set(1))));
+                odx[i] = W::mul(m, adx[i]);
+                ody[i] = W::mul(m, ady[i]);
+                odz[i] = W::mul(m, adz[i]);
+            }
+            break;
+        case Opcode::NTH_ROOT:
+            EVAL_LOOP
+            {
+                const V r = W::div(W::set(1), bv[i]);
+                const V m = W::mul(r,
+                        Math::pow(av[i], W::sub(r, W::set(1))));
+                odx[i] = W::mul(m, adx[i]);
+                ody[i] = W::mul(m, ady[i]);
+                odz[i] = W::mul(m, adz[i]);
+            }
+            break;
+        case Opcode::MOD:
+            EVAL_LOOP
+            {
+                odx[i] = adx[i];
+                ody[i] = ady[i];
+                odz[i] = adz[i];
+            }
+            break;
+        case Opcode::NANFILL:
+            EVAL_LOOP
+            {
+                const typename W::M cmp = W::unord(av[i], av[i]);
+                odx[i] = W::blend(adx[i], bdx[i], cmp);
+                ody[i] = W::blend(ady[i], bdy[i], cmp);
+                odz[i] = W::blend(adz[i], bdz[i], cmp);
+            }
+            break;
+
+        case Opcode::SQUARE:
+            EVAL_LOOP
+            {
+                odx[i] = W::mul(W::set(2), W::mul(av[i], adx[i]));
+                ody[i] = W::mul(W::set(2), W::mul(av[i], ady[i]));
+                odz[i] = W::mul(W::set(2), W::mul(av[i], adz[i]));
+            }
+            break;
+        case Opcode::SQRT:
+            EVAL_LOOP
+            {
+                const typename W::M cmp = W::lt(av[i], W::zero());
+
+                // Calculate the common denominator
+                const V den = W::mul(ov[i], W::set(2));
+
+                // If the value is less than zero, clamp the derivative at zero
+                odx[i] = W::blend(W::div(adx[i], den), W::zero(), cmp);
+                ody[i] = W::blend(W::div(ady[i], den), W::zero(), cmp);
+                odz[i] = W::blend(W::div(adz[i], den), W::zero(), cmp);
+            }
+            break;
+        case Opcode::NEG:
+            EVAL_LOOP
+            {
+                odx[i] = W::sub(W::zero(), adx[i]);
+                ody[i] = W::sub(W::zero(), ady[i]);
+                odz[i] = W::sub(W::zero(), adz[i]);
+            }
+            break;
+        case Opcode::SIN:
+            EVAL_LOOP
+            {
+                const V c = Math::cos(av[i]);
+                odx[i] = W::mul(adx[i], c);
+                ody[i] = W::mul(ady[i], c);
+                odz[i] = W::mul(adz[i], c);
+            }
+            break;
+        case Opcode::COS:
+            EVAL_LOOP
+            {
+                const V s = W::bitXor(Math::sin(av[i]), W::set(-0.0f));
+                odx[i] = W::mul(adx[i], s);
+                ody[i] = W::mul(ady[i], s);
+                odz[i] = W::mul(adz[i], s);
+            }
+            break;
+        case Opcode::TAN:
+            EVAL_LOOP
+            {
+                const V c = Math::cos(av[i]);
+                const V s = W::div(W::set(1), W::mul(c, c));
+                odx[i] = W::mul(adx[i], s);
+                ody[i] = W::mul(ady[i], s);
+                odz[i] = W::mul(adz[i], s);
+            }
+            break;
+        case Opcode::ASIN:
+            EVAL_LOOP
+            {
+                const V d = W::sqrt(W::sub(W::set(1), W::mul(av[i], av[i])));
+                odx[i] = W::div(adx[i], d);
+                ody[i] = W::div(ady[i], d);
+                odz[i] = W::div(adz[i], d);
+            }
+            break;
+        case Opcode::ACOS:
+            EVAL_LOOP
+            {
+                const V d = W::bitXor(W::set(-0.0f),
+                        W::sqrt(W::sub(W::set(1), W::mul(av[i], av[i]))));
+                odx[i] = W::div(adx[i], d);
+                ody[i] = W::div(ady[i], d);
+                odz[i] = W::div(adz[i], d);
+            }
+            break;
+        case Opcode::ATAN:
+            EVAL_LOOP
+            {
+                const V d = W::add(W::mul(av[i], av[i]), W::set(1));
+                odx[i] = W::div(adx[i], d);
+                ody[i] = W::div(ady[i], d);
+                odz[i] = W::div(adz[i], d);
+            }
+            break;
+        case Opcode::EXP:
+            EVAL_LOOP
+            {
+                odx[i] = W::mul(ov[i], adx[i]);
+                ody[i] = W::mul(ov[i], ady[i]);
+                odz[i] = W::mul(ov[i], adz[i]);
+            }
+            break;
+        case Opcode::ABS:
+            EVAL_LOOP
+            {
+                // Flip the sign of the derivatives where a is negative
+                const V s = W::blend(W::zero(), W::set(-0.0f),
+                                     W::lt(av[i], W::zero()));
+                odx[i] = W::bitXor(adx[i], s);
+                ody[i] = W::bitXor(ady[i], s);
+                odz[i] = W::bitXor(adz[i], s);
+            }
+            break;
+        case Opcode::RECIP:
+            EVAL_LOOP
+            {
+                const V d = W::sub(W::zero(), W::mul(ov[i], ov[i]));
+                odx[i] = W::mul(adx[i], d);
+                ody[i] = W::mul(ady[i], d);
+                odz[i] = W::mul(adz[i], d);
+            }
+            break;
+        case Opcode::RSQRT:
+            EVAL_LOOP
+            {
+                const V d = W::mul(W::set(-0.5f),
+                        W::mul(ov[i], W::mul(ov[i], ov[i])));
+                odx[i] = W::mul(adx[i], d);
+                ody[i] = W::mul(ady[i], d);
+                odz[i] = W::mul(adz[i], d);
+            }
+            break;
+
+        case Opcode::CONST_VAR:
+            EVAL_LOOP
+            {
+                odx[i] = adx[i];
+                ody[i] = ady[i];
+                odz[i] = adz[i];
+            }
+            break;
+
+        case Opcode::INVALID:
+        case Opcode::CONST:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR:
+        case Opcode::LAST_OP: assert(false);
+    }
+}
+
+template <class W>
+void EvaluatorSIMD<W>::eval_clause_partials(Opcode::Opcode op,
+        V a, V b, V out, V& pa, V& pb)
+{
+    typedef SIMDMath<W> Math;
+
+    const V one = W::set(1);
+    pa = W::zero();
+    pb = W::zero();
+    switch (op) {
+        case Opcode::ADD:
+            pa = one;
+            pb = one;
+            break;
+        case Opcode::MUL:
+            pa = b;
+            pb = a;
+            break;
+        case Opcode::MIN:
+        {
+            const M cmp = W::lt(a, b);
+            pa = W::blend(W::zero(), one, cmp);
+            pb = W::blend(one, W::zero(), cmp);
+            break;
+        }
+        case Opcode::MAX:
+        {
+            const M cmp = W::lt(a, b);
+            pa = W::blend(one, W::zero(), cmp);
+            pb = W::blend(W::zero(), one, cmp);
+            break;
+        }
+        case Opcode::SUB:
+            pa = one;
+            pb = W::set(-1);
+            break;
+        case Opcode::DIV:
+            pa = W::div(one, b);
+            pb = W::div(W::sub(W::zero(), a), W::mul(b, b));
+            break;
+        case Opcode::ATAN2:
+        {
+            const V d = W::add(W::mul(a, a), W::mul(b, b));
+            pa = W::div(b, d);
+            pb = W::div(W::sub(W::zero(), a), d);
+            break;
+        }
+        case Opcode::POW:
+            // As in the scalar evaluator, we skip the partial with
+            // respect to b, since b must be constant
+            pa = W::mul(b, Math::pow(a, W::sub(b, one)));
+            break;
+        case Opcode::NTH_ROOT:
+        {
+            const V r = W::div(one, b);
+            pa = W::mul(r, Math::pow(a, W::sub(r, one)));
+            break;
+        }
+        case Opcode::MOD:
+            pa = one;
+            break;
+        case Opcode::NANFILL:
+        {
+            const M cmp = W::unord(a, a);
+            pa = W::blend(one, W::zero(), cmp);
+            pb = W::blend(W::zero(), one, cmp);
+            break;
+        }
+
+        case Opcode::SQUARE:
+            pa = W::add(a, a);
+            break;
+        case Opcode::SQRT:
+            // If the value is less than zero, clamp the derivative at zero
+            pa = W::blend(W::div(one, W::add(out, out)), W::zero(),
+                          W::lt(a, W::zero()));
+            break;
+        case Opcode::NEG:
+            pa = W::set(-1);
+            break;
+        case Opcode::SIN:
+            pa = Math::cos(a);
+            break;
+        case Opcode::COS:
+            pa = W::bitXor(Math::sin(a), W::set(-0.0f));
+            break;
+        case Opcode::TAN:
+        {
+            const V c = Math::cos(a);
+            pa = W::div(one, W::mul(c, c));
+            break;
+        }
+        case Opcode::ASIN:
+            pa = W::div(one, W::sqrt(W::sub(one, W::mul(a, a))));
+            break;
+        case Opcode::ACOS:
+            pa = W::div(W::set(-1), W::sqrt(W::sub(one, W::mul(a, a))));
+            break;
+        case Opcode::ATAN:
+            pa = W::div(one, W::add(W::mul(a, a), one));
+            break;
+        case Opcode::EXP:
+            pa = out;
+            break;
+        case Opcode::ABS:
+            pa = W::blend(one, W::set(-1), W::lt(a, W::zero()));
+            break;
+        case Opcode::RECIP:
+            pa = W::sub(W::zero(), W::mul(out, out));
+            break;
+        case Opcode::RSQRT:
+            pa = W::mul(W::set(-0.5f), W::mul(out, W::mul(out, out)));
+            break;
+
+        case Opcode::CONST_VAR:
+            pa = W::zero();
+            break;
+
+        case Opcode::INVALID:
+        case Opcode::CONST:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR:
+        case Opcode::LAST_OP: assert(false);
+    }
+}
+
+template <class W>
+void EvaluatorSIMD<W>::eval_clause_adjoints(Opcode::Opcode op,
+        const V* __restrict av, const V* __restrict bv,
+        const V* __restrict ov, const V* __restrict d,
+        V* da, V* db, Index count)
+{
+    EVAL_LOOP
+    {
+        V pa, pb;
+        eval_clause_partials(op, av[i], bv[i], ov[i], pa, pb);
+
+        // Lanes with a zero adjoint are skipped, which keeps infinite
+        // partials (e.g. from an unused branch) out of the sums.  da and
+        // db may alias, so they're updated one after the other.
+        const M skip = W::eq(d[i], W::zero());
+        da[i] = W::add(da[i], W::blend(W::mul(d[i], pa), W::zero(), skip));
+        db[i] = W::add(db[i], W::blend(W::mul(d[i], pb), W::zero(), skip));
+    }
+}
+
+#undef EVAL_LOOP
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Batched interval arithmetic
+//
+//  Each lane holds one box's bounds.  Rather than changing the rounding mode,
+//  every rounded result is pushed outwards by at least one ulp (plus FLT_MIN,
+//  so that zero and subnormal bounds move too), which keeps the true range
+//  inside the interval.  Opcodes without a kernel here fall back to the
+//  scalar implementation in EvaluatorBase.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+template <class W>
+struct SIMDInterval
+{
+    typedef typename W::V V;
+    typedef typename W::M M;
+
+    /*
+     *  Rounds a lower / upper bound outwards.  If x is infinite, the
+     *  subtraction produces NaN and min / max return x unchanged.
+     */
+    static V down(V x)
+    {
+        const V d = W::add(W::mul(W::abs(x), W::set(1.0f / (1 << 23))),
+                           W::set(FLT_MIN));
+        return W::min(W::sub(x, d), x);
+    }
+    static V up(V x)
+    {
+        const V d = W::add(W::mul(W::abs(x), W::set(1.0f / (1 << 23))),
+                           W::set(FLT_MIN));
+        return W::max(W::add(x, d), x);
+    }
+
+    /*
+     *  Sets lo and hi to [min, max] of the four products (or quotients),
+     *  falling back to [-inf, inf] in lanes where any of them is NaN
+     *  (e.g. 0 * inf)
+     */
+    static void hull(V p, V q, V r, V s, V& lo, V& hi)
+    {
+        const M nan = W::maskOr(W::unord(p, q), W::unord(r, s));
+        lo = W::blend(down(W::min(W::min(p, q), W::min(r, s))),
+                      W::set(-INFINITY), nan);
+        hi = W::blend(up(W::max(W::max(p, q), W::max(r, s))),
+                      W::set(INFINITY), nan);
+    }
+};
+
+template <class W>
+bool EvaluatorSIMD<W>::eval_clause_interval(Opcode::Opcode op,
+        V alo, V ahi, V blo, V bhi, V& olo, V& ohi)
+{
+    typedef SIMDInterval<W> I;
+
+    switch (op) {
+        case Opcode::ADD:
+            olo = I::down(W::add(alo, blo));
+            ohi = I::up(W::add(ahi, bhi));
+            return true;
+        case Opcode::MUL:
+            I::hull(W::mul(alo, blo), W::mul(alo, bhi),
+                    W::mul(ahi, blo), W::mul(ahi, bhi), olo, ohi);
+            return true;
+        case Opcode::MIN:
+            olo = W::min(alo, blo);
+            ohi = W::min(ahi, bhi);
+            return true;
+        case Opcode::MAX:
+            olo = W::max(alo, blo);
+            ohi = W::max(ahi, bhi);
+            return true;
+        case Opcode::SUB:
+            olo = I::down(W::sub(alo, bhi));
+            ohi = I::up(W::sub(ahi, blo));
+            return true;
+        case Opcode::DIV:
+        {
+            I::hull(W::div(alo, blo), W::div(alo, bhi),
+                    W::div(ahi, blo), W::div(ahi, bhi), olo, ohi);
+
+            // If the divisor contains zero, the result is unbounded
+            const M zero = W::maskAnd(W::le(blo, W::zero()),
+                                      W::ge(bhi, W::zero()));
+            olo = W::blend(olo, W::set(-INFINITY), zero);
+            ohi = W::blend(ohi, W::set(INFINITY), zero);
+            return true;
+        }
+        case Opcode::NANFILL:
+        {
+            // The hull of a and b, skipping whichever one is empty
+            const M anan = W::unord(alo, ahi);
+            const M bnan = W::unord(blo, bhi);
+            olo = W::blend(W::blend(W::min(alo, blo), alo, bnan), blo, anan);
+            ohi = W::blend(W::blend(W::max(ahi, bhi), ahi, bnan), bhi, anan);
+            return true;
+        }
+
+        case Opcode::SQUARE:
+        {
+            const V l2 = W::mul(alo, alo);
+            const V h2 = W::mul(ahi, ahi);
+
+            // If the interval contains zero, the lower bound is zero
+            const M straddle = W::maskAnd(W::lt(alo, W::zero()),
+                                          W::gt(ahi, W::zero()));
+            olo = W::max(W::blend(I::down(W::min(l2, h2)), W::zero(), straddle),
+                         W::zero());
+            ohi = I::up(W::max(l2, h2));
+            return true;
+        }
+        case Opcode::SQRT:
+        {
+            olo = W::max(I::down(W::sqrt(W::max(alo, W::zero()))), W::zero());
+            ohi = I::up(W::sqrt(ahi));
+
+            // Intervals that are entirely negative become empty (NaN)
+            const M empty = W::lt(ahi, W::zero());
+            olo = W::blend(olo, W::set(NAN), empty);
+            ohi = W::blend(ohi, W::set(NAN), empty);
+            return true;
+        }
+        case Opcode::NEG:
+            olo = W::sub(W::zero(), ahi);
+            ohi = W::sub(W::zero(), alo);
+            return true;
+        case Opcode::ABS:
+        {
+            // This is exact, so there's no rounding
+            olo = W::max(W::max(alo, W::sub(W::zero(), ahi)), W::zero());
+            ohi = W::max(W::abs(alo), W::abs(ahi));
+
+            // Empty intervals stay empty
+            const M empty = W::unord(alo, ahi);
+            olo = W::blend(olo, W::set(NAN), empty);
+            ohi = W::blend(ohi, W::set(NAN), empty);
+            return true;
+        }
+
+        case Opcode::CONST_VAR:
+            olo = alo;
+            ohi = ahi;
+            return true;
+
+        case Opcode::ATAN2:
+        case Opcode::POW:
+        case Opcode::NTH_ROOT:
+        case Opcode::MOD:
+        case Opcode::SIN:
+        case Opcode::COS:
+        case Opcode::TAN:
+        case Opcode::ASIN:
+        case Opcode::ACOS:
+        case Opcode::ATAN:
+        case Opcode::EXP:
+        case Opcode::RECIP:
+        case Opcode::RSQRT:
+            return false;
+
+        case Opcode::INVALID:
+        case Opcode::CONST:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR:
+        case Opcode::LAST_OP: assert(false);
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <class W>
+void EvaluatorSIMD<W>::values(Opcode::Opcode op,
+        const float* __restrict a, const float* __restrict b,
+              float* __restrict out, Index count)
+{
+    eval_clause_values(op, reinterpret_cast<const V*>(a),
+                           reinterpret_cast<const V*>(b),
+                           reinterpret_cast<V*>(out), vectors(count));
+}
+
+template <class W>
+void EvaluatorSIMD<W>::fused(Fused::Op op, const float* a, const float* b,
+                             const float* c, float* out, Index count)
+{
+    eval_fused(op, reinterpret_cast<const V*>(a),
+                   reinterpret_cast<const V*>(b),
+                   reinterpret_cast<const V*>(c),
+                   reinterpret_cast<V*>(out), vectors(count));
+}
+
+template <class W>
+void EvaluatorSIMD<W>::derivs(Opcode::Opcode op,
+        const float* __restrict av,  const float* __restrict adx,
+        const float* __restrict ady, const float* __restrict adz,
+
+        const float* __restrict bv,  const float* __restrict bdx,
+        const float* __restrict bdy, const float* __restrict bdz,
+
+        float* __restrict ov,  float* __restrict odx,
+        float* __restrict ody, float* __restrict odz,
+        Index count)
+{
+    eval_clause_derivs(op,
+            reinterpret_cast<const V*>(av), reinterpret_cast<const V*>(adx),
+            reinterpret_cast<const V*>(ady), reinterpret_cast<const V*>(adz),
+
+            reinterpret_cast<const V*>(bv), reinterpret_cast<const V*>(bdx),
+            reinterpret_cast<const V*>(bdy), reinterpret_cast<const V*>(bdz),
+
+            reinterpret_cast<V*>(ov), reinterpret_cast<V*>(odx),
+            reinterpret_cast<V*>(ody), reinterpret_cast<V*>(odz),
+            vectors(count));
+}
+
+template <class W>
+void EvaluatorSIMD<W>::ambiguous(const float* __restrict a,
+                                 const float* __restrict b,
+                                 float* __restrict out, Index count)
+{
+    const V* av = reinterpret_cast<const V*>(a);
+    const V* bv = reinterpret_cast<const V*>(b);
+    V* ov = reinterpret_cast<V*>(out);
+    for (Index i=0; i < vectors(count); ++i)
+    {
+        ov[i] = W::blend(ov[i], W::set(1), W::eq(av[i], bv[i]));
+    }
+}
+
+template <class W>
+void EvaluatorSIMD<W>::adjoints(Opcode::Opcode op,
+        const float* __restrict av, const float* __restrict bv,
+        const float* __restrict ov, const float* __restrict d,
+        float* da, float* db, Index count)
+{
+    eval_clause_adjoints(op, reinterpret_cast<const V*>(av),
+                             reinterpret_cast<const V*>(bv),
+                             reinterpret_cast<const V*>(ov),
+                             reinterpret_cast<const V*>(d),
+                             reinterpret_cast<V*>(da),
+                             reinterpret_cast<V*>(db), vectors(count));
+}
+
+template <class W>
+bool EvaluatorSIMD<W>::intervals(Opcode::Opcode op,
+        const float* __restrict alo, const float* __restrict ahi,
+        const float* __restrict blo, const float* __restrict bhi,
+        float* __restrict olo, float* __restrict ohi, Index count)
+{
+    // Lanes needn't start on a vector boundary, so we use unaligned loads
+    for (Index i=0; i < count; i += W::WIDTH)
+    {
+        V lo, hi;
+        if (!eval_clause_interval(op, W::load(alo + i), W::load(ahi + i),
+                                      W::load(blo + i), W::load(bhi + i),
+                                      lo, hi))
+        {
+            return false;
+        }
+        W::store(olo + i, lo);
+        W::store(ohi + i, hi);
+    }
+    return true;
+}
+
+template <class W>
+void EvaluatorSIMD<W>::transform(const float* M, float* __restrict x,
+                                 float* __restrict y, float* __restrict z,
+                                 Index count)
+{
+    // M is column-major, so M[4*j + i] is row i of column j
+    const V M00 = W::set(M[0]);
+    const V M10 = W::set(M[4]);
+    const V M20 = W::set(M[8]);
+    const V M30 = W::set(M[12]);
+
+    const V M01 = W::set(M[1]);
+    const V M11 = W::set(M[5]);
+    const V M21 = W::set(M[9]);
+    const V M31 = W::set(M[13]);
+
+    const V M02 = W::set(M[2]);
+    const V M12 = W::set(M[6]);
+    const V M22 = W::set(M[10]);
+    const V M32 = W::set(M[14]);
+
+    V* xs = reinterpret_cast<V*>(x);
+    V* ys = reinterpret_cast<V*>(y);
+    V* zs = reinterpret_cast<V*>(z);
+
+    for (Index i=0; i < vectors(count); ++i)
+    {
+        const V px = xs[i];
+        const V py = ys[i];
+        const V pz = zs[i];
+        xs[i] = W::add(W::add(W::mul(px, M00), W::mul(py, M10)),
+                       W::add(W::mul(pz, M20), M30));
+        ys[i] = W::add(W::add(W::mul(px, M01), W::mul(py, M11)),
+                       W::add(W::mul(pz, M21), M31));
+        zs[i] = W::add(W::add(W::mul(px, M02), W::mul(py, M12)),
+                       W::add(W::mul(pz, M22), M32));
+    }
+}
+
+}   // namespace Kernel
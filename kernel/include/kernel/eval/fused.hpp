@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "kernel/eval/clause.hpp"
+
+namespace Kernel {
+
+/*
+ *  A Fused instruction is one step of a tape as run by the interpreter:
+ *  either a single clause, or a superinstruction that evaluates a short
+ *  chain of clauses in one pass, so that intermediate values are never
+ *  written to (or read back from) the Result::f rows.
+ *
+ *  Arguments and outputs are stored as rows of Result::f rather than
+ *  clause ids, which saves a lookup per clause.
+ */
+struct Fused
+{
+    typedef uint32_t Index;
+
+    enum Op {
+        CLAUSE,     /*  out = op(a, b)                  */
+        MULADD,     /*  out = a * b + c                 */
+        SQDIST,     /*  out = (a - b)^2                 */
+        SUMSQ,      /*  out = a^2 + b^2                 */
+        HYPOT2,     /*  out = sqrt(a^2 + b^2)           */
+        HYPOT3,     /*  out = sqrt(a^2 + b^2 + c^2)     */
+    };
+
+    Op fused;
+
+    /*  Only meaningful for CLAUSE  */
+    Opcode::Opcode op;
+
+    Index a;
+    Index b;
+    Index c;
+    Index out;
+
+    /*
+     *  Builds a list of instructions (in evaluation order) from a tape
+     *  (stored in reverse order, as in the Evaluator), where slots maps
+     *  clause ids to rows of Result::f.
+     *
+     *  Only clauses with a single reader are folded into a superinstruction.
+     *  The roots and arguments to min and max are always written out, as
+     *  they're read once the whole tape has been evaluated.
+     */
+    static std::vector<Fused> build(const std::vector<Clause>& tape,
+                                    const std::vector<Clause::Id>& roots,
+                                    const std::vector<Index>& slots);
+};
+
+}   // namespace Kernel
@@ -1,78 +1,222 @@
 #pragma once
 
-#include <boost/numeric/interval.hpp>
+#include <cfloat>
+#include <cmath>
+#include <limits>
 
 #include <glm/vec3.hpp>
 
 namespace Kernel {
 
-typedef boost::numeric::interval<float,
-    boost::numeric::interval_lib::policies<
-        boost::numeric::interval_lib::save_state<
-            boost::numeric::interval_lib::rounded_transc_std<float>>,
-        boost::numeric::interval_lib::checking_base<float>>> Interval;
+/*
+ *  Interval is a closed range of floats, used for interval arithmetic.
+ *
+ *  Bounds are rounded outwards without touching the FPU rounding mode
+ *  (which is expensive to save and restore around every operation):
+ *  each result is computed with the default round-to-nearest, then the
+ *  rounding error is recovered exactly (with an error-free transformation
+ *  or by working in double precision) and the bound is moved out by one
+ *  step of nextafter if it was rounded inwards.
+ *
+ *  For +, -, *, /, and sqrt, this gives exactly the same bounds as directed
+ *  rounding.  Transcendental functions are evaluated in double precision,
+ *  then widened by an error bound before rounding (see interval.cpp).
+ *
+ *  An empty interval (e.g. the square root of a negative interval) has NaN
+ *  for both bounds.
+ */
+class Interval
+{
+public:
+    Interval() : lo(0), hi(0) {}
+    Interval(float v) : lo(v), hi(v) {}
 
-}
+    /*
+     *  Constructs an interval from its bounds; if either is NaN or lower
+     *  is greater than upper, returns an empty interval
+     */
+    Interval(float lower, float upper) : lo(lower), hi(upper)
+        { if (!(lower <= upper)) { setEmpty(); } }
 
-inline Kernel::Interval atan2(const Kernel::Interval& y, const Kernel::Interval& x)
-{
-    // There are 9 possible cases for interval atan2:
-    // - Completely within a quadrant (4 cases)
-    // - Completely within two quadrants (4 cases)
-    // - Containing the origin (1 case)
-
-    if (x.lower() > 0)
-    {   // Right half of the plane
-        if (y.lower() > 0)
-        {   // 1st quadrant
-            return Kernel::Interval(atan2(y.lower(), x.upper()),
-                                    atan2(y.upper(), x.lower()));
-        }
-        else if (y.upper() < 0)
-        {   // 4th quadrant
-            return Kernel::Interval(atan2(y.lower(), x.lower()),
-                                    atan2(y.upper(), x.upper()));
-        }
-        else
-        {   // Crossing the X axis
-            return Kernel::Interval(atan2(y.lower(), x.lower()),
-                                    atan2(y.upper(), x.lower()));
-        }
+    /*
+     *  Constructs an interval from bounds of some other type (e.g. double),
+     *  rounding them outwards to floats
+     */
+    template <class A, class B>
+    Interval(A lower, B upper)
+        : Interval(roundDown(double(lower)), roundUp(double(upper))) {}
+
+    float lower() const { return lo; }
+    float upper() const { return hi; }
+
+    bool isEmpty() const { return std::isnan(lo); }
+
+    static Interval empty()
+        { return Interval(std::numeric_limits<float>::quiet_NaN()); }
+    static Interval whole()
+        { return Interval(-INFINITY, INFINITY); }
+
+    /*
+     *  Rounds a double to the nearest float below or above it
+     *  (NaN is passed through)
+     */
+    static float roundDown(double d)
+    {
+        float f = static_cast<float>(d);
+        return (f > d) ? std::nextafter(f, -INFINITY) : f;
+    }
+    static float roundUp(double d)
+    {
+        float f = static_cast<float>(d);
+        return (f < d) ? std::nextafter(f, INFINITY) : f;
     }
-    else if (x.upper() < 0)
-    {   // Left half of the plane
-        if (y.lower() > 0)
-        {   // 2nd quadrant
-            return Kernel::Interval(atan2(y.upper(), x.upper()),
-                                    atan2(y.lower(), x.lower()));
+
+    /*
+     *  Adds two floats, rounding downwards or upwards.
+     *
+     *  The rounding error of a + b is recovered exactly with Knuth's
+     *  TwoSum, unless the sum overflowed (in which case it's pulled back
+     *  to the largest finite float when rounding towards zero).
+     */
+    static float addDown(float a, float b)
+    {
+        const float s = a + b;
+        if (std::isinf(s))
+        {
+            return (s > 0 && std::isfinite(a) && std::isfinite(b)) ? FLT_MAX
+                                                                   : s;
         }
-        else if (y.upper() < 0)
-        {   // 3rd quadrant
-            return Kernel::Interval(atan2(y.upper(), x.lower()),
-                                    atan2(y.lower(), x.upper()));
+        const float bv = s - a;
+        const float err = (a - (s - bv)) + (b - bv);
+        return (err < 0) ? std::nextafter(s, -INFINITY) : s;
+    }
+    static float addUp(float a, float b)
+    {
+        const float s = a + b;
+        if (std::isinf(s))
+        {
+            return (s < 0 && std::isfinite(a) && std::isfinite(b)) ? -FLT_MAX
+                                                                   : s;
         }
-        else
-        {   // Branch cut
-            return Kernel::Interval(-M_PI, M_PI);
+        const float bv = s - a;
+        const float err = (a - (s - bv)) + (b - bv);
+        return (err > 0) ? std::nextafter(s, INFINITY) : s;
+    }
+
+    /*
+     *  Multiplies or divides two floats, rounding downwards or upwards.
+     *
+     *  The product of two floats is exact in double precision.  A quotient
+     *  that isn't exact is at least 2^-48 (relative) away from any float,
+     *  so rounding it to double can't land on a float boundary.
+     */
+    static float mulDown(float a, float b)
+        { return roundDown(double(a) * double(b)); }
+    static float mulUp(float a, float b)
+        { return roundUp(double(a) * double(b)); }
+    static float divDown(float a, float b)
+        { return roundDown(double(a) / double(b)); }
+    static float divUp(float a, float b)
+        { return roundUp(double(a) / double(b)); }
+
+    /*
+     *  Arithmetic operators and functions are friends, so that they're
+     *  only found by argument-dependent lookup: otherwise, they'd hide
+     *  the std:: overloads (e.g. sqrt(float)) from unqualified calls
+     *  elsewhere in namespace Kernel, which would quietly convert to an
+     *  Interval through the implicit constructor above.
+     */
+    friend Interval operator+(const Interval& a, const Interval& b)
+    {
+        return Interval(addDown(a.lo, b.lo), addUp(a.hi, b.hi));
+    }
+
+    friend Interval operator-(const Interval& a)
+    {
+        return Interval(-a.hi, -a.lo);
+    }
+
+    friend Interval operator-(const Interval& a, const Interval& b)
+    {
+        return Interval(addDown(a.lo, -b.hi), addUp(a.hi, -b.lo));
+    }
+
+    friend Interval min(const Interval& a, const Interval& b)
+    {
+        if (a.isEmpty() || b.isEmpty())
+        {
+            return empty();
         }
+        return Interval(std::fmin(a.lo, b.lo), std::fmin(a.hi, b.hi));
     }
-    else
-    {  // Both sides of the plane
-        if (y.lower() > 0)
-        {   // Top half of the plane
-            return Kernel::Interval(atan2(y.lower(), x.upper()),
-                                    atan2(y.lower(), x.lower()));
+
+    friend Interval max(const Interval& a, const Interval& b)
+    {
+        if (a.isEmpty() || b.isEmpty())
+        {
+            return empty();
         }
-        else if (y.upper() < 0)
+        return Interval(std::fmax(a.lo, b.lo), std::fmax(a.hi, b.hi));
+    }
+
+    friend Interval abs(const Interval& a)
+    {
+        if (a.lo >= 0)
         {
-            // Bottom half of the plane
-            return Kernel::Interval(atan2(y.upper(), x.lower()),
-                                    atan2(y.upper(), x.upper()));
+            return a;
         }
-        else
+        else if (a.hi <= 0)
         {
-            // Contains the origin
-            return Kernel::Interval(-M_PI, M_PI);
+            return -a;
         }
+        // If a is empty, both bounds are NaN, so this is empty too
+        return Interval(0.0f, std::fmax(-a.lo, a.hi));
     }
-}
+
+    friend Interval operator*(const Interval& a, const Interval& b);
+    friend Interval operator/(const Interval& a, const Interval& b);
+
+    friend Interval square(const Interval& a);
+    friend Interval sqrt(const Interval& a);
+    friend Interval pow(const Interval& a, int p);
+    friend Interval nth_root(const Interval& a, int n);
+
+    /*
+     *  Real-valued versions of pow and nth_root (matching std::pow, so
+     *  negative bases only have integer powers, and a^0 is 1), where the
+     *  exponent and root may themselves be intervals
+     */
+    friend Interval pow(const Interval& a, const Interval& b);
+    friend Interval nth_root(const Interval& a, const Interval& n);
+
+    /*
+     *  Floored modulo, which is in [0, b) for positive b
+     */
+    friend Interval mod(const Interval& a, const Interval& b);
+
+    /*
+     *  Bounds a where it's a number and b where it's NaN.  As an interval
+     *  doesn't record whether its clause was NaN anywhere in the box (e.g.
+     *  the square root of [-1, 1] is [0, 1]), a non-empty a can only be
+     *  narrowed to a itself if b is empty.
+     */
+    friend Interval nanfill(const Interval& a, const Interval& b);
+
+    friend Interval sin(const Interval& a);
+    friend Interval cos(const Interval& a);
+    friend Interval tan(const Interval& a);
+    friend Interval asin(const Interval& a);
+    friend Interval acos(const Interval& a);
+    friend Interval atan(const Interval& a);
+    friend Interval exp(const Interval& a);
+    friend Interval atan2(const Interval& y, const Interval& x);
+
+protected:
+    void setEmpty()
+        { lo = hi = std::numeric_limits<float>::quiet_NaN(); }
+
+    float lo;
+    float hi;
+};
+
+}   // namespace Kernel
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "kernel/eval/backend.hpp"
+#include "kernel/eval/clause.hpp"
+#include "kernel/eval/result.hpp"
+
+namespace Kernel {
+
+/*
+ *  Jit compiles an evaluation tape into straight-line x86-64 AVX code,
+ *  which is stored in its own executable (mmap'd) buffer.
+ *
+ *  The compiled function loops over a batch of points, eight at a time;
+ *  for each group of eight, it runs through every clause in the tape
+ *  without any dispatch, loading arguments from and storing results to
+ *  the Result::f rows.  Rows are addressed relative to the first row,
+ *  so the same code works for any Result with the same layout.
+ *
+ *  Opcodes without a native kernel (e.g. the transcendentals) are compiled
+ *  into a call to a fallback backend's values kernel for those eight floats.
+ *
+ *  The JIT is off by default; it can be turned on with setEnabled or by
+ *  setting the STRAYLIGHT_JIT environment variable to 1.
+ */
+class Jit
+{
+public:
+    /*  Number of floats handled by each pass through the compiled tape  */
+    static constexpr Result::Index WIDTH = 8;
+
+    /*
+     *  Compiles a tape, which is stored in reverse order (as in the
+     *  Evaluator), where slots maps clause ids to rows of Result::f.
+     *
+     *  fallback is used for opcodes without a native kernel, and must
+     *  have a width that divides WIDTH (see fallbackFor)
+     *
+     *  Returns an empty pointer if the JIT isn't available on this
+     *  platform or the tape can't be compiled.
+     */
+    static std::unique_ptr<Jit> compile(const std::vector<Clause>& tape,
+                                        const std::vector<Result::Index>& slots,
+                                        const Backend& fallback);
+
+    /*
+     *  Evaluates the compiled tape for the first count points, given a
+     *  pointer to the first row of Result::f
+     *
+     *  count is rounded up to a multiple of WIDTH (which is safe, as
+     *  Result rows are padded).
+     */
+    void run(Result::Row* rows, Result::Index count) const
+    {
+        float* begin = &rows[0][0];
+        function(begin, begin + (count + WIDTH - 1) / WIDTH * WIDTH);
+    }
+
+    /*
+     *  Picks a backend that can be called by compiled code, preferring
+     *  the given one if it's narrow enough
+     */
+    static const Backend& fallbackFor(const Backend& b);
+
+    /*
+     *  Checks whether the JIT can run on this CPU and OS
+     */
+    static bool available();
+
+    /*
+     *  Checks or sets whether new Evaluators use the JIT
+     *  (it's only used when it's also available)
+     */
+    static bool enabled();
+    static void setEnabled(bool e);
+
+    /*
+     *  Tapes are compiled when they're evaluated for the THRESHOLD'th time,
+     *  so that the cost of compiling isn't paid for pushed tapes that are
+     *  only evaluated once (e.g. at octree leaf cells)
+     */
+    static constexpr unsigned THRESHOLD = 2;
+
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+protected:
+    typedef void (*Function)(float* begin, const float* end);
+
+    Jit(void* buffer, size_t size);
+
+    /*  Executable buffer, which is size bytes long  */
+    void* buffer;
+    size_t size;
+
+    /*  The compiled tape, which lives in buffer  */
+    Function function;
+};
+
+}   // namespace Kernel
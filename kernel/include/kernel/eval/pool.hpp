@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "kernel/eval/evaluator.hpp"
+#include "kernel/tree/tree.hpp"
+
+namespace Kernel {
+
+/*
+ *  An EvaluatorPool keeps idle Evaluators around between renders, so that
+ *  repeated renders of the same tree skip flattening and allocation.
+ *
+ *  Evaluators are keyed by Tree::Id.  The pool holds a handle to each tree
+ *  that it has evaluators for, so an Id can't be reused by a different tree
+ *  while it's in the pool.  Variable values aren't part of the key: they're
+ *  loaded into the Evaluator on every checkout.
+ *
+ *  The number of idle evaluators is bounded; when the pool is full, the
+ *  least recently used tree's evaluators are deleted first.
+ */
+class EvaluatorPool
+{
+public:
+    /*  Returns an Evaluator to the pool that it came from  */
+    struct Checkin
+    {
+        EvaluatorPool* pool;
+        Tree::Id key;
+        void operator()(Evaluator* e) const { pool->checkin(key, e); }
+    };
+
+    /*  Evaluators are checked back in when their Handle is destroyed.
+     *  They must be popped back to their root tape by then.  */
+    typedef std::unique_ptr<Evaluator, Checkin> Handle;
+
+    /*
+     *  Returns the process-wide pool
+     */
+    static EvaluatorPool& instance();
+
+    /*
+     *  Constructs an empty pool, which holds up to capacity idle evaluators
+     */
+    explicit EvaluatorPool(size_t capacity=64) : capacity(capacity) {}
+
+    /*
+     *  Deletes all idle evaluators (all handles must have been destroyed)
+     */
+    ~EvaluatorPool();
+
+    /*
+     *  Checks out an evaluator for the given tree, constructing one
+     *  if there isn't an idle one available.
+     *
+     *  The evaluator has an identity matrix, the active backend, the
+     *  default JIT setting and interval mode, and zeroed counts, with the
+     *  given variable values loaded.
+     */
+    Handle checkout(const Tree t, const std::map<Tree::Id, float>& vars=
+                                        std::map<Tree::Id, float>());
+
+    /*
+     *  Checks out count evaluators for the same tree
+     */
+    std::vector<Handle> checkout(const Tree t, size_t count,
+                                 const std::map<Tree::Id, float>& vars=
+                                        std::map<Tree::Id, float>());
+
+    /*
+     *  Sets the maximum number of idle evaluators,
+     *  deleting the least recently used ones if necessary
+     */
+    void setCapacity(size_t c);
+
+    /*
+     *  Deletes all idle evaluators
+     */
+    void clear();
+
+    struct Stats
+    {
+        /*  Checkouts that reused an idle evaluator  */
+        uint64_t hits;
+        /*  Checkouts that constructed a new evaluator  */
+        uint64_t misses;
+        /*  Idle evaluators deleted to stay under capacity  */
+        uint64_t evictions;
+        /*  Current number of idle evaluators  */
+        size_t idle;
+    };
+    Stats stats() const;
+
+    EvaluatorPool(const EvaluatorPool&) = delete;
+    EvaluatorPool& operator=(const EvaluatorPool&) = delete;
+
+protected:
+    /*
+     *  Returns an evaluator to the pool (called by Handle)
+     */
+    void checkin(Tree::Id key, Evaluator* e);
+
+    /*
+     *  Deletes idle evaluators (least recently used first) until there are
+     *  no more than capacity of them.  mut must be locked.
+     */
+    void evict();
+
+    struct Entry
+    {
+        /*  Keeps the tree (and so its Id) alive  */
+        Tree tree;
+
+        /*  Shared between every evaluator for this tree  */
+        std::shared_ptr<const Program> program;
+
+        std::vector<Evaluator*> idle;
+
+        /*  Number of evaluators that are checked out  */
+        size_t active;
+
+        /*  Value of clock when this entry was last used  */
+        uint64_t used;
+    };
+    std::map<Tree::Id, Entry> entries;
+
+    size_t capacity;
+    size_t idle=0;
+    uint64_t clock=0;
+
+    Stats counts={0, 0, 0, 0};
+
+    mutable std::mutex mut;
+};
+
+}   // namespace Kernel
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/bimap.hpp>
+
+#include "kernel/eval/result.hpp"
+#include "kernel/eval/clause.hpp"
+#include "kernel/tree/tree.hpp"
+
+namespace Kernel {
+
+/*
+ *  A Program is a Tree compiled for evaluation: it holds the flattened
+ *  tape, constants, variable map, and the assignment of clauses to rows
+ *  in a Result.
+ *
+ *  A Program is immutable once it's shared, so a single Program can be
+ *  shared (with a std::shared_ptr) between any number of Evaluators on
+ *  any number of threads.  Each Evaluator only owns its scratch Result
+ *  and tape stack.  Before then, it can be patched to match an edited
+ *  tree with update (see EvaluatorBase::setTree).
+ */
+class Program
+{
+public:
+    /*
+     *  Flattens the given tree into a tape
+     */
+    explicit Program(const Tree root);
+
+    /*
+     *  Flattens a set of trees into a single tape with one output per root.
+     *  Subexpressions that are shared between trees (which is common, as
+     *  trees are deduplicated by the Cache) are only evaluated once.
+     */
+    explicit Program(const std::vector<Tree>& roots);
+
+    /*
+     *  Returns the number of clauses in the tape
+     *  (not counting location-agnostic clauses in the prelude)
+     */
+    size_t size() const { return tape.size(); }
+
+    /*
+     *  Returns the number of Result rows that an Evaluator needs
+     */
+    Result::Index rows() const { return row_count; }
+
+    /*
+     *  Returns the number of outputs (one per root)
+     */
+    size_t outputs() const { return roots.size(); }
+
+    /*
+     *  Updates the program to evaluate a new set of trees.
+     *
+     *  Only nodes that aren't already in the program are flattened, and
+     *  their clauses are added to the front of the tape (so they run last);
+     *  clauses that are no longer used are dropped.  When an edit changes
+     *  a single subtree, this costs one pass over the tape (rather than a
+     *  full walk of the tree).  Once most clause ids are unused, the
+     *  program is rebuilt from scratch.
+     *
+     *  This must not be called on a Program that is shared.
+     */
+    void update(const std::vector<Tree>& roots);
+
+protected:
+    /*
+     *  Assigns each clause id to a row in a Result, reusing rows once their
+     *  clause's value is no longer needed.  Populates slot and row_count.
+     */
+    void assignSlots();
+
+    /*  Clauses in reverse evaluation order (so the root is at the front)  */
+    std::vector<Clause> tape;
+
+    /*  Location-agnostic clauses (which only depend on constants and
+     *  variables), in reverse evaluation order.  These aren't in the tape;
+     *  instead, Evaluators run them once whenever a variable changes and
+     *  broadcast their results, so the tape treats them as constants.  */
+    std::vector<Clause> prelude;
+
+    /*  Clause ids of each tree's root, in the order they were given  */
+    std::vector<Clause::Id> roots;
+
+    /*  Store the root opcodes explicitly so that we can convert back into
+     *  trees even if there's nothing in the tape  */
+    std::vector<Opcode::Opcode> root_ops;
+
+    /*  Values of CONST clauses  */
+    std::map<Clause::Id, float> constants;
+
+    /*  Map of variables (in terms of their clause ids) to their ids in their
+     *  respective Tree (e.g. what you get when calling Tree::var().id()) */
+    boost::bimap<Clause::Id, Tree::Id> vars;
+
+    /*  Clause id of every flattened node (including constants, variables,
+     *  and X, Y, Z), along with a handle to the node, which keeps its Id
+     *  from being reused by another tree while it's in the program  */
+    std::unordered_map<Tree::Id, std::pair<Clause::Id, Tree>> clauses;
+
+    /*  Maps clause ids back to their nodes (with nullptr for the dummy
+     *  clause and for ids whose nodes were dropped by update)  */
+    std::vector<Tree::Id> trees;
+
+    /*  Rows in a Result for X, Y, Z coordinates */
+    Result::Index X, Y, Z;
+
+    /*  Maps clause ids to rows in a Result.  Clauses whose values are never
+     *  needed at the same time share a row, so a Result is only as large
+     *  as the tape's maximum live width (see assignSlots).  Roots always
+     *  get their own rows, so every output can be read after evaluation.  */
+    std::vector<Result::Index> slot;
+    Result::Index row_count;
+
+    friend class EvaluatorBase;
+};
+
+}   // namespace Kernel
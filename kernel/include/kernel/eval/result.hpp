@@ -3,29 +3,43 @@
 #include <array>
 #include <vector>
 
+#include "kernel/eval/affine.hpp"
 #include "kernel/eval/interval.hpp"
 #include "kernel/eval/clause.hpp"
 
-#ifdef __AVX__
-#include <immintrin.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#else
+#include <cstdlib>
+#endif
 
 namespace Kernel {
 
-// AVX data needs to be aligned on 32-byte boundaries.
-// This isn't the default on certain OSs, so we make a custom allocator
-// here that uses _mm_malloc and _mm_free.
+// Vectorized evaluation needs data aligned to the SIMD width (up to 64 bytes
+// for AVX-512).  This isn't the default on certain OSs, so we make a custom
+// allocator here that uses _mm_malloc and _mm_free.
 template <class T>
 struct _AlignedAllocator {
     typedef T value_type;
+    static constexpr std::size_t ALIGNMENT = 64;
+
     _AlignedAllocator() noexcept {}
 
     template <class U>
     _AlignedAllocator(const _AlignedAllocator<U>& /*other*/) throw() {}
 
+#if defined(__SSE__)
     T* allocate(std::size_t n)
-        { return static_cast<T*>(_mm_malloc(n * sizeof(T), 32)); }
+        { return static_cast<T*>(_mm_malloc(n * sizeof(T), ALIGNMENT)); }
     void deallocate(T* p, std::size_t /*n*/)
         { _mm_free(p); }
+#else
+    // Without SIMD, alignment doesn't matter
+    T* allocate(std::size_t n)
+        { return static_cast<T*>(malloc(n * sizeof(T))); }
+    void deallocate(T* p, std::size_t /*n*/)
+        { free(p); }
+#endif
 };
 
 template <typename T, typename U>
@@ -37,36 +51,41 @@ template <typename T, typename U>
 inline bool operator!=(const _AlignedAllocator<T>& a,
                        const _AlignedAllocator<U>& b)
     { return !(a == b); }
-#endif
-
 
 struct Result {
     typedef Clause::Id Index;
 
     /*
      *  Prepares the given number of clauses
+     *
+     *  Derivative rows and batched interval rows (along with affine
+     *  and interval derivative scratch space) are left empty, as most
+     *  evaluators only ever need values and single intervals; they're
+     *  allocated on first use by resizeDerivs and resizeIntervals.
      */
-    void resize(Index clauses, Index vars=0);
+    void resize(Index clauses);
 
     /*
-     *  Sets all of the values to the given constant float
-     *  (across the Interval, and float / __m256 arrays)
-     *
-     *  Gradients are set to {0, 0, 0}
-     *  Gradient is set to 0
+     *  Allocates (zero-filled) derivative rows for every clause
      */
-    void fill(float v, Index clause);
+    void resizeDerivs();
 
     /*
-     *  Sets all of the values to the given constant float
-     *  (across the Interval, and float / __m256 arrays)
+     *  Allocates batched interval rows, affine forms, and interval
+     *  derivatives for every clause, filling them with the value
+     *  stored in the float array (so constants carry over)
      */
-    void setValue(float v, Index clause);
+    void resizeIntervals();
+
 
     /*
-     *  Marks that j[clause][var] = 1
+     *  Sets all of the values to the given constant float
+     *  (across the Interval and float arrays)
+     *
+     *  Derivatives (if allocated) are set to {0, 0, 0}, and batched
+     *  intervals and affine forms (if allocated) are set to the value
      */
-    void setGradient(Index clause, Index var);
+    void setValue(float v, Index clause);
 
     /*
      *  Fills the derivative arrays with the given values
@@ -76,31 +95,46 @@ struct Result {
     // This is the number of samples that we can process in one pass
     static constexpr Index N = 256;
 
-#ifdef __AVX__
-    typedef std::array<__m256, N/8> AVXArray;
-    typedef std::vector<AVXArray, _AlignedAllocator<AVXArray>> AVXVector;
-
-    AVXVector mf;
-    AVXVector mdx;
-    AVXVector mdy;
-    AVXVector mdz;
-
-    // If we're using AVX for evaluation, then our floats are simply
-    // pointers to the first member of the __m256 array
-    float (*f)[N];
-    float (*dx)[N];
-    float (*dy)[N];
-    float (*dz)[N];
-#else
-    std::vector<std::array<float, N>> f;
-    std::vector<std::array<float, N>> dx;
-    std::vector<std::array<float, N>> dy;
-    std::vector<std::array<float, N>> dz;
-#endif
-    /*  j[clause][var] = dclause / dvar */
-    std::vector<std::vector<float>> j;
+    // Each row holds N floats, and rows are stored contiguously with
+    // the aligned allocator, so every row starts on a 64-byte boundary
+    // (as N * sizeof(float) is a multiple of 64).  Vectorized evaluators
+    // reinterpret rows as arrays of their native vector type.
+    typedef std::array<float, N> Row;
+    typedef std::vector<Row, _AlignedAllocator<Row>> Rows;
+
+    Rows f;
+
+    /*  Partial derivatives, which are empty until resizeDerivs is called  */
+    Rows dx;
+    Rows dy;
+    Rows dz;
+
+    /*  Nonzero where a min or max was ambiguous (set by derivs).
+     *  This is a single row, stored in Rows so that it's aligned.  */
+    Rows ambiguous;
+
+    // This is the number of boxes that we can store for batched interval
+    // evaluation.  Interval rows are padded by the widest SIMD width, so
+    // that vectorized kernels can round a count of boxes up to a whole
+    // number of vectors starting at any index.
+    static constexpr Index NI = 128;
+    typedef std::array<float, NI + 16> IntervalRow;
+    typedef std::vector<IntervalRow, _AlignedAllocator<IntervalRow>>
+        IntervalRows;
+
+    /*  Lower and upper bounds for batched interval evaluation,
+     *  which are empty until resizeIntervals is called  */
+    IntervalRows lower;
+    IntervalRows upper;
 
     std::vector<Interval> i;
+
+    /*  Scratch space for affine arithmetic (see EvaluatorBase::affine)  */
+    std::vector<Affine> a;
+
+    /*  Interval derivatives with respect to the input box's axes
+     *  (see EvaluatorBase::meanValue)  */
+    std::vector<std::array<Interval, 3>> di;
 };
 
 }   // namespace Kernel
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace Kernel {
+namespace SIMD {
+
+/*
+ *  These structs are width policies for the vectorized evaluator.
+ *
+ *  Each one wraps a particular instruction set's intrinsics behind a
+ *  common set of static functions, so that EvaluatorSIMD<W> can be written
+ *  once and instantiated at every width that the compiler supports.
+ *
+ *  Every policy provides
+ *      V:      a vector of WIDTH floats
+ *      M:      a lane mask, as produced by the comparison functions
+ *  with the convention that blend(a, b, m) picks b in lanes where m is set.
+ *  load and store don't require their pointers to be aligned.
+ */
+
+#if defined(__SSE2__)
+struct SSE
+{
+    typedef __m128 V;
+    typedef __m128 M;
+    static constexpr unsigned WIDTH = 4;
+
+    static V set(float f)           { return _mm_set1_ps(f); }
+    static V zero()                 { return _mm_setzero_ps(); }
+    static V load(const float* p)   { return _mm_loadu_ps(p); }
+    static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+
+    static V add(V a, V b)          { return _mm_add_ps(a, b); }
+    static V sub(V a, V b)          { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b)          { return _mm_mul_ps(a, b); }
+    static V div(V a, V b)          { return _mm_div_ps(a, b); }
+    static V min(V a, V b)          { return _mm_min_ps(a, b); }
+    static V max(V a, V b)          { return _mm_max_ps(a, b); }
+    static V sqrt(V a)              { return _mm_sqrt_ps(a); }
+
+    /*  Returns a * b + c  */
+    static V fma(V a, V b, V c)
+#if defined(__FMA__)
+        { return _mm_fmadd_ps(a, b, c); }
+#else
+        { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#endif
+
+    static V floor(V a)
+#if defined(__SSE4_1__)
+        { return _mm_floor_ps(a); }
+#else
+    {
+        // Truncate, then step down if truncation rounded up; values above
+        // 2^23 are already integral (and would overflow the conversion)
+        V t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), set(1)));
+        return blend(t, a, _mm_cmpge_ps(abs(a), set(8388608.0f)));
+    }
+#endif
+
+    static V bitAnd(V a, V b)       { return _mm_and_ps(a, b); }
+    static V bitOr(V a, V b)        { return _mm_or_ps(a, b); }
+    static V bitXor(V a, V b)       { return _mm_xor_ps(a, b); }
+    static V abs(V a)               { return _mm_andnot_ps(set(-0.0f), a); }
+    static V sign(V a)              { return _mm_and_ps(set(-0.0f), a); }
+
+    static M lt(V a, V b)           { return _mm_cmplt_ps(a, b); }
+    static M le(V a, V b)           { return _mm_cmple_ps(a, b); }
+    static M gt(V a, V b)           { return _mm_cmpgt_ps(a, b); }
+    static M ge(V a, V b)           { return _mm_cmpge_ps(a, b); }
+    static M eq(V a, V b)           { return _mm_cmpeq_ps(a, b); }
+    static M unord(V a, V b)        { return _mm_cmpunord_ps(a, b); }
+
+    static M maskAnd(M a, M b)      { return _mm_and_ps(a, b); }
+    static M maskOr(M a, M b)       { return _mm_or_ps(a, b); }
+    /*  Returns (~a & b)  */
+    static M maskAndNot(M a, M b)   { return _mm_andnot_ps(a, b); }
+    static bool any(M m)            { return _mm_movemask_ps(m) != 0; }
+
+    static V blend(V a, V b, M m)
+#if defined(__SSE4_1__)
+        { return _mm_blendv_ps(a, b, m); }
+#else
+        { return _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a)); }
+#endif
+
+    /*  Returns 2^n, for integral n in [-126, 127]  */
+    static V pow2n(V n)
+    {
+        __m128i i = _mm_cvtps_epi32(_mm_add_ps(n, set(127)));
+        return _mm_castsi128_ps(_mm_slli_epi32(i, 23));
+    }
+
+    /*
+     *  Splits a positive normal float into a mantissa in [0.5, 1)
+     *  and an integral-valued exponent
+     */
+    static V frexp(V x, V* e)
+    {
+        __m128i i = _mm_srli_epi32(_mm_castps_si128(x), 23);
+        *e = _mm_cvtepi32_ps(_mm_sub_epi32(i, _mm_set1_epi32(126)));
+        x = _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(~0x7f800000)));
+        return _mm_or_ps(x, set(0.5f));
+    }
+};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX__)
+struct AVX
+{
+    typedef __m256 V;
+    typedef __m256 M;
+    static constexpr unsigned WIDTH = 8;
+
+    static V set(float f)           { return _mm256_set1_ps(f); }
+    static V zero()                 { return _mm256_setzero_ps(); }
+    static V load(const float* p)   { return _mm256_loadu_ps(p); }
+    static void store(float* p, V a) { _mm256_storeu_ps(p, a); }
+
+    static V add(V a, V b)          { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b)          { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b)          { return _mm256_mul_ps(a, b); }
+    static V div(V a, V b)          { return _mm256_div_ps(a, b); }
+    static V min(V a, V b)          { return _mm256_min_ps(a, b); }
+    static V max(V a, V b)          { return _mm256_max_ps(a, b); }
+    static V sqrt(V a)              { return _mm256_sqrt_ps(a); }
+    static V floor(V a)             { return _mm256_floor_ps(a); }
+
+    /*  Returns a * b + c  */
+    static V fma(V a, V b, V c)
+#if defined(__FMA__)
+        { return _mm256_fmadd_ps(a, b, c); }
+#else
+        { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+    static V bitAnd(V a, V b)       { return _mm256_and_ps(a, b); }
+    static V bitOr(V a, V b)        { return _mm256_or_ps(a, b); }
+    static V bitXor(V a, V b)       { return _mm256_xor_ps(a, b); }
+    static V abs(V a)               { return _mm256_andnot_ps(set(-0.0f), a); }
+    static V sign(V a)              { return _mm256_and_ps(set(-0.0f), a); }
+
+    // We use comparison operators which are
+    //      ordered (which defines how they handle NaNs)
+    //      quiet (meaning they don't signal on NaN)
+    static M lt(V a, V b)           { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M le(V a, V b)           { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static M gt(V a, V b)           { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M ge(V a, V b)           { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static M eq(V a, V b)           { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static M unord(V a, V b)        { return _mm256_cmp_ps(a, b, _CMP_UNORD_Q); }
+
+    static M maskAnd(M a, M b)      { return _mm256_and_ps(a, b); }
+    static M maskOr(M a, M b)       { return _mm256_or_ps(a, b); }
+    /*  Returns (~a & b)  */
+    static M maskAndNot(M a, M b)   { return _mm256_andnot_ps(a, b); }
+    static bool any(M m)            { return _mm256_movemask_ps(m) != 0; }
+
+    static V blend(V a, V b, M m)   { return _mm256_blendv_ps(a, b, m); }
+
+    /*  Returns 2^n, for integral n in [-126, 127]  */
+    static V pow2n(V n)
+    {
+        __m256i i = _mm256_cvtps_epi32(_mm256_add_ps(n, set(127)));
+#if defined(__AVX2__)
+        i = _mm256_slli_epi32(i, 23);
+#else
+        // Without AVX2, we have to do integer math on 128-bit halves
+        __m128i lo = _mm_slli_epi32(_mm256_castsi256_si128(i), 23);
+        __m128i hi = _mm_slli_epi32(_mm256_extractf128_si256(i, 1), 23);
+        i = _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+#endif
+        return _mm256_castsi256_ps(i);
+    }
+
+    /*
+     *  Splits a positive normal float into a mantissa in [0.5, 1)
+     *  and an integral-valued exponent
+     */
+    static V frexp(V x, V* e)
+    {
+        __m256i i = _mm256_castps_si256(x);
+#if defined(__AVX2__)
+        __m256i ei = _mm256_sub_epi32(_mm256_srli_epi32(i, 23),
+                                      _mm256_set1_epi32(126));
+#else
+        __m128i lo = _mm_sub_epi32(
+                _mm_srli_epi32(_mm256_castsi256_si128(i), 23),
+                _mm_set1_epi32(126));
+        __m128i hi = _mm_sub_epi32(
+                _mm_srli_epi32(_mm256_extractf128_si256(i, 1), 23),
+                _mm_set1_epi32(126));
+        __m256i ei = _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+#endif
+        *e = _mm256_cvtepi32_ps(ei);
+
+        x = _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(~0x7f800000)));
+        return _mm256_or_ps(x, set(0.5f));
+    }
+};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX512F__)
+struct AVX512
+{
+    typedef __m512 V;
+    typedef __mmask16 M;
+    static constexpr unsigned WIDTH = 16;
+
+    static V set(float f)           { return _mm512_set1_ps(f); }
+    static V zero()                 { return _mm512_setzero_ps(); }
+    static V load(const float* p)   { return _mm512_loadu_ps(p); }
+    static void store(float* p, V a) { _mm512_storeu_ps(p, a); }
+
+    static V add(V a, V b)          { return _mm512_add_ps(a, b); }
+    static V sub(V a, V b)          { return _mm512_sub_ps(a, b); }
+    static V mul(V a, V b)          { return _mm512_mul_ps(a, b); }
+    static V div(V a, V b)          { return _mm512_div_ps(a, b); }
+    static V min(V a, V b)          { return _mm512_min_ps(a, b); }
+    static V max(V a, V b)          { return _mm512_max_ps(a, b); }
+    static V sqrt(V a)              { return _mm512_sqrt_ps(a); }
+    static V fma(V a, V b, V c)     { return _mm512_fmadd_ps(a, b, c); }
+    static V floor(V a)
+        { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF |
+                                         _MM_FROUND_NO_EXC); }
+
+    // Floating-point bitwise operations require AVX512DQ,
+    // so we go through the integer unit instead
+    static V bitAnd(V a, V b)
+        { return _mm512_castsi512_ps(_mm512_and_si512(
+                    _mm512_castps_si512(a), _mm512_castps_si512(b))); }
+    static V bitOr(V a, V b)
+        { return _mm512_castsi512_ps(_mm512_or_si512(
+                    _mm512_castps_si512(a), _mm512_castps_si512(b))); }
+    static V bitXor(V a, V b)
+        { return _mm512_castsi512_ps(_mm512_xor_si512(
+                    _mm512_castps_si512(a), _mm512_castps_si512(b))); }
+    static V abs(V a)
+        { return _mm512_castsi512_ps(_mm512_and_si512(
+                    _mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+    static V sign(V a)              { return bitAnd(set(-0.0f), a); }
+
+    static M lt(V a, V b)           { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M le(V a, V b)           { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static M gt(V a, V b)           { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static M ge(V a, V b)           { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static M eq(V a, V b)           { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static M unord(V a, V b)        { return _mm512_cmp_ps_mask(a, b, _CMP_UNORD_Q); }
+
+    static M maskAnd(M a, M b)      { return a & b; }
+    static M maskOr(M a, M b)       { return a | b; }
+    /*  Returns (~a & b)  */
+    static M maskAndNot(M a, M b)   { return static_cast<M>(~a & b); }
+    static bool any(M m)            { return m != 0; }
+
+    static V blend(V a, V b, M m)   { return _mm512_mask_blend_ps(m, a, b); }
+
+    /*  Returns 2^n, for integral n in [-126, 127]  */
+    static V pow2n(V n)
+    {
+        __m512i i = _mm512_cvtps_epi32(_mm512_add_ps(n, set(127)));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(i, 23));
+    }
+
+    /*
+     *  Splits a positive normal float into a mantissa in [0.5, 1)
+     *  and an integral-valued exponent
+     */
+    static V frexp(V x, V* e)
+    {
+        __m512i i = _mm512_srli_epi32(_mm512_castps_si512(x), 23);
+        *e = _mm512_cvtepi32_ps(_mm512_sub_epi32(i, _mm512_set1_epi32(126)));
+        x = _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x),
+                    _mm512_set1_epi32(~0x7f800000)));
+        return bitOr(x, set(0.5f));
+    }
+};
+#endif
+
+}   // namespace SIMD
+}   // namespace Kernel
@@ -19,10 +19,13 @@ namespace Heightmap
  *  Render a height-map image into an array of floats (representing depth)
  *  and the height-map's normals into a shaded image with R, G, B, A packed
  *  into int32_t pixels.
+ *
+ *  mode selects how regions are bounded (see EvaluatorBase::IntervalMode)
  */
 std::pair<DepthImage, NormalImage> render(
         const Tree t, Region r, const std::atomic_bool& abort,
-        glm::mat4 m=glm::mat4(), size_t threads=8);
+        glm::mat4 m=glm::mat4(), size_t threads=8,
+        Evaluator::IntervalMode mode=Evaluator::INTERVAL_ARITHMETIC);
 
 std::pair<DepthImage, NormalImage> render(
         const std::vector<Evaluator*>& es, Region r,
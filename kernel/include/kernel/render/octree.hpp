@@ -9,6 +9,7 @@ class Octree : public XTree<Octree, 3>
 protected:
     Octree(const Subregion& r);
     Octree(Evaluator* e, const Subregion& r);
+    Octree(Evaluator* e, const Subregion& r, Interval i, Result::Index lane);
     Octree(Evaluator* e, const std::array<Octree*, 8>& cs, const Subregion& r);
 
     static const std::vector<bool>& cornerTable()
@@ -8,6 +8,7 @@ class Quadtree : public XTree<Quadtree, 2>
 {
     Quadtree(const Subregion& r);
     Quadtree(Evaluator* e, const Subregion& r);
+    Quadtree(Evaluator* e, const Subregion& r, Interval i, Result::Index lane);
     Quadtree(Evaluator* e, const std::array<Quadtree*, 4>& cs,
              const Subregion& r);
 
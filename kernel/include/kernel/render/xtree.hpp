@@ -10,6 +10,7 @@
 
 #include "kernel/eval/interval.hpp"
 #include "kernel/eval/evaluator.hpp"
+#include "kernel/eval/pool.hpp"
 #include "kernel/render/region.hpp"
 #include "kernel/render/axes.hpp"
 #include "kernel/tree/tree.hpp"
@@ -26,7 +27,13 @@ template <class T, int dims>
 class XTree
 {
 public:
-    static T* render(const Tree t, const Region& r, bool multithread=true);
+    /*
+     *  Renders a tree over the given region, with mode selecting how
+     *  cells are bounded (see EvaluatorBase::IntervalMode)
+     */
+    static T* render(const Tree t, const Region& r, bool multithread=true,
+                     Evaluator::IntervalMode mode=
+                        Evaluator::INTERVAL_ARITHMETIC);
 
     /*  Enumerator that distinguishes between cell types  */
     enum Type { LEAF, BRANCH, EMPTY, FULL };
@@ -76,6 +83,14 @@ protected:
      */
     XTree(Evaluator* e, const Subregion& r);
 
+    /*
+     *  Recursive constructor for a cell whose interval i has already been
+     *  found by its parent, in the given lane of a batched evaluation
+     *  (or Result::NI if it was evaluated on its own)
+     *  Requires a call to finalize in the parent constructor
+     */
+    XTree(Evaluator* e, const Subregion& r, Interval i, Result::Index lane);
+
     /*
      *  Collecting constructor that assembles multiple subtrees
      *  Requires a call to finalize in the parent constructor
@@ -88,9 +103,16 @@ protected:
     XTree(const Subregion& r);
 
     /*
-     *  Splits a subregion and fills out child pointers and cell type
+     *  Splits a subregion and fills out child pointers and cell type,
+     *  given the subregion's interval result (see above for lane)
+     *
+     *  All of the children are classified with a single batched interval
+     *  evaluation, using the next block of lanes after the parent's, so
+     *  that results for a cell's siblings are still there when the
+     *  recursion comes back up to them.
      */
-    void populateChildren(Evaluator* e, const Subregion& r);
+    void populateChildren(Evaluator* e, const Subregion& r,
+                          Interval out, Result::Index lane);
 
     /*
      *  Finishes initialization once the type and child pointers are in place
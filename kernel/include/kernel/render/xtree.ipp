@@ -11,24 +11,30 @@
 namespace Kernel {
 
 template <class T, int dims>
-T* XTree<T, dims>::render(const Tree t, const Region& r, bool multithread)
+T* XTree<T, dims>::render(const Tree t, const Region& r, bool multithread,
+                          Evaluator::IntervalMode mode)
 {
     auto rp = r.powerOfTwo(dims).view();
 
+    auto& pool = EvaluatorPool::instance();
+
     if (multithread && rp.canSplitEven<dims>())
     {
         std::list<std::future<T*>> futures;
 
+        // Borrow one evaluator per branch from the global pool (they're
+        // returned when handles goes out of scope, after every task is done)
+        auto handles = pool.checkout(t, 1 << dims);
+        auto h = handles.begin();
+
         // Start up a set of future rendering every branch of the octree
         for (auto region : rp.splitEven<dims>())
         {
-            auto e = new Evaluator(t);
+            auto e = (h++)->get();
+            e->setIntervalMode(mode);
 
             futures.push_back(std::async(std::launch::async,
-                [e, region](){
-                    auto out = new T(e, region);
-                    delete e;
-                    return out;}));
+                [e, region](){ return new T(e, region); }));
         }
 
         // Wait for all of the tasks to finish running in the background
@@ -40,14 +46,14 @@ T* XTree<T, dims>::render(const Tree t, const Region& r, bool multithread)
             sub[index++] = f.get();
         }
 
-        Evaluator e(t);
-        return new T(&e, sub, rp);
+        return new T(handles.front().get(), sub, rp);
     }
 
     else
     {
-        Evaluator e(t);
-        return new T(&e, rp);
+        auto e = pool.checkout(t);
+        e->setIntervalMode(mode);
+        return new T(e.get(), rp);
     }
 }
 
@@ -66,7 +72,19 @@ template <class T, int dims>
 XTree<T, dims>::XTree(Evaluator* e, const Subregion& r)
     : XTree(r)
 {
-    populateChildren(e, r);
+    // Evaluate the root cell in lane 0, so that children start at the
+    // next block of lanes (see populateChildren)
+    e->set(r.X.bounds, r.Y.bounds, r.Z.bounds, 0);
+    auto i = e->intervals(1);
+    populateChildren(e, r, Interval(i.lower[0], i.upper[0]), 0);
+}
+
+template <class T, int dims>
+XTree<T, dims>::XTree(Evaluator* e, const Subregion& r,
+                      Interval i, Result::Index lane)
+    : XTree(r)
+{
+    populateChildren(e, r, i, lane);
 }
 
 template <class T, int dims>
@@ -82,10 +100,10 @@ XTree<T, dims>::XTree(const std::array<T*, 1 << dims>& cs, const Subregion& r)
 }
 
 template <class T, int dims>
-void XTree<T, dims>::populateChildren(Evaluator* e, const Subregion& r)
+void XTree<T, dims>::populateChildren(Evaluator* e, const Subregion& r,
+                                      Interval out, Result::Index lane)
 {
-    // First, do interval evaluation to see if the cell should be checked
-    Interval out = e->eval(r.X.bounds, r.Y.bounds, r.Z.bounds);
+    // The interval result tells us whether the cell should be checked
     if (out.upper() < 0)
     {
         type = FULL;
@@ -103,11 +121,52 @@ void XTree<T, dims>::populateChildren(Evaluator* e, const Subregion& r)
         if (r.canSplit())
         {
             auto rs = r.splitEven<dims>();
-            e->push();
+            if (lane < Result::NI)
+            {
+                e->push(lane);
+            }
+            else
+            {
+                e->push();
+            }
+
+            // Children are evaluated in the block of lanes after this
+            // cell's block.  If we run out of lanes (in a very deep
+            // tree), we fall back to evaluating them one at a time.
+            const Result::Index first = (lane < Result::NI)
+                ? (lane / children.size() + 1) * children.size()
+                : Result::NI;
+            const bool batch = first + children.size() <= Result::NI;
+
+            std::array<Interval, 1 << dims> is;
+            if (batch)
+            {
+                for (uint8_t i=0; i < children.size(); ++i)
+                {
+                    e->set(rs[i].X.bounds, rs[i].Y.bounds, rs[i].Z.bounds,
+                           first + i);
+                }
+                auto batched = e->intervals(children.size(), first);
+                for (uint8_t i=0; i < children.size(); ++i)
+                {
+                    is[i] = Interval(batched.lower[first + i],
+                                     batched.upper[first + i]);
+                }
+            }
+
             for (uint8_t i=0; i < children.size(); ++i)
             {
                 // Populate child recursively
-                children[i].reset(new T(e, rs[i]));
+                if (batch)
+                {
+                    children[i].reset(new T(e, rs[i], is[i], first + i));
+                }
+                else
+                {
+                    children[i].reset(new T(e, rs[i],
+                        e->eval(rs[i].X.bounds, rs[i].Y.bounds,
+                                rs[i].Z.bounds), Result::NI));
+                }
 
                 // Grab corner values from children
                 corners[i] = children[i]->corners[i];
@@ -235,15 +294,13 @@ std::vector<Intersection> XTree<T, dims>::findIntersections(
     }
     auto ds = eval->derivs(pts.size());
 
-    // Mark which of the points are ambiguous
-    const auto ambiguous = eval->getAmbiguous(pts.size());
-
     // Accumulate intersections, ambiguous and non-ambiguous
+    // (using the ambiguity that derivs found along the way)
     std::vector<Intersection> intersections;
     for (unsigned i=0; i < pts.size(); ++i)
     {
         const auto p = pts[i];
-        if (ambiguous.find(i) == ambiguous.end())
+        if (!ds.ambiguous[i])
         {
             const glm::vec3 g(ds.dx[i], ds.dy[i], ds.dz[i]);
             intersections.push_back({p, glm::normalize(g)});
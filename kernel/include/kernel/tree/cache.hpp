@@ -68,6 +68,13 @@ protected:
      */
     Node checkCommutative(Opcode::Opcode op, Node a, Node b);
 
+    /*
+     *  Checks whether the operation can be done by a single more specific
+     *  opcode, returning the rewritten tree if so
+     *  i.e. (1 / X) will return recip(X)
+     */
+    Node checkRewrite(Opcode::Opcode op, Node a, Node b);
+
     /*
      *  A Key uniquely identifies an operation Node, so that we can
      *  deduplicate based on opcode  and arguments
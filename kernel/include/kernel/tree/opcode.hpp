@@ -28,6 +28,9 @@ enum Opcode
     ACOS,
     ATAN,
     EXP,
+    ABS,
+    RECIP,
+    RSQRT,
 
     ADD,
     MUL,
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <list>
 
@@ -109,6 +110,20 @@ public:
      */
     std::list<Tree> ordered() const;
 
+    /*
+     *  Walks the tree depth-first, returning each node after its children
+     *  (visiting the higher-ranked child first).  This keeps fewer values
+     *  live at once than rank order when evaluating from the front.
+     *  The last item in the list will be the tree this is called on
+     */
+    std::list<Tree> postorder() const;
+
+    /*
+     *  Like postorder, but doesn't visit nodes (or their children) for
+     *  which skip returns true, e.g. because they've already been flattened
+     */
+    std::list<Tree> postorder(std::function<bool(Id)> skip) const;
+
 protected:
     /*
      *  Empty tree constructor
@@ -0,0 +1,144 @@
+#include <cmath>
+
+#include "kernel/eval/affine.hpp"
+
+namespace Kernel {
+
+/*  Relative error allowed for a handful of double-precision operations,
+ *  which is far more than they can actually accumulate  */
+static const double DOUBLE_ERROR = 1e-14;
+
+Affine Affine::round(double c, double dx, double dy, double dz, double err)
+{
+    if (!std::isfinite(c) || !std::isfinite(dx) || !std::isfinite(dy) ||
+        !std::isfinite(dz) || !std::isfinite(err))
+    {
+        return whole();
+    }
+
+    Affine out;
+    out.c = static_cast<float>(c);
+    out.d = {{static_cast<float>(dx), static_cast<float>(dy),
+              static_cast<float>(dz)}};
+
+    const double slop = std::abs(c - out.c) + std::abs(dx - out.d[0]) +
+                        std::abs(dy - out.d[1]) + std::abs(dz - out.d[2]);
+    const double margin = DOUBLE_ERROR * (std::abs(c) + std::abs(dx) +
+                                          std::abs(dy) + std::abs(dz) + err);
+    out.err = Interval::roundUp(err + slop + margin);
+
+    // Rounding to float can overflow, even if the doubles were finite
+    if (!std::isfinite(out.c) || !std::isfinite(out.d[0]) ||
+        !std::isfinite(out.d[1]) || !std::isfinite(out.d[2]) ||
+        !std::isfinite(out.err))
+    {
+        return whole();
+    }
+    return out;
+}
+
+Affine Affine::transform(const std::array<Interval, 3>& box,
+                         float a, float b, float c, float d)
+{
+    std::array<double, 3> mid, rad;
+    for (unsigned i=0; i < 3; ++i)
+    {
+        if (box[i].isEmpty() || !std::isfinite(box[i].lower()) ||
+                                !std::isfinite(box[i].upper()))
+        {
+            return whole();
+        }
+        // These are exact in double precision
+        mid[i] = (double(box[i].lower()) + box[i].upper()) / 2;
+        rad[i] = (double(box[i].upper()) - box[i].lower()) / 2;
+    }
+
+    return round(a * mid[0] + b * mid[1] + c * mid[2] + d,
+                 a * rad[0], b * rad[1], c * rad[2], 0);
+}
+
+Affine Affine::fromInterval(Interval i)
+{
+    if (i.isEmpty() || !std::isfinite(i.lower()) || !std::isfinite(i.upper()))
+    {
+        return whole();
+    }
+    return round((double(i.lower()) + i.upper()) / 2, 0, 0, 0,
+                 (double(i.upper()) - i.lower()) / 2);
+}
+
+Affine Affine::whole()
+{
+    Affine out;
+    out.err = INFINITY;
+    return out;
+}
+
+double Affine::radius() const
+{
+    return double(std::abs(d[0])) + std::abs(d[1]) + std::abs(d[2]) + err;
+}
+
+Interval Affine::bounds() const
+{
+    // Use directed float arithmetic (rather than rounding a double), so that
+    // exactly representable bounds aren't pushed outwards
+    const float r = Interval::addUp(Interval::addUp(std::abs(d[0]),
+                                                    std::abs(d[1])),
+                                    Interval::addUp(std::abs(d[2]), err));
+    return Interval(Interval::addDown(c, -r), Interval::addUp(c, r));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Affine operator+(const Affine& a, const Affine& b)
+{
+    return Affine::round(double(a.c) + b.c,
+                         double(a.d[0]) + b.d[0],
+                         double(a.d[1]) + b.d[1],
+                         double(a.d[2]) + b.d[2],
+                         double(a.err) + b.err);
+}
+
+Affine operator-(const Affine& a)
+{
+    Affine out = a;
+    out.c = -a.c;
+    for (auto& d : out.d)
+    {
+        d = -d;
+    }
+    return out;
+}
+
+Affine operator-(const Affine& a, const Affine& b)
+{
+    return a + (-b);
+}
+
+Affine operator*(const Affine& a, const Affine& b)
+{
+    // The product of the two noise parts is bounded by the product of
+    // their radii, and is absorbed into the error term
+    return Affine::round(double(a.c) * b.c,
+                         double(a.c) * b.d[0] + double(b.c) * a.d[0],
+                         double(a.c) * b.d[1] + double(b.c) * a.d[1],
+                         double(a.c) * b.d[2] + double(b.c) * a.d[2],
+                         std::abs(double(a.c)) * b.err +
+                         std::abs(double(b.c)) * a.err +
+                         a.radius() * b.radius());
+}
+
+Affine square(const Affine& a)
+{
+    // The square of the noise part is in [0, r^2], so we shift the
+    // center up by r^2 / 2 and use r^2 / 2 as the error
+    const double r2 = a.radius() * a.radius() / 2;
+    return Affine::round(double(a.c) * a.c + r2,
+                         2.0 * a.c * a.d[0],
+                         2.0 * a.c * a.d[1],
+                         2.0 * a.c * a.d[2],
+                         2.0 * std::abs(double(a.c)) * a.err + r2);
+}
+
+}   // namespace Kernel
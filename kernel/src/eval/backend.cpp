@@ -0,0 +1,111 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#include "kernel/eval/backend.hpp"
+#include "kernel/eval/evaluator_base.hpp"
+
+namespace Kernel {
+
+// Each of these is defined in its own translation unit (evaluator_*.cpp),
+// which is only built if the compiler supports the relevant target flags
+#if defined(STRAYLIGHT_BACKEND_AVX512)
+extern const Backend BACKEND_AVX512;
+#endif
+#if defined(STRAYLIGHT_BACKEND_AVX2)
+extern const Backend BACKEND_AVX2;
+#endif
+#if defined(STRAYLIGHT_BACKEND_SSE)
+extern const Backend BACKEND_SSE;
+#endif
+
+std::vector<const Backend*> Backend::available()
+{
+    std::vector<const Backend*> out;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // This also checks that the OS saves the wider registers on
+    // context switches (via XGETBV), not just that the CPU has them
+    __builtin_cpu_init();
+#if defined(STRAYLIGHT_BACKEND_AVX512)
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma"))
+    {
+        out.push_back(&BACKEND_AVX512);
+    }
+#endif
+#if defined(STRAYLIGHT_BACKEND_AVX2)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        out.push_back(&BACKEND_AVX2);
+    }
+#endif
+#if defined(STRAYLIGHT_BACKEND_SSE)
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        out.push_back(&BACKEND_SSE);
+    }
+#endif
+#endif
+
+    out.push_back(&EvaluatorBase::SCALAR);
+    return out;
+}
+
+const Backend* Backend::find(const std::string& name)
+{
+    for (auto b : available())
+    {
+        if (name == b->name)
+        {
+            return b;
+        }
+    }
+    return nullptr;
+}
+
+const Backend& Backend::scalar()
+{
+    return EvaluatorBase::SCALAR;
+}
+
+/*
+ *  Picks the widest supported backend, unless overridden by
+ *  the STRAYLIGHT_BACKEND environment variable
+ */
+static const Backend* defaultBackend()
+{
+    if (auto name = getenv("STRAYLIGHT_BACKEND"))
+    {
+        if (auto b = Backend::find(name))
+        {
+            return b;
+        }
+        fprintf(stderr, "STRAYLIGHT_BACKEND: unknown or unsupported "
+                        "backend '%s'\n", name);
+    }
+    return Backend::available().front();
+}
+
+static std::atomic<const Backend*>& current()
+{
+    static std::atomic<const Backend*> b(defaultBackend());
+    return b;
+}
+
+const Backend& Backend::active()
+{
+    return *current().load();
+}
+
+bool Backend::select(const std::string& name)
+{
+    if (auto b = find(name))
+    {
+        current().store(b);
+        return true;
+    }
+    return false;
+}
+
+}   // namespace Kernel
@@ -0,0 +1,23 @@
+#include "kernel/eval/evaluator_simd.ipp"
+
+// This file must be compiled with the matching target flags (see
+// kernel/CMakeLists.txt), and is only linked in if the compiler supports them
+#if !defined(__AVX512F__)
+#error "evaluator_avx512.cpp requires __AVX512F__"
+#endif
+
+namespace Kernel {
+
+template struct EvaluatorSIMD<SIMD::AVX512>;
+
+extern const Backend BACKEND_AVX512 = {
+    "avx512", SIMD::AVX512::WIDTH,
+    &EvaluatorSIMD<SIMD::AVX512>::values,
+    &EvaluatorSIMD<SIMD::AVX512>::fused,
+    &EvaluatorSIMD<SIMD::AVX512>::derivs,
+    &EvaluatorSIMD<SIMD::AVX512>::ambiguous,
+    &EvaluatorSIMD<SIMD::AVX512>::adjoints,
+    &EvaluatorSIMD<SIMD::AVX512>::intervals,
+    &EvaluatorSIMD<SIMD::AVX512>::transform};
+
+}   // namespace Kernel
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <numeric>
 #include <memory>
 #include <cmath>
+#include <limits>
 
 #include <glm/gtc/matrix_inverse.hpp>
 
@@ -15,109 +17,141 @@ namespace Kernel {
 
 EvaluatorBase::EvaluatorBase(const Tree root, const glm::mat4& M,
                              const std::map<Tree::Id, float>& vs)
-    : root_op(root->op)
+    : EvaluatorBase(std::make_shared<Program>(root), M, vs)
+{
+    // Nothing to do here
+}
+
+EvaluatorBase::EvaluatorBase(const std::vector<Tree>& roots,
+                             const glm::mat4& M,
+                             const std::map<Tree::Id, float>& vs)
+    : EvaluatorBase(std::make_shared<Program>(roots), M, vs)
+{
+    // Nothing to do here
+}
+
+EvaluatorBase::EvaluatorBase(std::shared_ptr<const Program> p,
+                             const glm::mat4& M,
+                             const std::map<Tree::Id, float>& vs)
+    : program(p), backend(&Backend::active()), jit(Jit::enabled())
 {
     setMatrix(M);
 
-    auto flat = root.ordered();
+    tapes.push_back(Tape());
+    tape = &tapes.front();
+    loadProgram(vs);
+}
 
-    // Helper function to create a new clause in the data array
-    // The dummy clause (0) is mapped to the first result slot
-    std::unordered_map<Tree::Id, Clause::Id> clauses = {{nullptr, 0}};
-    Clause::Id id = flat.size();
+void EvaluatorBase::loadProgram(const std::map<Tree::Id, float>& vs)
+{
+    assert(tape == &tapes.front());
 
-    // Helper function to make a new function
-    std::list<Clause> tape_;
-    auto newClause = [&clauses, &id, &tape_](const Tree::Id t)
-    {
-        tape_.push_front(
-                {t->op,
-                 id,
-                 clauses.at(t->lhs.get()),
-                 clauses.at(t->rhs.get())});
-    };
+    X = program->X;
+    Y = program->Y;
+    Z = program->Z;
 
-    // Write the flattened tree into the tape!
-    std::map<Clause::Id, float> constants;
-    for (const auto& m : flat)
+    // Copy the program's tape to the bottom of the tape stack
+    // (making sure that every tape has room for it)
+    for (auto& t : tapes)
     {
-        // Normal clauses end up in the tape
-        if (m->rank > 0)
-        {
-            newClause(m.id());
-        }
-        // For constants and variables, record their values so
-        // that we can store those values in the result array
-        else if (m->op == Opcode::CONST)
-        {
-            constants[id] = m->value;
-        }
-        else if (m->op == Opcode::VAR)
-        {
-            constants[id] = vs.at(m.id());
-            vars.left.insert({id, m.id()});
-            var_handles.insert({m.id(), m});
-        }
-        else
-        {
-            assert(m->op == Opcode::VAR_X ||
-                   m->op == Opcode::VAR_Y ||
-                   m->op == Opcode::VAR_Z);
-        }
-        clauses[m.id()] = id--;
+        t.t.reserve(program->tape.size());
     }
-    assert(id == 0);
-
-    //  Move from the list tape to a more-compact vector tape
-    tapes.push_back(Tape());
-    tape = tapes.begin();
-    for (auto& t : tape_)
+    tape->t.clear();
+    for (auto& c : program->tape)
     {
-        tape->t.push_back(t);
+        tape->t.push_back(c);
     }
+    tape->roots = program->roots;
+    tape->i = tape->roots.front();
+    tape->fused.clear();
+    tape->jit.reset();
+    tape->evals = 0;
 
-    // Make sure that X, Y, Z have been allocated space
-    std::vector<Tree> axes = {Tree::X(), Tree::Y(), Tree::Z()};
-    for (auto a : axes)
-    {
-        if (clauses.find(a.id()) == clauses.end())
-        {
-            clauses[a.id()] = clauses.size();
-        }
-    }
+    // Cached tapes were pushed from an old version of the bottom tape
+    tape_cache.clear();
+    tape_index.clear();
+    tape_cache_clauses = 0;
 
     // Allocate enough memory for all the clauses
-    result.resize(clauses.size() + 1, vars.size());
-    disabled.resize(clauses.size() + 1);
-    remap.resize(clauses.size() + 1);
+    disabled.resize(program->slot.size());
+    remap.resize(program->slot.size());
+    bound.resize(program->slot.size());
+    live.assign(program->outputs(), true);
+    result.resize(program->rows());
+
+    // Store all constants and variables in results array
+    for (auto c : program->constants)
+    {
+        result.setValue(c.second, program->slot[c.first]);
+    }
+    for (auto v : program->vars.left)
+    {
+        result.setValue(vs.at(v.second), program->slot[v.first]);
+    }
+    runPrelude();
+}
 
-    // Store all constants in results array
-    for (auto c : constants)
+void EvaluatorBase::runPrelude()
+{
+    // Each clause is evaluated once, then broadcast across every
+    // lane (and the interval and derivative arrays), so that the
+    // tape can read it like a constant
+    for (auto itr = program->prelude.rbegin();
+              itr != program->prelude.rend(); ++itr)
     {
-        result.fill(c.second, c.first);
+        float out;
+        eval_clause_values(itr->op, &result.f[program->slot[itr->a]][0],
+                           &result.f[program->slot[itr->b]][0], &out, 1);
+        result.setValue(out, program->slot[itr->id]);
     }
+}
 
-    // Save X, Y, Z ids
-    X = clauses.at(axes[0].id());
-    Y = clauses.at(axes[1].id());
-    Z = clauses.at(axes[2].id());
+void EvaluatorBase::prepareDerivs()
+{
+    if (!result.dx.empty())
+    {
+        return;
+    }
+    result.resizeDerivs();
 
     // Set derivatives for X, Y, Z (unchanging)
     result.setDeriv(1, 0, 0, X);
     result.setDeriv(0, 1, 0, Y);
     result.setDeriv(0, 0, 1, Z);
+}
 
-    {   // Set the Jacobian for our variables (unchanging)
-        size_t index = 0;
-        for (auto v : vars.left)
-        {
-            result.setGradient(v.first, index++);
-        }
+void EvaluatorBase::prepareIntervals()
+{
+    if (result.lower.empty())
+    {
+        result.resizeIntervals();
+    }
+}
+
+void EvaluatorBase::setTree(const Tree root,
+                            const std::map<Tree::Id, float>& vars)
+{
+    setTrees({root}, vars);
+}
+
+void EvaluatorBase::setTrees(const std::vector<Tree>& roots,
+                             const std::map<Tree::Id, float>& vars)
+{
+    auto vs = varValues();
+    for (const auto& v : vars)
+    {
+        vs[v.first] = v.second;
     }
 
-    // Store the index of the tree's root
-    assert(clauses.at(root.id()) == 1);
-    tape->i = clauses.at(root.id());
+    // Patch the program in place if nobody else is using it
+    // (otherwise, patch a copy, as shared programs are immutable)
+    auto p = (program.use_count() == 1)
+        ? std::const_pointer_cast<Program>(program)
+        : std::make_shared<Program>(*program);
+    p->update(roots);
+    program = p;
+
+    loadProgram(vs);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -136,36 +170,79 @@ Interval EvaluatorBase::eval(Interval x, Interval y, Interval z)
 
 void EvaluatorBase::set(Interval x, Interval y, Interval z)
 {
+    boxes[Result::NI] = {{x, y, z}};
+    load(boxes[Result::NI]);
+}
+
+void EvaluatorBase::load(const std::array<Interval, 3>& box)
+{
+    const auto& x = box[0];
+    const auto& y = box[1];
+    const auto& z = box[2];
     result.i[X] = M[0][0] * x + M[1][0] * y + M[2][0] * z + M[3][0];
     result.i[Y] = M[0][1] * x + M[1][1] * y + M[2][1] * z + M[3][1];
     result.i[Z] = M[0][2] * x + M[1][2] * y + M[2][2] * z + M[3][2];
 }
 
+void EvaluatorBase::set(Interval x, Interval y, Interval z,
+                        Result::Index index)
+{
+    assert(index < Result::NI);
+    boxes[index] = {{x, y, z}};
+    prepareIntervals();
+
+    const Interval xs = M[0][0] * x + M[1][0] * y + M[2][0] * z + M[3][0];
+    const Interval ys = M[0][1] * x + M[1][1] * y + M[2][1] * z + M[3][1];
+    const Interval zs = M[0][2] * x + M[1][2] * y + M[2][2] * z + M[3][2];
+
+    result.lower[X][index] = xs.lower();
+    result.upper[X][index] = xs.upper();
+    result.lower[Y][index] = ys.lower();
+    result.upper[Y][index] = ys.upper();
+    result.lower[Z][index] = zs.lower();
+    result.upper[Z][index] = zs.upper();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
-void EvaluatorBase::pushTape()
+EvaluatorBase::Tape* EvaluatorBase::nextTape()
 {
-    auto prev_tape = tape;
+    const size_t depth = tape - tapes.data();
 
     // Add another tape to the top of the tape stack if one doesn't already
     // exist (we never erase them, to avoid re-allocating memory during
-    // nested evaluations).
-    if (++tape == tapes.end())
+    // nested evaluations).  Growing the stack may move the tapes, so
+    // pointers are recomputed afterwards.
+    if (depth + 1 == tapes.size())
     {
-        tape = tapes.insert(tape, Tape());
-        tape->t.reserve(tapes.front().t.size());
+        tapes.emplace_back();
+        tapes.back().t.reserve(tapes.front().t.size());
     }
     else
     {
         // We may be reusing an existing tape, so resize to 0
-        // (preserving allocated storage)
-        tape->t.clear();
+        // (preserving allocated storage) and drop its compiled code
+        auto& next = tapes[depth + 1];
+        next.t.clear();
+        next.fused.clear();
+        next.jit.reset();
+        next.evals = 0;
+        next.cached.reset();
     }
+    auto prev_tape = &tapes[depth];
+    tape = &tapes[depth + 1];
+    tape->id = Tape::NONE;
 
-    assert(tape != tapes.end());
-    assert(tape != tapes.begin());
+    assert(tape != &tapes.front());
     assert(tape->t.capacity() >= prev_tape->t.size());
 
+    return prev_tape;
+}
+
+void EvaluatorBase::pushTape()
+{
+    auto prev_tape = nextTape();
+
     // Now, use the data in disabled and remap to make the new tape
     for (const auto& c : prev_tape->t)
     {
@@ -178,50 +255,196 @@ void EvaluatorBase::pushTape()
         }
     }
 
-    // Remap the tape root index
-    for (tape->i = prev_tape->i; remap[tape->i]; tape->i = remap[tape->i]);
+    // Remap the tape's roots, dropping outputs that aren't live
+    tape->roots.clear();
+    for (size_t k=0; k < prev_tape->roots.size(); ++k)
+    {
+        Clause::Id r = live[k] ? prev_tape->roots[k] : 0;
+        for (; remap[r]; r = remap[r]);
+        tape->roots.push_back(r);
+    }
+    tape->i = tape->roots.front();
 
     // Make sure that the tape got shorter
     assert(tape->t.size() <= prev_tape->t.size());
 }
 
-void EvaluatorBase::push()
+void EvaluatorBase::pushCached()
+{
+    // Tapes without an id (e.g. specializations) aren't cached,
+    // so neither are their children
+    const bool cacheable = tape->id != Tape::NONE && tape_cache_size;
+
+    auto itr = cacheable ? tape_index.find(choices) : tape_index.end();
+    if (itr != tape_index.end())
+    {
+        counts.tape_hits++;
+
+        // Mark this entry as the most recently used
+        tape_cache.splice(tape_cache.begin(), tape_cache, itr->second);
+        const auto& cached = itr->second->second;
+
+        nextTape();
+        for (const auto& c : cached->t)
+        {
+            tape->t.push_back(c);
+        }
+        tape->i = cached->i;
+        tape->roots = cached->roots;
+        tape->fused = cached->fused;
+        tape->jit = cached->jit;
+        tape->evals = cached->evals;
+        tape->id = cached->id;
+        tape->cached = cached;
+        return;
+    }
+
+    counts.tape_misses++;
+    pushTape();
+
+    if (!cacheable)
+    {
+        return;
+    }
+
+    // Tapes that could never fit aren't stored (though they still
+    // get an id, so that their children can be)
+    tape->id = next_tape_id++;
+    if (tape->t.size() > tape_cache_size)
+    {
+        return;
+    }
+
+    auto cached = std::make_shared<Tape>(*tape);
+    tape->cached = cached;
+    tape_cache.push_front({choices, cached});
+    tape_index[choices] = tape_cache.begin();
+    tape_cache_clauses += cached->t.size();
+
+    setTapeCacheSize(tape_cache_size);
+}
+
+void EvaluatorBase::setTapeCacheSize(size_t clauses)
+{
+    tape_cache_size = clauses;
+
+    // Drop the least recently used tapes until we're under the limit
+    // (tapes on the stack keep their own copies, so this is always safe)
+    while (tape_cache_clauses > tape_cache_size ||
+           (tape_cache_size == 0 && tape_cache.size()))
+    {
+        const auto& e = tape_cache.back();
+        tape_cache_clauses -= e.second->t.size();
+        tape_index.erase(e.first);
+        tape_cache.pop_back();
+    }
+}
+
+void EvaluatorBase::markRoots()
 {
     // Since we'll be figuring out which clauses are disabled and
-    // which should be remapped, we reset those arrays here
-    std::fill(disabled.begin(), disabled.end(), true);
-    std::fill(remap.begin(), remap.end(), 0);
+    // which should be remapped, we reset those arrays here.  Pushing
+    // only reads the entries for the current tape's clauses, arguments,
+    // and roots, so the rest can be left stale.
+    const float reset = -std::numeric_limits<float>::infinity();
+    for (const auto& c : tape->t)
+    {
+        for (auto k : {c.id, c.a, c.b})
+        {
+            disabled[k] = true;
+            remap[k] = 0;
+            bound[k] = reset;
+        }
+    }
+    for (auto r : tape->roots)
+    {
+        disabled[r] = true;
+        remap[r] = 0;
+        bound[r] = reset;
+    }
+
+    // Mark the root nodes of live outputs as active
+    for (size_t k=0; k < live.size(); ++k)
+    {
+        if (live[k])
+        {
+            disabled[tape->roots[k]] = false;
+        }
+    }
+}
+
+void EvaluatorBase::push()
+{
+    std::fill(live.begin(), live.end(), true);
+    pushLive();
+}
+
+void EvaluatorBase::push(const std::vector<bool>& keep)
+{
+    assert(keep.size() == live.size());
+    std::copy(keep.begin(), keep.end(), live.begin());
+    pushLive();
+}
+
+void EvaluatorBase::pushLive()
+{
+    markRoots();
+
+    // Start the cache key with the current tape's id and live outputs
+    choices.clear();
+    for (unsigned i=0; i < sizeof(tape->id); ++i)
+    {
+        choices.push_back(tape->id >> (8 * i));
+    }
+    choices.insert(choices.end(), live.begin(), live.end());
+
+    // Roots are read in full, so they're unconstrained.  Every other
+    // clause is reached through a reader, which raises its bound
+    // (starting from -infinity, as set by markRoots).
+    for (size_t k=0; k < live.size(); ++k)
+    {
+        bound[tape->roots[k]] = std::numeric_limits<float>::infinity();
+    }
 
-    // Mark the root node as active
-    disabled[tape->i] = false;
+    auto isMinMax = [](Opcode::Opcode op)
+        { return op == Opcode::MIN || op == Opcode::MAX; };
 
     for (const auto& c : tape->t)
     {
         if (!disabled[c.id])
         {
             // For min and max operations, we may only need to keep one branch
-            // active if it is decisively above or below the other branch.
+            // active if it is decisively above or below the rest of the chain
+            // of min (or max) clauses that it's part of.  A min clause's
+            // bound is the lowest upper bound of any operand in the chain,
+            // so an operand whose lower bound is above it is never chosen.
+            const auto& ia = result.i[program->slot[c.a]];
+            const auto& ib = result.i[program->slot[c.b]];
+            float b = 0;
             if (c.op == Opcode::MAX)
             {
-                if (result.i[c.a].lower() > result.i[c.b].upper())
+                b = std::fmax(-bound[c.id], std::fmax(ia.lower(), ib.lower()));
+                if (ib.upper() < b && !(ia.upper() < b))
                 {
                     disabled[c.a] = false;
                     remap[c.id] = c.a;
                 }
-                else if (result.i[c.b].lower() > result.i[c.a].upper())
+                else if (ia.upper() < b && !(ib.upper() < b))
                 {
                     disabled[c.b] = false;
                     remap[c.id] = c.b;
                 }
+                b = -b;
             }
             else if (c.op == Opcode::MIN)
             {
-                if (result.i[c.a].lower() > result.i[c.b].upper())
+                b = std::fmin(bound[c.id], std::fmin(ia.upper(), ib.upper()));
+                if (ia.lower() > b && !(ib.lower() > b))
                 {
                     disabled[c.b] = false;
                     remap[c.id] = c.b;
                 }
-                else if (result.i[c.b].lower() > result.i[c.a].upper())
+                else if (ib.lower() > b && !(ia.lower() > b))
                 {
                     disabled[c.a] = false;
                     remap[c.id] = c.a;
@@ -236,21 +459,53 @@ void EvaluatorBase::push()
             {
                 disabled[c.id] = true;
             }
+
+            // Pass this clause's bound down to operands with the same
+            // opcode (which continue the chain); anything else is read
+            // in full, so it's unconstrained.
+            for (auto k : {c.a, c.b})
+            {
+                if (!remap[c.id] || remap[c.id] == k)
+                {
+                    bound[k] = (isMinMax(c.op) && program->trees[k]->op == c.op)
+                        ? std::fmax(bound[k], b)
+                        : std::numeric_limits<float>::infinity();
+                }
+            }
+        }
+
+        if (c.op == Opcode::MIN || c.op == Opcode::MAX)
+        {
+            choices.push_back(!remap[c.id] ? 0 : (remap[c.id] == c.a) ? 1 : 2);
         }
     }
 
-    pushTape();
+    pushCached();
 }
 
-Feature EvaluatorBase::push(const Feature& f)
+void EvaluatorBase::push(Result::Index index)
 {
-    // Since we'll be figuring out which clauses are disabled and
-    // which should be remapped, we reset those arrays here
-    std::fill(disabled.begin(), disabled.end(), true);
-    std::fill(remap.begin(), remap.end(), 0);
+    // Unpack this lane into the scalar interval results (which are
+    // only read for min and max arguments), then prune the tape as usual
+    for (const auto& c : tape->t)
+    {
+        if (c.op == Opcode::MIN || c.op == Opcode::MAX)
+        {
+            for (auto k : {program->slot[c.a], program->slot[c.b]})
+            {
+                result.i[k] = Interval(result.lower[k][index],
+                                       result.upper[k][index]);
+            }
+        }
+    }
+    push();
+}
 
-    // Mark the root node as active
-    disabled[tape->i] = false;
+Feature EvaluatorBase::push(const Feature& f)
+{
+    // Keep every output, which is marked as active
+    std::fill(live.begin(), live.end(), true);
+    markRoots();
 
     Feature out;
     out.deriv = f.deriv;
@@ -260,7 +515,7 @@ Feature EvaluatorBase::push(const Feature& f)
 
     for (const auto& c : tape->t)
     {
-        const bool match =  (result.f[c.a][0] == result.f[c.b][0] &&
+        const bool match =  (result.f[program->slot[c.a]][0] == result.f[program->slot[c.b]][0] &&
                             (c.op == Opcode::MAX || c.op == Opcode::MIN) &&
                             itr != choices.end() && itr->id == c.id);
 
@@ -312,11 +567,8 @@ void EvaluatorBase::specialize(float x, float y, float z)
     eval(x, y, z);
 
     // The same logic as push, but using float instead of interval comparisons
-    std::fill(disabled.begin(), disabled.end(), true);
-    std::fill(remap.begin(), remap.end(), 0);
-
-    // Mark the root node as active
-    disabled[tape->i] = false;
+    std::fill(live.begin(), live.end(), true);
+    markRoots();
 
     for (const auto& c : tape->t)
     {
@@ -326,12 +578,12 @@ void EvaluatorBase::specialize(float x, float y, float z)
             // active if it is decisively above or below the other branch.
             if (c.op == Opcode::MAX)
             {
-                if (result.f[c.a][0] > result.f[c.b][0])
+                if (result.f[program->slot[c.a]][0] > result.f[program->slot[c.b]][0])
                 {
                     disabled[c.a] = false;
                     remap[c.id] = c.a;
                 }
-                else if (result.f[c.b][0] > result.f[c.a][0])
+                else if (result.f[program->slot[c.b]][0] > result.f[program->slot[c.a]][0])
                 {
                     disabled[c.b] = false;
                     remap[c.id] = c.b;
@@ -339,12 +591,12 @@ void EvaluatorBase::specialize(float x, float y, float z)
             }
             else if (c.op == Opcode::MIN)
             {
-                if (result.f[c.a][0] > result.f[c.b][0])
+                if (result.f[program->slot[c.a]][0] > result.f[program->slot[c.b]][0])
                 {
                     disabled[c.b] = false;
                     remap[c.id] = c.b;
                 }
-                else if (result.f[c.b][0] > result.f[c.a][0])
+                else if (result.f[program->slot[c.b]][0] > result.f[program->slot[c.a]][0])
                 {
                     disabled[c.a] = false;
                     remap[c.id] = c.a;
@@ -441,15 +693,15 @@ std::list<Feature> EvaluatorBase::featuresAt(float x, float y, float z)
         {
             // Check for ambiguity here
             if ((itr->op == Opcode::MIN || itr->op == Opcode::MAX) &&
-                    result.f[itr->a][0] == result.f[itr->b][0])
+                    result.f[program->slot[itr->a]][0] == result.f[program->slot[itr->b]][0])
             {
                 // Check both branches of the ambiguity
-                const glm::vec3 rhs(result.dx[itr->b][0],
-                                    result.dy[itr->b][0],
-                                    result.dz[itr->b][0]);
-                const glm::vec3 lhs(result.dx[itr->a][0],
-                                    result.dy[itr->a][0],
-                                    result.dz[itr->a][0]);
+                const glm::vec3 rhs(result.dx[program->slot[itr->b]][0],
+                                    result.dy[program->slot[itr->b]][0],
+                                    result.dz[program->slot[itr->b]][0]);
+                const glm::vec3 lhs(result.dx[program->slot[itr->a]][0],
+                                    result.dy[program->slot[itr->a]][0],
+                                    result.dz[program->slot[itr->a]][0]);
                 const auto epsilon = (itr->op == Opcode::MIN) ? (rhs - lhs)
                                                               : (lhs - rhs);
 
@@ -494,7 +746,7 @@ std::set<Result::Index> EvaluatorBase::getAmbiguous(Result::Index i) const
         {
             for (Result::Index j=0; j < i; ++j)
             {
-                if (result.f[c.a][j] == result.f[c.b][j])
+                if (result.f[program->slot[c.a]][j] == result.f[program->slot[c.b]][j])
                 {
                     out.insert(j);
                 }
@@ -506,7 +758,19 @@ std::set<Result::Index> EvaluatorBase::getAmbiguous(Result::Index i) const
 
 void EvaluatorBase::pop()
 {
-    assert(tape != tapes.begin());
+    assert(tape != &tapes.front());
+
+    // Keep any compiled code (and superinstructions) for the next
+    // time this tape is pushed
+    if (tape->cached)
+    {
+        if (tape->cached->fused.empty())
+        {
+            tape->cached->fused = tape->fused;
+        }
+        tape->cached->jit = tape->jit;
+        tape->cached->evals = tape->evals;
+    }
     tape--;
 }
 
@@ -609,6 +873,18 @@ void EvaluatorBase::eval_clause_values(Opcode::Opcode op,
             EVAL_LOOP
             out[i] = exp(a[i]);
             break;
+        case Opcode::ABS:
+            EVAL_LOOP
+            out[i] = fabs(a[i]);
+            break;
+        case Opcode::RECIP:
+            EVAL_LOOP
+            out[i] = 1 / a[i];
+            break;
+        case Opcode::RSQRT:
+            EVAL_LOOP
+            out[i] = 1 / sqrt(a[i]);
+            break;
 
         case Opcode::CONST_VAR:
             EVAL_LOOP
@@ -625,6 +901,39 @@ void EvaluatorBase::eval_clause_values(Opcode::Opcode op,
     }
 }
 
+void EvaluatorBase::eval_fused(Fused::Op op, const float* a, const float* b,
+                               const float* c, float* out,
+                               Result::Index count)
+{
+    switch (op) {
+        case Fused::MULADD:
+            EVAL_LOOP
+            out[i] = a[i] * b[i] + c[i];
+            break;
+        case Fused::SQDIST:
+            EVAL_LOOP
+            {
+                const float d = a[i] - b[i];
+                out[i] = d * d;
+            }
+            break;
+        case Fused::SUMSQ:
+            EVAL_LOOP
+            out[i] = a[i] * a[i] + b[i] * b[i];
+            break;
+        case Fused::HYPOT2:
+            EVAL_LOOP
+            out[i] = sqrt(a[i] * a[i] + b[i] * b[i]);
+            break;
+        case Fused::HYPOT3:
+            EVAL_LOOP
+            out[i] = sqrt(a[i] * a[i] + b[i] * b[i] + c[i] * c[i]);
+            break;
+
+        case Fused::CLAUSE: assert(false);
+    }
+}
+
 void EvaluatorBase::eval_clause_derivs(Opcode::Opcode op,
         const float* __restrict av,  const float* __restrict adx,
         const float* __restrict ady, const float* __restrict adz,
@@ -854,6 +1163,33 @@ void EvaluatorBase::eval_clause_derivs(Opcode::Opcode op,
                 odz[i] = e * adz[i];
             }
             break;
+        case Opcode::ABS:
+            EVAL_LOOP
+            {
+                const float s = (av[i] < 0) ? -1 : 1;
+                odx[i] = adx[i] * s;
+                ody[i] = ady[i] * s;
+                odz[i] = adz[i] * s;
+            }
+            break;
+        case Opcode::RECIP:
+            EVAL_LOOP
+            {
+                const float d = -ov[i] * ov[i];
+                odx[i] = adx[i] * d;
+                ody[i] = ady[i] * d;
+                odz[i] = adz[i] * d;
+            }
+            break;
+        case Opcode::RSQRT:
+            EVAL_LOOP
+            {
+                const float d = -0.5f * ov[i] * ov[i] * ov[i];
+                odx[i] = adx[i] * d;
+                ody[i] = ady[i] * d;
+                odz[i] = adz[i] * d;
+            }
+            break;
 
         case Opcode::CONST_VAR:
             EVAL_LOOP
@@ -874,190 +1210,74 @@ void EvaluatorBase::eval_clause_derivs(Opcode::Opcode op,
     }
 }
 
-#define JAC_LOOP for (auto a = aj.begin(), b = bj.begin(), o = oj.begin(); a != aj.end(); ++a, ++b, ++o)
-float EvaluatorBase::eval_clause_jacobians(Opcode::Opcode op,
-        const float av,  std::vector<float>& aj,
-        const float bv,  std::vector<float>& bj,
-        std::vector<float>& oj)
+std::array<float, 2> EvaluatorBase::eval_clause_partials(Opcode::Opcode op,
+        const float av, const float bv, const float out)
 {
-    // Evaluate the base operations in a single pass
-    float out;
-    eval_clause_values(op, &av, &bv, &out, 1);
-
     switch (op) {
         case Opcode::ADD:
-            JAC_LOOP
-            {
-                (*o) = (*a) + (*b);
-            }
-            break;
+            return {{1, 1}};
         case Opcode::MUL:
-            JAC_LOOP
-            {   // Product rule
-                (*o) = av * (*b) + bv * (*a);
-            }
-            break;
+            // Product rule
+            return {{bv, av}};
         case Opcode::MIN:
-            JAC_LOOP
-            {
-                if (av < bv)
-                {
-                    (*o) = (*a);
-                }
-                else
-                {
-                    (*o) = (*b);
-                }
-            }
-            break;
+            return (av < bv) ? std::array<float, 2>{{1, 0}}
+                             : std::array<float, 2>{{0, 1}};
         case Opcode::MAX:
-            JAC_LOOP
-            {
-                if (av < bv)
-                {
-                    (*o) = (*b);
-                }
-                else
-                {
-                    (*o) = (*a);
-                }
-            }
-            break;
+            return (av < bv) ? std::array<float, 2>{{0, 1}}
+                             : std::array<float, 2>{{1, 0}};
         case Opcode::SUB:
-            JAC_LOOP
-            {
-                (*o) = (*a) - (*b);
-            }
-            break;
+            return {{1, -1}};
         case Opcode::DIV:
-            JAC_LOOP
-            {
-                const float p = pow(bv, 2);
-                (*o) = (bv*(*a) - av*(*b)) / p;
-            }
-            break;
+            return {{1 / bv, -av / (bv * bv)}};
         case Opcode::ATAN2:
-            JAC_LOOP
-            {
-                const float d = pow(av, 2) + pow(bv, 2);
-                (*o) = ((*a)*bv - av*(*b)) / d;
-            }
-            break;
+        {
+            const float d = pow(av, 2) + pow(bv, 2);
+            return {{bv / d, -av / d}};
+        }
         case Opcode::POW:
-            JAC_LOOP
-            {
-                const float m = pow(av, bv - 1);
-
-                // The full form of the derivative is
-                // (*o) = m * (bv * (*a) + av * log(av) * (*b)))
-                // However, log(av) is often NaN and (*b) is always zero,
-                // (since it must be CONST), so we skip that part.
-                (*o) = m * (bv * (*a));
-            }
-            break;
+            // The full form of the derivative with respect to b is
+            // out * log(av), but log(av) is often NaN and b is always
+            // constant, so we skip that part.
+            return {{std::pow(av, bv - 1.0f) * bv, 0}};
         case Opcode::NTH_ROOT:
-            JAC_LOOP
-            {
-                const float m = pow(av, 1.0f/bv - 1);
-                (*o) = m * (1.0f/bv * (*a));
-            }
-            break;
+            return {{std::pow(av, 1.0f/bv - 1.0f) / bv, 0}};
         case Opcode::MOD:
-            JAC_LOOP
-            {
-                // This isn't quite how partial derivatives of mod work,
-                // but close enough normals rendering.
-                (*o) = (*a);
-            }
-            break;
+            // This isn't quite how partial derivatives of mod work,
+            // but close enough normals rendering.
+            return {{1, 0}};
         case Opcode::NANFILL:
-            JAC_LOOP
-            {
-                (*o) = std::isnan(av) ? (*b) : (*a);
-            }
-            break;
+            return std::isnan(av) ? std::array<float, 2>{{0, 1}}
+                                  : std::array<float, 2>{{1, 0}};
 
         case Opcode::SQUARE:
-            JAC_LOOP
-            {
-                (*o) = 2 * av * (*a);
-            }
-            break;
+            return {{2 * av, 0}};
         case Opcode::SQRT:
-            JAC_LOOP
-            {
-                if (av < 0)
-                {
-                    (*o) = 0;
-                }
-                else
-                {
-                    (*o) = (*a) / (2 * out);
-                }
-            }
-            break;
+            return {{(av < 0) ? 0 : 1 / (2 * out), 0}};
         case Opcode::NEG:
-            JAC_LOOP
-            {
-                (*o) = -(*a);
-            }
-            break;
+            return {{-1, 0}};
         case Opcode::SIN:
-            JAC_LOOP
-            {
-                const float c = cos(av);
-                (*o) = (*a) * c;
-            }
-            break;
+            return {{std::cos(av), 0}};
         case Opcode::COS:
-            JAC_LOOP
-            {
-                const float s = -sin(av);
-                (*o) = (*a) * s;
-            }
-            break;
+            return {{-std::sin(av), 0}};
         case Opcode::TAN:
-            JAC_LOOP
-            {
-                const float s = pow(1/cos(av), 2);
-                (*o) = (*a) * s;
-            }
-            break;
+            return {{1 / (std::cos(av) * std::cos(av)), 0}};
         case Opcode::ASIN:
-            JAC_LOOP
-            {
-                const float d = sqrt(1 - pow(av, 2));
-                (*o) = (*a) / d;
-            }
-            break;
+            return {{1 / std::sqrt(1 - av * av), 0}};
         case Opcode::ACOS:
-            JAC_LOOP
-            {
-                const float d = -sqrt(1 - pow(av, 2));
-                (*o) = (*a) / d;
-            }
-            break;
+            return {{-1 / std::sqrt(1 - av * av), 0}};
         case Opcode::ATAN:
-            JAC_LOOP
-            {
-                const float d = pow(av, 2) + 1;
-                (*o) = (*a) / d;
-            }
-            break;
+            return {{1 / (av * av + 1), 0}};
         case Opcode::EXP:
-            JAC_LOOP
-            {
-                const float e = exp(av);
-                (*o) = e * (*a);
-            }
-            break;
+            return {{out, 0}};
+        case Opcode::ABS:
+            return {{(av < 0) ? -1.0f : 1.0f, 0}};
+        case Opcode::RECIP:
+            return {{-out * out, 0}};
+        case Opcode::RSQRT:
+            return {{-0.5f * out * out * out, 0}};
 
         case Opcode::CONST_VAR:
-            JAC_LOOP
-            {
-                (*o) = 0;
-            }
-            break;
+            return {{0, 0}};
 
         case Opcode::INVALID:
         case Opcode::CONST:
@@ -1068,7 +1288,38 @@ float EvaluatorBase::eval_clause_jacobians(Opcode::Opcode op,
         case Opcode::LAST_OP: assert(false);
     }
 
-    return out;
+    return {{0, 0}};
+}
+
+void EvaluatorBase::eval_ambiguous(
+        const float* __restrict a, const float* __restrict b,
+        float* __restrict out, Result::Index count)
+{
+    EVAL_LOOP
+    {
+        if (a[i] == b[i])
+        {
+            out[i] = 1;
+        }
+    }
+}
+
+void EvaluatorBase::eval_clause_adjoints(Opcode::Opcode op,
+        const float* __restrict av, const float* __restrict bv,
+        const float* __restrict ov, const float* __restrict d,
+        float* da, float* db, Result::Index count)
+{
+    EVAL_LOOP
+    {
+        // Skipping lanes that don't affect the output also keeps
+        // infinite partials (e.g. from an unused branch) out of the sum
+        if (d[i] != 0)
+        {
+            const auto p = eval_clause_partials(op, av[i], bv[i], ov[i]);
+            da[i] += d[i] * p[0];
+            db[i] += d[i] * p[1];
+        }
+    }
 }
 
 Interval EvaluatorBase::eval_clause_interval(
@@ -1080,9 +1331,9 @@ Interval EvaluatorBase::eval_clause_interval(
         case Opcode::MUL:
             return a * b;
         case Opcode::MIN:
-            return boost::numeric::min(a, b);
+            return min(a, b);
         case Opcode::MAX:
-            return boost::numeric::max(a, b);
+            return max(a, b);
         case Opcode::SUB:
             return a - b;
         case Opcode::DIV:
@@ -1090,34 +1341,40 @@ Interval EvaluatorBase::eval_clause_interval(
         case Opcode::ATAN2:
             return atan2(a, b);
         case Opcode::POW:
-            return boost::numeric::pow(a, b.lower());
+            return pow(a, b);
         case Opcode::NTH_ROOT:
-            return boost::numeric::nth_root(a, b.lower());
+            return nth_root(a, b);
         case Opcode::MOD:
-            return Interval(0.0f, b.upper()); // YOLO
+            return mod(a, b);
         case Opcode::NANFILL:
-            return (std::isnan(a.lower()) || std::isnan(a.upper())) ? b : a;
+            return nanfill(a, b);
 
         case Opcode::SQUARE:
-            return boost::numeric::square(a);
+            return square(a);
         case Opcode::SQRT:
-            return boost::numeric::sqrt(a);
+            return sqrt(a);
         case Opcode::NEG:
             return -a;
         case Opcode::SIN:
-            return boost::numeric::sin(a);
+            return sin(a);
         case Opcode::COS:
-            return boost::numeric::cos(a);
+            return cos(a);
         case Opcode::TAN:
-            return boost::numeric::tan(a);
+            return tan(a);
         case Opcode::ASIN:
-            return boost::numeric::asin(a);
+            return asin(a);
         case Opcode::ACOS:
-            return boost::numeric::acos(a);
+            return acos(a);
         case Opcode::ATAN:
-            return boost::numeric::atan(a);
+            return atan(a);
         case Opcode::EXP:
-            return boost::numeric::exp(a);
+            return exp(a);
+        case Opcode::ABS:
+            return abs(a);
+        case Opcode::RECIP:
+            return Interval(1.0f) / a;
+        case Opcode::RSQRT:
+            return Interval(1.0f) / sqrt(a);
 
         case Opcode::CONST_VAR:
             return a;
@@ -1137,106 +1394,797 @@ Interval EvaluatorBase::eval_clause_interval(
 
 const float* EvaluatorBase::values(Result::Index count)
 {
+    counts.points += count;
+
+    // Compiled tapes follow the vectorized kernels' semantics (e.g. for
+    // min and max of NaN), so they're never used with the scalar backend
+    if (jit && backend != &SCALAR)
+    {
+        if (++tape->evals == Jit::THRESHOLD)
+        {
+            tape->jit = Jit::compile(tape->t, program->slot,
+                                     Jit::fallbackFor(*backend));
+        }
+        if (tape->jit)
+        {
+            tape->jit->run(&result.f[0], count);
+            return &result.f[program->slot[tape->i]][0];
+        }
+    }
+
+    // Common chains of clauses are evaluated as superinstructions,
+    // which are found the first time that a tape is evaluated
+    if (tape->fused.empty())
+    {
+        tape->fused = Fused::build(tape->t, tape->roots, program->slot);
+    }
+    for (const auto& f : tape->fused)
+    {
+        if (f.fused == Fused::CLAUSE)
+        {
+            backend->values(f.op, &result.f[f.a][0], &result.f[f.b][0],
+                            &result.f[f.out][0], count);
+        }
+        else
+        {
+            backend->fused(f.fused, &result.f[f.a][0], &result.f[f.b][0],
+                           &result.f[f.c][0], &result.f[f.out][0], count);
+        }
+    }
+
+    return &result.f[program->slot[tape->i]][0];
+}
+
+const float* EvaluatorBase::grid(const float* xs, Result::Index nx,
+                                 const float* ys, Result::Index ny,
+                                 const float* zs, Result::Index nz)
+{
+    assert(nx * ny * nz <= Result::N);
+    counts.points += nx * ny * nz;
+
+    // A clause that depends on a subset of the axes is evaluated over the
+    // lattice of just those axes, which is ordered like the full grid
+    auto lattice = [&](uint8_t m)
+    {
+        return std::array<Result::Index, 3>{{
+            (m & 1) ? nx : 1, (m & 2) ? ny : 1, (m & 4) ? nz : 1}};
+    };
+
+    // Copies values from the lattice of axes ma into the lattice of axes m
+    // (which must be a superset).  As each point's source is at or before
+    // its destination, this works in place when src == dst.
+    auto broadcast = [&](const float* src, uint8_t ma, float* dst, uint8_t m)
+    {
+        const auto s = lattice(ma);
+        const auto d = lattice(m);
+        for (Result::Index n = d[0] * d[1] * d[2]; n-- > 0; )
+        {
+            const Result::Index k = n % d[2];
+            const Result::Index j = (n / d[2]) % d[1];
+            const Result::Index i = n / (d[2] * d[1]);
+            dst[n] = src[((i % s[0]) * s[1] + j % s[1]) * s[2] + k % s[2]];
+        }
+    };
+
+    grid_axes.assign(program->slot.size(), 0);
+    grid_rows.resize(2);
+
+    // Fill in X, Y, and Z, each of which depends on the axes that M mixes
+    // into it (which is just the one axis unless M rotates the model)
+    const std::array<const float*, 3> ps = {{xs, ys, zs}};
+    const std::array<Tree, 3> leaves = {{Tree::X(), Tree::Y(), Tree::Z()}};
+    for (unsigned r=0; r < 3; ++r)
+    {
+        const auto id = program->clauses.at(leaves[r].id()).first;
+        uint8_t m = 0;
+        for (unsigned c=0; c < 3; ++c)
+        {
+            m |= (M[c][r] != 0) << c;
+        }
+        grid_axes[id] = m;
+
+        const auto d = lattice(m);
+        float* out = &result.f[program->slot[id]][0];
+        for (Result::Index i=0; i < d[0]; ++i)
+        {
+            for (Result::Index j=0; j < d[1]; ++j)
+            {
+                for (Result::Index k=0; k < d[2]; ++k)
+                {
+                    *out++ = M[0][r] * ps[0][i] + M[1][r] * ps[1][j] +
+                             M[2][r] * ps[2][k] + M[3][r];
+                }
+            }
+        }
+    }
+
     for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
     {
-        eval_clause_values(itr->op,
-                &result.f[itr->a][0], &result.f[itr->b][0],
-                &result.f[itr->id][0], count);
+        const uint8_t ma = grid_axes[itr->a];
+        const uint8_t mb = grid_axes[itr->b];
+        const uint8_t m = ma | mb;
+        grid_axes[itr->id] = m;
+
+        // Arguments that depend on fewer axes are broadcast to match
+        // (b is the dummy clause for unary operations, so it's skipped)
+        const float* a = &result.f[program->slot[itr->a]][0];
+        const float* b = &result.f[program->slot[itr->b]][0];
+        if (ma != m)
+        {
+            broadcast(a, ma, &grid_rows[0][0], m);
+            a = &grid_rows[0][0];
+        }
+        if (mb != m && itr->b)
+        {
+            broadcast(b, mb, &grid_rows[1][0], m);
+            b = &grid_rows[1][0];
+        }
+        const auto d = lattice(m);
+        backend->values(itr->op, a, b, &result.f[program->slot[itr->id]][0],
+                        d[0] * d[1] * d[2]);
+    }
+
+    // Expand each output to the full grid
+    for (auto r = tape->roots.begin(); r != tape->roots.end(); ++r)
+    {
+        if (*r == 0 || std::find(tape->roots.begin(), r, *r) != r)
+        {
+            continue;
+        }
+        float* out = &result.f[program->slot[*r]][0];
+        broadcast(out, grid_axes[*r], out, 7);
     }
 
-    return &result.f[tape->i][0];
+    return &result.f[program->slot[tape->i]][0];
 }
 
 EvaluatorBase::Derivs EvaluatorBase::derivs(Result::Index count)
 {
+    counts.points += count;
+    prepareDerivs();
+
+    // Ambiguous points are marked as we go, while the arguments to each
+    // min and max are still in cache
+    result.ambiguous[0].fill(0);
+
     for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
     {
-        eval_clause_derivs(itr->op,
-               &result.f[itr->a][0], &result.dx[itr->a][0],
-               &result.dy[itr->a][0], &result.dz[itr->a][0],
+        backend->derivs(itr->op,
+               &result.f[program->slot[itr->a]][0], &result.dx[program->slot[itr->a]][0],
+               &result.dy[program->slot[itr->a]][0], &result.dz[program->slot[itr->a]][0],
 
-               &result.f[itr->b][0], &result.dx[itr->b][0],
-               &result.dy[itr->b][0], &result.dz[itr->b][0],
+               &result.f[program->slot[itr->b]][0], &result.dx[program->slot[itr->b]][0],
+               &result.dy[program->slot[itr->b]][0], &result.dz[program->slot[itr->b]][0],
 
-               &result.f[itr->id][0], &result.dx[itr->id][0],
-               &result.dy[itr->id][0], &result.dz[itr->id][0],
+               &result.f[program->slot[itr->id]][0], &result.dx[program->slot[itr->id]][0],
+               &result.dy[program->slot[itr->id]][0], &result.dz[program->slot[itr->id]][0],
                count);
+
+        if (itr->op == Opcode::MIN || itr->op == Opcode::MAX)
+        {
+            backend->ambiguous(&result.f[program->slot[itr->a]][0],
+                               &result.f[program->slot[itr->b]][0],
+                               &result.ambiguous[0][0], count);
+        }
     }
 
     // Apply the inverse matrix transform to our normals
-    const auto index = tape->i;
+    // (once per root, as several outputs may share one)
     auto o = Mi * glm::vec4(0,0,0,1);
-    for (size_t i=0; i < count; ++i)
+    for (auto r = tape->roots.begin(); r != tape->roots.end(); ++r)
     {
-        auto n = Mi * glm::vec4(result.dx[index][i],
-                                result.dy[index][i],
-                                result.dz[index][i], 1) - o;
-        result.dx[index][i] = n.x;
-        result.dy[index][i] = n.y;
-        result.dz[index][i] = n.z;
+        if (*r == 0 || std::find(tape->roots.begin(), r, *r) != r)
+        {
+            continue;
+        }
+        const auto index = program->slot[*r];
+        for (size_t i=0; i < count; ++i)
+        {
+            auto n = Mi * glm::vec4(result.dx[index][i],
+                                    result.dy[index][i],
+                                    result.dz[index][i], 1) - o;
+            result.dx[index][i] = n.x;
+            result.dy[index][i] = n.y;
+            result.dz[index][i] = n.z;
+        }
     }
 
-    return { &result.f[index][0],  &result.dx[index][0],
-             &result.dy[index][0], &result.dz[index][0] };
+    return derivsOf(0);
 }
 
 std::map<Tree::Id, float> EvaluatorBase::gradient(float x, float y, float z)
 {
     set(x, y, z, 0);
 
+    std::vector<Tree::Id> ids;
+    for (auto v : program->vars.right)
+    {
+        ids.push_back(v.first);
+    }
+    std::vector<float> gs(ids.size());
+    gradients(ids, 1, gs.data());
+
+    // Unpack from flat array into map
+    // (to allow correlating back to VARs in Tree)
+    std::map<Tree::Id, float> out;
+    for (unsigned k=0; k < ids.size(); ++k)
+    {
+        out[ids[k]] = gs[k];
+    }
+    return out;
+}
+
+void EvaluatorBase::gradients(const std::vector<Tree::Id>& vars,
+                              Result::Index count, float* out)
+{
+    assert(count <= Result::N);
+    counts.points += count;
+
+    // This is a reverse-mode (adjoint) pass, so it costs the same however
+    // many variables there are.  Values are stored by clause id rather
+    // than by row, since rows are reused before the backwards pass needs
+    // them.  Each clause gets a padded (and aligned) run of lanes, so
+    // that vectorized kernels can round count up.
+    const size_t stride = (count + 15) & ~15;
+    const size_t ids = program->slot.size();
+    clause_values.resize(ids * stride);
+    clause_adjoints.assign(ids * stride, 0);
+
+    // Constants, variables, prelude clauses, and X, Y, Z
+    // are copied from their rows
+    for (Clause::Id k=0; k < ids; ++k)
+    {
+        std::copy(result.f[program->slot[k]].begin(),
+                  result.f[program->slot[k]].begin() + count,
+                  clause_values.begin() + k * stride);
+    }
+    auto v = [&](Clause::Id k){ return &clause_values[k * stride]; };
+    auto d = [&](Clause::Id k){ return &clause_adjoints[k * stride]; };
+
     for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
     {
-        float av = result.f[itr->a][0];
-        float bv = result.f[itr->b][0];
-        std::vector<float>& aj = result.j[itr->a];
-        std::vector<float>& bj = result.j[itr->b];
+        backend->values(itr->op, v(itr->a), v(itr->b), v(itr->id), count);
+    }
 
-        result.f[itr->id][0] = eval_clause_jacobians(
-                itr->op, av, aj, bv, bj, result.j[itr->id]);
+    // The tape is stored in reverse order, so each clause's adjoint
+    // is complete before it's passed on to its arguments
+    std::fill(d(tape->i), d(tape->i) + count, 1.0f);
+    for (const auto& c : tape->t)
+    {
+        backend->adjoints(c.op, v(c.a), v(c.b), v(c.id), d(c.id),
+                          d(c.a), d(c.b), count);
     }
 
-    std::map<Tree::Id, float> out;
-    {   // Unpack from flat array into map
-        // (to allow correlating back to VARs in Tree)
-        const auto ti = tape->i;
-        size_t index = 0;
-        for (auto v : vars.left)
+    // Then, carry on through the prelude (whose values were copied
+    // from their rows above), since it's where variables are used
+    for (const auto& c : program->prelude)
+    {
+        backend->adjoints(c.op, v(c.a), v(c.b), v(c.id), d(c.id),
+                          d(c.a), d(c.b), count);
+    }
+
+    for (unsigned k=0; k < vars.size(); ++k)
+    {
+        auto r = program->vars.right.find(vars[k]);
+        if (r == program->vars.right.end())
         {
-            out[v.second] = result.j[ti][index++];
+            std::fill(out + k * count, out + (k + 1) * count, 0.0f);
+        }
+        else
+        {
+            std::copy(d(r->second), d(r->second) + count, out + k * count);
         }
     }
-    return out;
+}
+
+const float* EvaluatorBase::valuesOf(size_t output) const
+{
+    return &result.f[program->slot[tape->roots[output]]][0];
+}
+
+EvaluatorBase::Derivs EvaluatorBase::derivsOf(size_t output) const
+{
+    const auto index = program->slot[tape->roots[output]];
+    return { &result.f[index][0],  &result.dx[index][0],
+             &result.dy[index][0], &result.dz[index][0],
+             &result.ambiguous[0][0] };
+}
+
+Interval EvaluatorBase::intervalOf(size_t output) const
+{
+    return result.i[program->slot[tape->roots[output]]];
+}
+
+EvaluatorBase::Intervals EvaluatorBase::intervalsOf(size_t output) const
+{
+    const auto index = program->slot[tape->roots[output]];
+    return { &result.lower[index][0], &result.upper[index][0] };
 }
 
 Interval EvaluatorBase::interval()
 {
+    counts.intervals++;
+    switch (mode)
+    {
+        case INTERVAL_ARITHMETIC:   return plain();
+        case AFFINE_ARITHMETIC:     return affine(Result::NI);
+        case MEAN_VALUE:            return meanValue(Result::NI);
+    }
+    return Interval();
+}
+
+Interval EvaluatorBase::plain()
+{
+    for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
+    {
+        Interval a = result.i[program->slot[itr->a]];
+        Interval b = result.i[program->slot[itr->b]];
+
+        result.i[program->slot[itr->id]] = eval_clause_interval(itr->op, a, b);
+    }
+    return result.i[program->slot[tape->i]];
+}
+
+EvaluatorBase::Intervals EvaluatorBase::intervals(Result::Index count,
+                                                  Result::Index first)
+{
+    assert(first + count <= Result::NI);
+    counts.intervals += count;
+    prepareIntervals();
+
+    if (mode != INTERVAL_ARITHMETIC)
+    {
+        // Affine forms and interval derivatives don't fit in the batched
+        // rows, so each lane is evaluated on its own, then every clause's
+        // bounds are copied into the lane (so that push(lane) works as usual)
+        for (auto lane=first; lane < first + count; ++lane)
+        {
+            if (mode == AFFINE_ARITHMETIC)
+            {
+                affine(lane);
+            }
+            else
+            {
+                meanValue(lane);
+            }
+            for (const auto& c : tape->t)
+            {
+                const auto k = program->slot[c.id];
+                result.lower[k][lane] = result.i[k].lower();
+                result.upper[k][lane] = result.i[k].upper();
+            }
+        }
+        return { &result.lower[program->slot[tape->i]][0],
+                 &result.upper[program->slot[tape->i]][0] };
+    }
+
+    for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
+    {
+        const float* alo = &result.lower[program->slot[itr->a]][first];
+        const float* ahi = &result.upper[program->slot[itr->a]][first];
+        const float* blo = &result.lower[program->slot[itr->b]][first];
+        const float* bhi = &result.upper[program->slot[itr->b]][first];
+        float* olo = &result.lower[program->slot[itr->id]][first];
+        float* ohi = &result.upper[program->slot[itr->id]][first];
+
+        // Backends may not have batched kernels for every opcode
+        // (e.g. transcendentals), so fall back to the scalar kernel
+        if (!backend->intervals(itr->op, alo, ahi, blo, bhi,
+                                olo, ohi, count))
+        {
+            SCALAR.intervals(itr->op, alo, ahi, blo, bhi, olo, ohi, count);
+        }
+    }
+    return { &result.lower[program->slot[tape->i]][0], &result.upper[program->slot[tape->i]][0] };
+}
+
+bool EvaluatorBase::eval_clause_intervals(Opcode::Opcode op,
+        const float* __restrict alo, const float* __restrict ahi,
+        const float* __restrict blo, const float* __restrict bhi,
+        float* __restrict olo, float* __restrict ohi, Result::Index count)
+{
+    for (size_t i=0; i < count; ++i)
+    {
+        const auto out = eval_clause_interval(
+                op, Interval(alo[i], ahi[i]), Interval(blo[i], bhi[i]));
+        olo[i] = out.lower();
+        ohi[i] = out.upper();
+    }
+    return true;
+}
+
+Interval EvaluatorBase::affine(Result::Index lane)
+{
+    prepareIntervals();
+
+    // Build affine forms for the transformed coordinates from the raw box,
+    // so that every coordinate shares the box's noise symbols
+    const auto& box = boxes[lane];
+    result.a[X] = Affine::transform(box, M[0][0], M[1][0], M[2][0], M[3][0]);
+    result.a[Y] = Affine::transform(box, M[0][1], M[1][1], M[2][1], M[3][1]);
+    result.a[Z] = Affine::transform(box, M[0][2], M[1][2], M[2][2], M[3][2]);
+    for (auto k : {X, Y, Z})
+    {
+        // Intersect with the interval arithmetic result from set, which is
+        // exact for boxes that M doesn't rotate
+        const Interval i = (lane == Result::NI)
+            ? result.i[k]
+            : Interval(result.lower[k][lane], result.upper[k][lane]);
+        const Interval bounds = result.a[k].bounds();
+        result.i[k] = Interval(std::fmax(i.lower(), bounds.lower()),
+                               std::fmin(i.upper(), bounds.upper()));
+    }
+
+    for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
+    {
+        const auto ka = program->slot[itr->a];
+        const auto kb = program->slot[itr->b];
+        const auto ko = program->slot[itr->id];
+
+        const Interval ia = result.i[ka];
+        const Interval ib = result.i[kb];
+        const Interval out = eval_clause_interval(itr->op, ia, ib);
+        const Affine a = eval_clause_affine(
+                itr->op, result.a[ka], result.a[kb], ia, ib, out);
+
+        // Both results are sound, so their intersection is too
+        const Interval bounds = a.bounds();
+        result.a[ko] = a;
+        result.i[ko] = out.isEmpty() ? out
+            : Interval(std::fmax(out.lower(), bounds.lower()),
+                       std::fmin(out.upper(), bounds.upper()));
+    }
+    return result.i[program->slot[tape->i]];
+}
+
+Affine EvaluatorBase::eval_clause_affine(Opcode::Opcode op,
+        const Affine& a, const Affine& b,
+        const Interval& ia, const Interval& ib, const Interval& out)
+{
+    switch (op) {
+        case Opcode::ADD:
+            return a + b;
+        case Opcode::MUL:
+            return a * b;
+        case Opcode::SUB:
+            return a - b;
+        case Opcode::DIV:
+            // Division by a constant is multiplication by a (rounded
+            // outwards) reciprocal; anything else loses correlation
+            return (b.isConstant() && ib.lower() != 0)
+                ? a * Affine::fromInterval(Interval(1.0f) / ib)
+                : Affine::fromInterval(out);
+
+        // Pass through whichever branch is strictly selected
+        case Opcode::MIN:
+            if (ia.upper() < ib.lower())        return a;
+            else if (ib.upper() < ia.lower())   return b;
+            else                                return Affine::fromInterval(out);
+        case Opcode::MAX:
+            if (ia.lower() > ib.upper())        return a;
+            else if (ib.lower() > ia.upper())   return b;
+            else                                return Affine::fromInterval(out);
+
+        case Opcode::SQUARE:
+            return square(a);
+        case Opcode::NEG:
+            return -a;
+        case Opcode::CONST_VAR:
+            return a;
+        case Opcode::ABS:
+            // Pass through (or negate) arguments that don't change sign
+            if (ia.lower() >= 0)        return a;
+            else if (ia.upper() <= 0)   return -a;
+            else                        return Affine::fromInterval(out);
+
+        // Nonlinear functions use their interval arithmetic bounds
+        case Opcode::ATAN2:
+        case Opcode::POW:
+        case Opcode::NTH_ROOT:
+        case Opcode::MOD:
+        case Opcode::NANFILL:
+        case Opcode::SQRT:
+        case Opcode::SIN:
+        case Opcode::COS:
+        case Opcode::TAN:
+        case Opcode::ASIN:
+        case Opcode::ACOS:
+        case Opcode::ATAN:
+        case Opcode::EXP:
+        case Opcode::RECIP:
+        case Opcode::RSQRT:
+            return Affine::fromInterval(out);
+
+        case Opcode::INVALID:
+        case Opcode::CONST:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR:
+        case Opcode::LAST_OP: assert(false);
+    }
+    return Affine::whole();
+}
+
+Interval EvaluatorBase::meanValue(Result::Index lane)
+{
+    prepareIntervals();
+    const auto& box = boxes[lane];
+
+    // Bound the value at the box's center by evaluating a degenerate box
+    // there (which accounts for rounding).  The mean value form holds for
+    // any point in the box, so the center doesn't need to be exact.
+    std::array<float, 3> center;
+    std::array<Interval, 3> point;
+    for (unsigned i=0; i < 3; ++i)
+    {
+        center[i] = box[i].lower() / 2 + box[i].upper() / 2;
+        point[i] = Interval(center[i]);
+    }
+    load(point);
+    const Interval fc = plain();
+
+    // Evaluate the box, carrying derivatives with respect to its
+    // (untransformed) axes, so the chain rule through M is exact
+    load(box);
+    result.di[X] = {{Interval(M[0][0]), Interval(M[1][0]), Interval(M[2][0])}};
+    result.di[Y] = {{Interval(M[0][1]), Interval(M[1][1]), Interval(M[2][1])}};
+    result.di[Z] = {{Interval(M[0][2]), Interval(M[1][2]), Interval(M[2][2])}};
     for (auto itr = tape->t.rbegin(); itr != tape->t.rend(); ++itr)
     {
-        Interval a = result.i[itr->a];
-        Interval b = result.i[itr->b];
+        const auto ka = program->slot[itr->a];
+        const auto kb = program->slot[itr->b];
+        const auto ko = program->slot[itr->id];
+
+        const Interval out = eval_clause_interval(
+                itr->op, result.i[ka], result.i[kb]);
+        result.di[ko] = eval_clause_interval_derivs(
+                itr->op, result.i[ka], result.i[kb],
+                result.di[ka], result.di[kb], out);
+        result.i[ko] = out;
+    }
+
+    // Tighten the root with f(box) in f(c) + f'(box) * (box - c)
+    const auto root = program->slot[tape->i];
+    Interval mv = fc;
+    for (unsigned i=0; i < 3; ++i)
+    {
+        // Skip flat axes, where the derivative doesn't matter
+        // (and may be infinite or NaN)
+        if (box[i].lower() != box[i].upper())
+        {
+            mv = mv + result.di[root][i] * (box[i] - center[i]);
+        }
+    }
+
+    // fmax and fmin ignore a NaN bound, so a mean value form that
+    // went wrong (e.g. from an infinite derivative) changes nothing
+    const Interval out = result.i[root];
+    if (!out.isEmpty())
+    {
+        result.i[root] = Interval(std::fmax(out.lower(), mv.lower()),
+                                  std::fmin(out.upper(), mv.upper()));
+    }
+    return result.i[root];
+}
+
+std::array<Interval, 3> EvaluatorBase::eval_clause_interval_derivs(
+        Opcode::Opcode op, const Interval& a, const Interval& b,
+        const std::array<Interval, 3>& da, const std::array<Interval, 3>& db,
+        const Interval& out)
+{
+    std::array<Interval, 3> o;
+
+    // Derivatives are only meaningful where the clause is continuous with
+    // finite bounds; anywhere else, it could jump by any amount
+    if (out.isEmpty() || !std::isfinite(out.lower()) ||
+                         !std::isfinite(out.upper()))
+    {
+        o.fill(Interval::whole());
+        return o;
+    }
+
+#define DERIV_LOOP for (unsigned i=0; i < 3; ++i)
+    switch (op) {
+        case Opcode::ADD:
+            DERIV_LOOP o[i] = da[i] + db[i];
+            break;
+        case Opcode::MUL:
+            DERIV_LOOP o[i] = da[i] * b + a * db[i];
+            break;
+        case Opcode::MIN:
+            if (a.upper() < b.lower())
+            {
+                o = da;
+            }
+            else if (b.upper() < a.lower())
+            {
+                o = db;
+            }
+            else
+            {   // Either branch could be active, so take the hull
+                DERIV_LOOP o[i] = Interval(std::fmin(da[i].lower(), db[i].lower()),
+                                           std::fmax(da[i].upper(), db[i].upper()));
+            }
+            break;
+        case Opcode::MAX:
+            if (a.lower() > b.upper())
+            {
+                o = da;
+            }
+            else if (b.lower() > a.upper())
+            {
+                o = db;
+            }
+            else
+            {
+                DERIV_LOOP o[i] = Interval(std::fmin(da[i].lower(), db[i].lower()),
+                                           std::fmax(da[i].upper(), db[i].upper()));
+            }
+            break;
+        case Opcode::SUB:
+            DERIV_LOOP o[i] = da[i] - db[i];
+            break;
+        case Opcode::DIV:
+            DERIV_LOOP o[i] = (da[i] * b - a * db[i]) / square(b);
+            break;
+        case Opcode::ATAN2:
+            // atan2 jumps across the negative x axis
+            if (b.lower() < 0 && a.lower() <= 0 && a.upper() >= 0)
+            {
+                o.fill(Interval::whole());
+            }
+            else
+            {
+                DERIV_LOOP o[i] = (b * da[i] - a * db[i]) /
+                                  (square(a) + square(b));
+            }
+            break;
+        case Opcode::POW:
+            DERIV_LOOP o[i] = (b.lower() == 0 && b.upper() == 0)
+                ? Interval(0.0f)
+                : b * pow(a, b - Interval(1.0f)) * da[i];
+            break;
+        case Opcode::NTH_ROOT:
+            DERIV_LOOP o[i] = out / (b * a) * da[i];
+            break;
+
+        case Opcode::SQUARE:
+            DERIV_LOOP o[i] = 2.0f * a * da[i];
+            break;
+        case Opcode::SQRT:
+            DERIV_LOOP o[i] = da[i] / (2.0f * out);
+            break;
+        case Opcode::NEG:
+            DERIV_LOOP o[i] = -da[i];
+            break;
+        case Opcode::SIN:
+            DERIV_LOOP o[i] = cos(a) * da[i];
+            break;
+        case Opcode::COS:
+            DERIV_LOOP o[i] = -sin(a) * da[i];
+            break;
+        case Opcode::TAN:
+            DERIV_LOOP o[i] = (1.0f + square(out)) * da[i];
+            break;
+        case Opcode::ASIN:
+            DERIV_LOOP o[i] = da[i] / sqrt(1.0f - square(a));
+            break;
+        case Opcode::ACOS:
+            DERIV_LOOP o[i] = -da[i] / sqrt(1.0f - square(a));
+            break;
+        case Opcode::ATAN:
+            DERIV_LOOP o[i] = da[i] / (1.0f + square(a));
+            break;
+        case Opcode::EXP:
+            DERIV_LOOP o[i] = out * da[i];
+            break;
+        case Opcode::ABS:
+            if (a.lower() >= 0)
+            {
+                o = da;
+            }
+            else if (a.upper() <= 0)
+            {
+                DERIV_LOOP o[i] = -da[i];
+            }
+            else
+            {   // The sign could go either way
+                DERIV_LOOP o[i] = Interval(-abs(da[i]).upper(),
+                                           abs(da[i]).upper());
+            }
+            break;
+        case Opcode::RECIP:
+            DERIV_LOOP o[i] = -square(out) * da[i];
+            break;
+        case Opcode::RSQRT:
+            DERIV_LOOP o[i] = -out / (2.0f * a) * da[i];
+            break;
+
+        // These are discontinuous
+        case Opcode::MOD:
+        case Opcode::NANFILL:
+            o.fill(Interval::whole());
+            break;
+
+        case Opcode::CONST_VAR:
+            o = da;
+            break;
+
+        case Opcode::INVALID:
+        case Opcode::CONST:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR:
+        case Opcode::LAST_OP: assert(false);
+    }
+#undef DERIV_LOOP
 
-        result.i[itr->id] = eval_clause_interval(itr->op, a, b);
+    // An empty derivative (e.g. sqrt'(0) = 1 / 0) means that it's unbounded
+    for (auto& d : o)
+    {
+        if (d.isEmpty())
+        {
+            d = Interval::whole();
+        }
     }
-    return result.i[tape->i];
+    return o;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 void EvaluatorBase::applyTransform(Result::Index count)
 {
+    backend->transform(&M[0][0], &result.f[X][0], &result.f[Y][0],
+                       &result.f[Z][0], count);
+}
+
+void EvaluatorBase::eval_transform(const float* M, float* __restrict x,
+                                   float* __restrict y, float* __restrict z,
+                                   Result::Index count)
+{
+    // M is column-major, so M[4*j + i] is row i of column j
     for (size_t i=0; i < count; ++i)
     {
-        float x = result.f[X][i];
-        float y = result.f[Y][i];
-        float z = result.f[Z][i];
-        result.f[X][i] = M[0][0] * x + M[1][0] * y + M[2][0] * z + M[3][0];
-        result.f[Y][i] = M[0][1] * x + M[1][1] * y + M[2][1] * z + M[3][1];
-        result.f[Z][i] = M[0][2] * x + M[1][2] * y + M[2][2] * z + M[3][2];
+        const float px = x[i];
+        const float py = y[i];
+        const float pz = z[i];
+        x[i] = M[0] * px + M[4] * py + M[8] * pz + M[12];
+        y[i] = M[1] * px + M[5] * py + M[9] * pz + M[13];
+        z[i] = M[2] * px + M[6] * py + M[10] * pz + M[14];
     }
 }
 
+const Backend EvaluatorBase::SCALAR = {
+    "scalar", 1,
+    &EvaluatorBase::eval_clause_values,
+    &EvaluatorBase::eval_fused,
+    &EvaluatorBase::eval_clause_derivs,
+    &EvaluatorBase::eval_ambiguous,
+    &EvaluatorBase::eval_clause_adjoints,
+    &EvaluatorBase::eval_clause_intervals,
+    &EvaluatorBase::eval_transform};
+
 ////////////////////////////////////////////////////////////////////////////////
 
+void EvaluatorBase::setBackend(const Backend& b)
+{
+    backend = &b;
+
+    // Compiled tapes call into the old backend's kernels, so recompile them
+    for (auto& t : tapes)
+    {
+        t.jit.reset();
+        t.evals = 0;
+    }
+    for (auto& t : tape_cache)
+    {
+        t.second->jit.reset();
+        t.second->evals = 0;
+    }
+}
+
 double EvaluatorBase::utilization() const
 {
     return tape->t.size() / double(tapes.front().t.size());
@@ -1250,10 +2198,11 @@ void EvaluatorBase::setMatrix(const glm::mat4& m)
 
 void EvaluatorBase::setVar(Tree::Id var, float value)
 {
-    auto r = vars.right.find(var);
-    if (r != vars.right.end())
+    auto r = program->vars.right.find(var);
+    if (r != program->vars.right.end())
     {
-        result.setValue(value, r->second);
+        result.setValue(value, program->slot[r->second]);
+        runPrelude();
     }
 }
 
@@ -1261,9 +2210,9 @@ std::map<Tree::Id, float> EvaluatorBase::varValues() const
 {
     std::map<Tree::Id, float> out;
 
-    for (auto v : vars.left)
+    for (auto v : program->vars.left)
     {
-        out[v.second] = result.f[v.first][0];
+        out[v.second] = result.f[program->slot[v.first]][0];
     }
     return out;
 }
@@ -1271,15 +2220,19 @@ std::map<Tree::Id, float> EvaluatorBase::varValues() const
 bool EvaluatorBase::updateVars(const std::map<Kernel::Tree::Id, float>& vars_)
 {
     bool changed = false;
-    for (const auto& v : vars.left)
+    for (const auto& v : program->vars.left)
     {
         auto val = vars_.at(v.second);
-        if (val != result.f[v.first][0])
+        if (val != result.f[program->slot[v.first]][0])
         {
-            setVar(v.second, val);
+            result.setValue(val, program->slot[v.first]);
             changed = true;
         }
     }
+    if (changed)
+    {
+        runPrelude();
+    }
     return changed;
 }
 
@@ -0,0 +1,23 @@
+#include "kernel/eval/evaluator_simd.ipp"
+
+// This file must be compiled with the matching target flags (see
+// kernel/CMakeLists.txt), and is only linked in if the compiler supports them
+#if !defined(__SSE4_1__)
+#error "evaluator_sse.cpp requires __SSE4_1__"
+#endif
+
+namespace Kernel {
+
+template struct EvaluatorSIMD<SIMD::SSE>;
+
+extern const Backend BACKEND_SSE = {
+    "sse4.1", SIMD::SSE::WIDTH,
+    &EvaluatorSIMD<SIMD::SSE>::values,
+    &EvaluatorSIMD<SIMD::SSE>::fused,
+    &EvaluatorSIMD<SIMD::SSE>::derivs,
+    &EvaluatorSIMD<SIMD::SSE>::ambiguous,
+    &EvaluatorSIMD<SIMD::SSE>::adjoints,
+    &EvaluatorSIMD<SIMD::SSE>::intervals,
+    &EvaluatorSIMD<SIMD::SSE>::transform};
+
+}   // namespace Kernel
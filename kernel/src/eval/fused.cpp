@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <initializer_list>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "kernel/eval/fused.hpp"
+
+namespace Kernel {
+
+std::vector<Fused> Fused::build(const std::vector<Clause>& tape,
+                                const std::vector<Clause::Id>& roots,
+                                const std::vector<Index>& slots)
+{
+    // Count readers of every clause in the tape.  Roots get an extra
+    // reader, as they're read after evaluation (arguments to min and max
+    // are already counted by their min or max clause).
+    std::unordered_map<Clause::Id, const Clause*> defs;
+    std::unordered_map<Clause::Id, unsigned> uses;
+    for (const auto& c : tape)
+    {
+        defs[c.id] = &c;
+        uses[c.a]++;
+        uses[c.b]++;
+    }
+    for (auto r : roots)
+    {
+        uses[r]++;
+    }
+
+    // Returns the clause that produces id if it has the given opcode
+    // and no other readers, or nullptr otherwise
+    auto single = [&](Clause::Id id, Opcode::Opcode op) -> const Clause*
+    {
+        auto d = defs.find(id);
+        return (d != defs.end() && d->second->op == op && uses[id] == 1)
+            ? d->second : nullptr;
+    };
+
+    // Checks that the claimed clauses come immediately before c when
+    // evaluating.  Folding them into c delays reading their arguments
+    // until c runs, which is only safe if nothing else runs in between
+    // (as the slot of an argument may be reused once its last reader
+    // has run).
+    auto adjacent = [&](const Clause& c,
+                        std::initializer_list<const Clause*> claimed)
+    {
+        size_t last = 0;
+        for (auto m : claimed)
+        {
+            last = std::max<size_t>(last, m - &c);
+        }
+        return last == claimed.size();
+    };
+
+    // Walk the tape from the last clause to the first, so that each clause
+    // is seen before its arguments and can claim them for a superinstruction
+    std::unordered_set<Clause::Id> fused;
+    std::vector<Fused> out;
+    out.reserve(tape.size());
+    for (const auto& c : tape)
+    {
+        if (fused.count(c.id))
+        {
+            continue;
+        }
+
+        auto emit = [&](Op op, std::initializer_list<const Clause*> claimed,
+                        Clause::Id a, Clause::Id b, Clause::Id k)
+        {
+            for (auto m : claimed)
+            {
+                fused.insert(m->id);
+            }
+            out.push_back({op, c.op, slots[a], slots[b], slots[k],
+                           slots[c.id]});
+        };
+
+        if (c.op == Opcode::SQRT)
+        {
+            if (auto s = single(c.a, Opcode::ADD))
+            {
+                // sqrt((p^2 + q^2) + r^2), with the sums in either order
+                bool done = false;
+                for (auto ab : {std::make_pair(s->a, s->b),
+                                std::make_pair(s->b, s->a)})
+                {
+                    auto t = single(ab.first, Opcode::ADD);
+                    auto r = single(ab.second, Opcode::SQUARE);
+                    auto p = t ? single(t->a, Opcode::SQUARE) : nullptr;
+                    auto q = t ? single(t->b, Opcode::SQUARE) : nullptr;
+                    if (r && p && q && p != q && adjacent(c, {s, t, p, q, r}))
+                    {
+                        emit(HYPOT3, {s, t, p, q, r}, p->a, q->a, r->a);
+                        done = true;
+                        break;
+                    }
+                }
+                if (done)
+                {
+                    continue;
+                }
+
+                // sqrt(p^2 + q^2)
+                auto p = single(s->a, Opcode::SQUARE);
+                auto q = single(s->b, Opcode::SQUARE);
+                if (p && q && p != q && adjacent(c, {s, p, q}))
+                {
+                    emit(HYPOT2, {s, p, q}, p->a, q->a, 0);
+                    continue;
+                }
+            }
+        }
+        else if (c.op == Opcode::ADD)
+        {
+            // p^2 + q^2
+            auto p = single(c.a, Opcode::SQUARE);
+            auto q = single(c.b, Opcode::SQUARE);
+            if (p && q && p != q && adjacent(c, {p, q}))
+            {
+                emit(SUMSQ, {p, q}, p->a, q->a, 0);
+                continue;
+            }
+
+            // p * q + r, with the sum in either order
+            auto m = single(c.a, Opcode::MUL);
+            if (m && adjacent(c, {m}))
+            {
+                emit(MULADD, {m}, m->a, m->b, c.b);
+                continue;
+            }
+            m = single(c.b, Opcode::MUL);
+            if (m && adjacent(c, {m}))
+            {
+                emit(MULADD, {m}, m->a, m->b, c.a);
+                continue;
+            }
+        }
+        else if (c.op == Opcode::SQUARE)
+        {
+            // (p - q)^2
+            auto s = single(c.a, Opcode::SUB);
+            if (s && adjacent(c, {s}))
+            {
+                emit(SQDIST, {s}, s->a, s->b, 0);
+                continue;
+            }
+        }
+
+        emit(CLAUSE, {}, c.a, c.b, 0);
+    }
+
+    // Switch to evaluation order
+    return std::vector<Fused>(out.rbegin(), out.rend());
+}
+
+}   // namespace Kernel
@@ -0,0 +1,663 @@
+#include <algorithm>
+#include <cassert>
+
+#include "kernel/eval/interval.hpp"
+
+namespace Kernel {
+
+////////////////////////////////////////////////////////////////////////////////
+
+Interval operator*(const Interval& a, const Interval& b)
+{
+    if (a.isEmpty() || b.isEmpty())
+    {
+        return Interval::empty();
+    }
+
+    // Sign-based case analysis (following boost::numeric::interval), which
+    // only multiplies bounds that can reach the result's bounds and so
+    // never multiplies 0 by an infinite bound
+    const float al = a.lo, ah = a.hi;
+    const float bl = b.lo, bh = b.hi;
+    typedef Interval I;
+
+    if (al < 0)
+    {
+        if (ah > 0)
+        {
+            if (bl < 0)
+            {
+                if (bh > 0)     // M * M
+                {
+                    return I(std::min(I::mulDown(al, bh), I::mulDown(ah, bl)),
+                             std::max(I::mulUp(al, bl), I::mulUp(ah, bh)));
+                }
+                else            // M * N
+                {
+                    return I(I::mulDown(ah, bl), I::mulUp(al, bl));
+                }
+            }
+            else
+            {
+                if (bh > 0)     // M * P
+                {
+                    return I(I::mulDown(al, bh), I::mulUp(ah, bh));
+                }
+                else            // M * Z
+                {
+                    return I(0.0f, 0.0f);
+                }
+            }
+        }
+        else
+        {
+            if (bl < 0)
+            {
+                if (bh > 0)     // N * M
+                {
+                    return I(I::mulDown(al, bh), I::mulUp(al, bl));
+                }
+                else            // N * N
+                {
+                    return I(I::mulDown(ah, bh), I::mulUp(al, bl));
+                }
+            }
+            else
+            {
+                if (bh > 0)     // N * P
+                {
+                    return I(I::mulDown(al, bh), I::mulUp(ah, bl));
+                }
+                else            // N * Z
+                {
+                    return I(0.0f, 0.0f);
+                }
+            }
+        }
+    }
+    else
+    {
+        if (ah > 0)
+        {
+            if (bl < 0)
+            {
+                if (bh > 0)     // P * M
+                {
+                    return I(I::mulDown(ah, bl), I::mulUp(ah, bh));
+                }
+                else            // P * N
+                {
+                    return I(I::mulDown(ah, bl), I::mulUp(al, bh));
+                }
+            }
+            else
+            {
+                if (bh > 0)     // P * P
+                {
+                    return I(I::mulDown(al, bl), I::mulUp(ah, bh));
+                }
+                else            // P * Z
+                {
+                    return I(0.0f, 0.0f);
+                }
+            }
+        }
+        else                    // Z * ?
+        {
+            return I(0.0f, 0.0f);
+        }
+    }
+}
+
+Interval operator/(const Interval& a, const Interval& b)
+{
+    if (a.isEmpty() || b.isEmpty())
+    {
+        return Interval::empty();
+    }
+
+    const float al = a.lo, ah = a.hi;
+    const float bl = b.lo, bh = b.hi;
+    typedef Interval I;
+    const bool a_zero = (al == 0 && ah == 0);
+
+    // Division by an interval containing zero (as in boost's div_zero,
+    // div_positive, and div_negative)
+    if (bl <= 0 && bh >= 0)
+    {
+        if (bl != 0 && bh != 0)
+        {
+            return a_zero ? a : I::whole();
+        }
+        else if (bl != 0)       // b = [bl, 0]
+        {
+            if (a_zero)         return a;
+            else if (ah < 0)    return I(I::divDown(ah, bl), INFINITY);
+            else if (al < 0)    return I::whole();
+            else                return I(-INFINITY, I::divUp(al, bl));
+        }
+        else if (bh != 0)       // b = [0, bh]
+        {
+            if (a_zero)         return a;
+            else if (ah < 0)    return I(-INFINITY, I::divUp(ah, bh));
+            else if (al < 0)    return I::whole();
+            else                return I(I::divDown(al, bh), INFINITY);
+        }
+        else                    // b = [0, 0]
+        {
+            return I::empty();
+        }
+    }
+
+    // Otherwise, b is strictly positive or strictly negative
+    if (bh < 0)
+    {
+        if (ah < 0)         return I(I::divDown(ah, bl), I::divUp(al, bh));
+        else if (al < 0)    return I(I::divDown(ah, bh), I::divUp(al, bh));
+        else                return I(I::divDown(ah, bh), I::divUp(al, bl));
+    }
+    else
+    {
+        if (ah < 0)         return I(I::divDown(al, bl), I::divUp(ah, bh));
+        else if (al < 0)    return I(I::divDown(al, bl), I::divUp(ah, bl));
+        else                return I(I::divDown(al, bh), I::divUp(ah, bl));
+    }
+}
+
+Interval square(const Interval& a)
+{
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+    else if (a.hi < 0)
+    {
+        return Interval(Interval::mulDown(a.hi, a.hi),
+                        Interval::mulUp(a.lo, a.lo));
+    }
+    else if (a.lo > 0)
+    {
+        return Interval(Interval::mulDown(a.lo, a.lo),
+                        Interval::mulUp(a.hi, a.hi));
+    }
+    else
+    {
+        const float m = (-a.lo > a.hi) ? a.lo : a.hi;
+        return Interval(0.0f, Interval::mulUp(m, m));
+    }
+}
+
+Interval sqrt(const Interval& a)
+{
+    if (a.isEmpty() || a.hi < 0)
+    {
+        return Interval::empty();
+    }
+
+    // As with division, an inexact square root of a float is far enough
+    // from any float that rounding it to double doesn't hide the error
+    return Interval(
+            (a.lo > 0) ? Interval::roundDown(std::sqrt(double(a.lo))) : 0.0f,
+            Interval::roundUp(std::sqrt(double(a.hi))));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ *  Everything below is evaluated in double precision, where the standard
+ *  library's functions are accurate to within an ulp or so.  Before rounding
+ *  to float, we widen results by this relative error bound, which is far
+ *  larger than the double-precision error and far smaller than one ulp of
+ *  a float, so the float bounds are still almost always the tightest ones.
+ */
+static const double TRANSCENDENTAL_ERROR = 1.0 / (1LL << 40);
+
+static float transcDown(double d)
+{
+    // If the double overflowed, the exact result may still be finite
+    if (std::isinf(d))
+    {
+        return (d > 0) ? FLT_MAX : d;
+    }
+    return Interval::roundDown(d - std::abs(d) * TRANSCENDENTAL_ERROR);
+}
+
+static float transcUp(double d)
+{
+    if (std::isinf(d))
+    {
+        return (d < 0) ? -FLT_MAX : d;
+    }
+    return Interval::roundUp(d + std::abs(d) * TRANSCENDENTAL_ERROR);
+}
+
+/*
+ *  Returns x^p for x >= 0 and p > 0, rounded downwards or upwards
+ */
+static float powDown(float x, int p)
+{
+    return transcDown(std::pow(double(x), p));
+}
+
+static float powUp(float x, int p)
+{
+    return transcUp(std::pow(double(x), p));
+}
+
+Interval pow(const Interval& a, int p)
+{
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+    else if (p == 0)
+    {
+        return (a.lo == 0 && a.hi == 0) ? Interval::empty() : Interval(1.0f);
+    }
+    else if (p < 0)
+    {
+        return Interval(1.0f) / pow(a, -p);
+    }
+
+    if (a.hi < 0)
+    {
+        const float yl = powDown(-a.hi, p);
+        const float yu = powUp(-a.lo, p);
+        return (p & 1) ? Interval(-yu, -yl) : Interval(yl, yu);
+    }
+    else if (a.lo < 0)
+    {
+        if (p & 1)
+        {
+            return Interval(-powUp(-a.lo, p), powUp(a.hi, p));
+        }
+        else
+        {
+            return Interval(0.0f, powUp(std::max(-a.lo, a.hi), p));
+        }
+    }
+    else
+    {
+        return Interval(powDown(a.lo, p), powUp(a.hi, p));
+    }
+}
+
+/*
+ *  Returns the n'th root of x, for x >= 0 and n > 0
+ */
+static double root(float x, int n)
+{
+    return (n == 3) ? std::cbrt(double(x)) : std::pow(double(x), 1.0 / n);
+}
+
+Interval nth_root(const Interval& a, int n)
+{
+    assert(n > 0);
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+    else if (n == 1)
+    {
+        return a;
+    }
+
+    if (a.hi <= 0)
+    {
+        if (a.hi == 0)
+        {
+            if (!(n & 1) || a.lo == 0)  // [-1,0]^/2 or [0,0]
+            {
+                return Interval(0.0f, 0.0f);
+            }
+            else                        // [-1,0]^/3
+            {
+                return Interval(-transcUp(root(-a.lo, n)), 0.0f);
+            }
+        }
+        else if (!(n & 1))              // [-2,-1]^/2
+        {
+            return Interval::empty();
+        }
+        else                            // [-2,-1]^/3
+        {
+            return Interval(-transcUp(root(-a.lo, n)),
+                            -transcDown(root(-a.hi, n)));
+        }
+    }
+
+    const float u = transcUp(root(a.hi, n));
+    if (a.lo <= 0)
+    {
+        if (!(n & 1) || a.lo == 0)      // [-1,1]^/2 or [0,1]
+        {
+            return Interval(0.0f, u);
+        }
+        else                            // [-1,1]^/3
+        {
+            return Interval(-transcUp(root(-a.lo, n)), u);
+        }
+    }
+    else                                // [1,2]
+    {
+        return Interval(transcDown(root(a.lo, n)), u);
+    }
+}
+
+/*
+ *  Returns the smallest interval containing both a and b
+ */
+static Interval hull(const Interval& a, const Interval& b)
+{
+    if (a.isEmpty())
+    {
+        return b;
+    }
+    else if (b.isEmpty())
+    {
+        return a;
+    }
+    return Interval(std::min(a.lower(), b.lower()),
+                    std::max(a.upper(), b.upper()));
+}
+
+/*
+ *  Bounds x^b for x in [xl, xu] (with xl >= 0) and b in [bl, bu].
+ *
+ *  For a fixed b, x^b is monotonic in x, and for a fixed x, it's monotonic
+ *  in b, so its extrema over the box are at the corners (this holds for
+ *  std::pow's conventions at zero and infinity, too).
+ */
+static Interval powCorners(double xl, double xu, double bl, double bu)
+{
+    double lo = INFINITY;
+    double hi = -INFINITY;
+    for (double x : {xl, xu})
+    {
+        for (double b : {bl, bu})
+        {
+            const double v = std::pow(x, b);
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+    }
+    return Interval(std::max(0.0f, transcDown(lo)), transcUp(hi));
+}
+
+Interval pow(const Interval& a, const Interval& b)
+{
+    if (a.isEmpty() || b.isEmpty())
+    {
+        return Interval::empty();
+    }
+
+    // Constant integer exponents (the usual case) are handled exactly
+    if (b.lo == b.hi && b.lo == std::floor(b.lo) && std::abs(b.lo) < 1e6)
+    {
+        return (b.lo == 0) ? Interval(1.0f) : pow(a, int(b.lo));
+    }
+
+    auto out = Interval::empty();
+    if (a.hi >= 0)
+    {
+        out = powCorners(std::max(a.lo, 0.0f), a.hi, b.lo, b.hi);
+    }
+
+    // Negative bases only have (real) powers for the integers in b,
+    // whose magnitudes are bounded like those of positive bases.
+    // The sign alternates, unless there's only one integer.
+    if (a.lo < 0)
+    {
+        const double kl = std::ceil(b.lo);
+        const double ku = std::floor(b.hi);
+        if (kl <= ku)
+        {
+            const auto m = powCorners((a.hi < 0) ? -a.hi : 0.0f, -a.lo, kl, ku);
+            if (kl != ku)
+            {
+                out = hull(out, Interval(-m.hi, m.hi));
+            }
+            else
+            {
+                out = hull(out, std::fmod(kl, 2) ? -m : m);
+            }
+        }
+    }
+    return out;
+}
+
+Interval nth_root(const Interval& a, const Interval& n)
+{
+    // This matches the point evaluators, which compute a^(1/n) in floats
+    // (so roots of negative numbers are NaN, even for odd n)
+    return pow(a, Interval(1.0f) / n);
+}
+
+Interval mod(const Interval& a, const Interval& b)
+{
+    if (a.isEmpty() || b.isEmpty())
+    {
+        return Interval::empty();
+    }
+    else if (!(b.lo > 0))
+    {
+        return Interval::whole();
+    }
+    else if (std::isinf(b.hi))
+    {
+        return Interval(0.0f, b.hi);
+    }
+
+    // If a is within a single period of a constant b (or below the smallest
+    // b), then the result is a shifted copy of a.  Evaluators compute it as
+    // a - floor(a / b) * b, then fix up results outside of [0, b), so points
+    // can land a few ulps away from the exact result; we widen by that much.
+    double k = 0;
+    if (b.lo == b.hi)
+    {
+        k = std::floor(double(a.lo) / b.lo);
+        if (!(std::abs(k) < (1 << 24)) || k != std::floor(double(a.hi) / b.lo))
+        {
+            return Interval(0.0f, b.hi);
+        }
+    }
+    else if (!(a.lo >= 0 && a.hi < b.lo))
+    {
+        return Interval(0.0f, b.hi);
+    }
+
+    const double err = 4 * FLT_EPSILON * (std::abs(k) + 1) * b.hi;
+    return Interval(std::max(double(a.lo) - k * b.lo - err, -err),
+                    std::min(double(a.hi) - k * b.lo + err, b.hi + err));
+}
+
+Interval nanfill(const Interval& a, const Interval& b)
+{
+    return hull(a, b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ *  Checks whether [l, u] contains p + k * period for some integer k
+ */
+static bool containsPeriodic(double l, double u, double p, double period)
+{
+    return p + std::ceil((l - p) / period) * period <= u;
+}
+
+/*
+ *  Shared implementation for sin and cos, which have their maximum at
+ *  peak + 2*pi*k (and their minimum half a period later)
+ */
+static Interval periodic(const Interval& a, double (*f)(double), double peak)
+{
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+
+    const double l = a.lower();
+    const double u = a.upper();
+    if (!(u - l < 2 * M_PI))
+    {
+        return Interval(-1.0f, 1.0f);
+    }
+
+    // The case analysis works on the original (unreduced) values, so
+    // rounding errors only matter right next to an extremum, where
+    // the function is flat enough that it doesn't matter.
+    const double fl = f(l);
+    const double fu = f(u);
+    const bool has_max = containsPeriodic(l, u, peak, 2 * M_PI);
+    const bool has_min = containsPeriodic(l, u, peak + M_PI, 2 * M_PI);
+
+    return Interval(has_min ? -1.0f
+                            : std::max(-1.0f, transcDown(std::min(fl, fu))),
+                    has_max ? 1.0f
+                            : std::min(1.0f, transcUp(std::max(fl, fu))));
+}
+
+Interval sin(const Interval& a)
+{
+    return periodic(a, [](double x) { return std::sin(x); }, M_PI / 2);
+}
+
+Interval cos(const Interval& a)
+{
+    return periodic(a, [](double x) { return std::cos(x); }, 0);
+}
+
+Interval tan(const Interval& a)
+{
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+
+    const double l = a.lower();
+    const double u = a.upper();
+    if (!(u - l < M_PI) || containsPeriodic(l, u, M_PI / 2, M_PI))
+    {
+        return Interval::whole();
+    }
+
+    // If the bounds are so close to an asymptote that the case analysis
+    // above was fooled, they'll come out in the wrong order
+    const double tl = std::tan(l);
+    const double tu = std::tan(u);
+    if (tl > tu)
+    {
+        return Interval::whole();
+    }
+    return Interval(transcDown(tl), transcUp(tu));
+}
+
+Interval asin(const Interval& a)
+{
+    if (a.isEmpty() || a.hi < -1 || a.lo > 1)
+    {
+        return Interval::empty();
+    }
+    return Interval(
+        (a.lo <= -1) ? transcDown(-M_PI / 2) : transcDown(std::asin(double(a.lo))),
+        (a.hi >= 1)  ? transcUp(M_PI / 2)    : transcUp(std::asin(double(a.hi))));
+}
+
+Interval acos(const Interval& a)
+{
+    if (a.isEmpty() || a.hi < -1 || a.lo > 1)
+    {
+        return Interval::empty();
+    }
+    return Interval(
+        (a.hi >= 1)  ? 0.0f             : transcDown(std::acos(double(a.hi))),
+        (a.lo <= -1) ? transcUp(M_PI)   : transcUp(std::acos(double(a.lo))));
+}
+
+Interval atan(const Interval& a)
+{
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+    return Interval(transcDown(std::atan(double(a.lo))),
+                    transcUp(std::atan(double(a.hi))));
+}
+
+Interval exp(const Interval& a)
+{
+    if (a.isEmpty())
+    {
+        return Interval::empty();
+    }
+    return Interval(std::max(0.0f, transcDown(std::exp(double(a.lo)))),
+                    transcUp(std::exp(double(a.hi))));
+}
+
+Interval atan2(const Interval& y, const Interval& x)
+{
+    if (y.isEmpty() || x.isEmpty())
+    {
+        return Interval::empty();
+    }
+
+    // There are 9 possible cases for interval atan2:
+    // - Completely within a quadrant (4 cases)
+    // - Completely within two quadrants (4 cases)
+    // - Containing the origin (1 case)
+    auto out = [](double lo, double hi)
+        { return Interval(transcDown(lo), transcUp(hi)); };
+    const double xl = x.lo, xu = x.hi;
+    const double yl = y.lo, yu = y.hi;
+
+    if (xl > 0)
+    {   // Right half of the plane
+        if (yl > 0)
+        {   // 1st quadrant
+            return out(std::atan2(yl, xu), std::atan2(yu, xl));
+        }
+        else if (yu < 0)
+        {   // 4th quadrant
+            return out(std::atan2(yl, xl), std::atan2(yu, xu));
+        }
+        else
+        {   // Crossing the X axis
+            return out(std::atan2(yl, xl), std::atan2(yu, xl));
+        }
+    }
+    else if (xu < 0)
+    {   // Left half of the plane
+        if (yl > 0)
+        {   // 2nd quadrant
+            return out(std::atan2(yu, xu), std::atan2(yl, xl));
+        }
+        else if (yu < 0)
+        {   // 3rd quadrant
+            return out(std::atan2(yu, xl), std::atan2(yl, xu));
+        }
+        else
+        {   // Branch cut
+            return out(-M_PI, M_PI);
+        }
+    }
+    else
+    {  // Both sides of the plane
+        if (yl > 0)
+        {   // Top half of the plane
+            return out(std::atan2(yl, xu), std::atan2(yl, xl));
+        }
+        else if (yu < 0)
+        {
+            // Bottom half of the plane
+            return out(std::atan2(yu, xl), std::atan2(yu, xu));
+        }
+        else
+        {
+            // Contains the origin
+            return out(-M_PI, M_PI);
+        }
+    }
+}
+
+}   // namespace Kernel
@@ -0,0 +1,331 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    (defined(__linux__) || defined(__APPLE__))
+#define STRAYLIGHT_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "kernel/eval/jit.hpp"
+
+namespace Kernel {
+
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined(STRAYLIGHT_JIT_X86_64)
+
+/*
+ *  A minimal x86-64 assembler, which knows just enough instructions to
+ *  build a compiled tape.
+ *
+ *  The generated function is
+ *      void f(float* begin, const float* end)
+ *  where rbx walks from begin to end in steps of 32 bytes (one ymm register)
+ *  and every Result row is addressed as [rbx + disp32].  rbx and rbp are
+ *  callee-saved, so they survive calls to fallback kernels; the ymm
+ *  registers don't, so nothing is kept in them across a call.
+ */
+class Assembler
+{
+public:
+    /*  VEX opcodes (in the 0F map) for packed single-precision ops  */
+    enum PackedOp : uint8_t {
+        LOAD = 0x28, STORE = 0x29, SQRT = 0x51, XOR = 0x57,
+        ADD = 0x58, MUL = 0x59, SUB = 0x5C, MIN = 0x5D, DIV = 0x5E,
+        MAX = 0x5F,
+    };
+
+    void byte(uint8_t b) { code.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs)
+        { code.insert(code.end(), bs.begin(), bs.end()); }
+    void imm32(uint32_t i)
+        { for (unsigned s=0; s < 32; s += 8) byte((i >> s) & 0xFF); }
+    void imm64(uint64_t i)
+        { for (unsigned s=0; s < 64; s += 8) byte((i >> s) & 0xFF); }
+
+    /*
+     *  Emits the prefix and opcode of a 256-bit VEX instruction (2-byte
+     *  form, no mandatory prefix), where src1 goes in the vvvv field
+     *  (0 if unused, which encodes as 1111).  Only ymm0-7 are used, so
+     *  the ModRM byte that follows doesn't need any extension bits.
+     */
+    void vex(PackedOp op, uint8_t src1)
+    {
+        bytes({0xC5, uint8_t(0x80 | ((~src1 & 0xF) << 3) | 0x04), op});
+    }
+
+    /*  op ymm(dst), ymm(src1), [rbx + disp]  */
+    void mem(PackedOp op, uint8_t dst, uint8_t src1, int32_t disp)
+    {
+        vex(op, src1);
+        byte(0x80 | (dst << 3) | 3);
+        imm32(disp);
+    }
+
+    /*  op ymm(dst), ymm(src1), ymm(src2)  */
+    void reg(PackedOp op, uint8_t dst, uint8_t src1, uint8_t src2)
+    {
+        vex(op, src1);
+        byte(0xC0 | (dst << 3) | src2);
+    }
+
+    /*  lea r64, [rbx + disp], where r is rcx, rdx, or rsi  */
+    void lea(uint8_t r, int32_t disp)
+    {
+        bytes({0x48, 0x8D, uint8_t(0x80 | (r << 3) | 3)});
+        imm32(disp);
+    }
+
+    void vzeroupper() { bytes({0xC5, 0xF8, 0x77}); }
+
+    /*  Register numbers used in lea  */
+    static constexpr uint8_t RCX = 1, RDX = 2, RSI = 6;
+
+    std::vector<uint8_t> code;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::unique_ptr<Jit> Jit::compile(const std::vector<Clause>& tape,
+                                  const std::vector<Result::Index>& slots,
+                                  const Backend& fallback)
+{
+    if (!available() || WIDTH % fallback.width)
+    {
+        return nullptr;
+    }
+
+    // Rows are addressed with a signed 32-bit displacement
+    const uint64_t max_disp = uint64_t(INT32_MAX) - sizeof(Result::Row);
+    auto disp = [&](Clause::Id id)
+        { return int32_t(slots[id] * sizeof(Result::Row)); };
+
+    Assembler a;
+
+    // push rbx; push rbp; sub rsp, 8 (to keep the stack 16-byte aligned
+    // for calls), then move begin and end into rbx and rbp
+    a.bytes({0x53, 0x55, 0x48, 0x83, 0xEC, 0x08});
+    a.bytes({0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5});
+    const size_t loop = a.code.size();
+
+    // ymm0 holds the row written by the previous clause (if still valid),
+    // which saves a load when a clause uses it as its first argument
+    const Result::Index NONE = UINT32_MAX;
+    Result::Index cached = NONE;
+    auto load = [&](Clause::Id id)
+    {
+        if (cached != slots[id])
+        {
+            a.mem(Assembler::LOAD, 0, 0, disp(id));
+        }
+    };
+
+    for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr)
+    {
+        if (slots[itr->id] * uint64_t(sizeof(Result::Row)) > max_disp ||
+            slots[itr->a] * uint64_t(sizeof(Result::Row)) > max_disp ||
+            slots[itr->b] * uint64_t(sizeof(Result::Row)) > max_disp)
+        {
+            return nullptr;
+        }
+
+        Assembler::PackedOp op = Assembler::LOAD;
+        switch (itr->op)
+        {
+            case Opcode::ADD:   op = Assembler::ADD; break;
+            case Opcode::MUL:   op = Assembler::MUL; break;
+            case Opcode::MIN:   op = Assembler::MIN; break;
+            case Opcode::MAX:   op = Assembler::MAX; break;
+            case Opcode::SUB:   op = Assembler::SUB; break;
+            case Opcode::DIV:   op = Assembler::DIV; break;
+
+            case Opcode::SQUARE:
+                load(itr->a);
+                a.reg(Assembler::MUL, 0, 0, 0);
+                break;
+            case Opcode::SQRT:
+                a.mem(Assembler::SQRT, 0, 0, disp(itr->a));
+                break;
+            case Opcode::NEG:
+                // Computed as 0 - a (rather than flipping the sign bit),
+                // to match the interpreter's handling of zero
+                a.reg(Assembler::XOR, 1, 1, 1);
+                a.mem(Assembler::SUB, 0, 1, disp(itr->a));
+                break;
+            case Opcode::CONST_VAR:
+                load(itr->a);
+                break;
+
+            case Opcode::ATAN2:
+            case Opcode::POW:
+            case Opcode::NTH_ROOT:
+            case Opcode::MOD:
+            case Opcode::NANFILL:
+            case Opcode::SIN:
+            case Opcode::COS:
+            case Opcode::TAN:
+            case Opcode::ASIN:
+            case Opcode::ACOS:
+            case Opcode::ATAN:
+            case Opcode::EXP:
+            case Opcode::ABS:
+            case Opcode::RECIP:
+            case Opcode::RSQRT:
+                // fallback.values(op, a, b, out, WIDTH), with
+                // arguments in edi, rsi, rdx, rcx, and r8d
+                a.byte(0xBF);
+                a.imm32(itr->op);
+                a.lea(Assembler::RSI, disp(itr->a));
+                a.lea(Assembler::RDX, disp(itr->b));
+                a.lea(Assembler::RCX, disp(itr->id));
+                a.bytes({0x41, 0xB8});
+                a.imm32(WIDTH);
+                a.bytes({0x48, 0xB8});
+                a.imm64(reinterpret_cast<uintptr_t>(fallback.values));
+                a.vzeroupper();
+                a.bytes({0xFF, 0xD0});  // call rax
+                cached = NONE;
+                continue;
+
+            case Opcode::INVALID:
+            case Opcode::CONST:
+            case Opcode::VAR_X:
+            case Opcode::VAR_Y:
+            case Opcode::VAR_Z:
+            case Opcode::VAR:
+            case Opcode::LAST_OP: return nullptr;
+        }
+
+        if (op != Assembler::LOAD)
+        {
+            // Commutative operations can use a cached second argument
+            if (cached == slots[itr->b] && cached != slots[itr->a] &&
+                (itr->op == Opcode::ADD || itr->op == Opcode::MUL))
+            {
+                a.mem(op, 0, 0, disp(itr->a));
+            }
+            else
+            {
+                load(itr->a);
+                a.mem(op, 0, 0, disp(itr->b));
+            }
+        }
+        a.mem(Assembler::STORE, 0, 0, disp(itr->id));
+        cached = slots[itr->id];
+    }
+
+    // add rbx, 32; cmp rbx, rbp; jb loop
+    a.bytes({0x48, 0x83, 0xC3, 0x20, 0x48, 0x39, 0xEB, 0x0F, 0x82});
+    a.imm32(uint32_t(int32_t(loop) - int32_t(a.code.size() + 4)));
+
+    // vzeroupper; add rsp, 8; pop rbp; pop rbx; ret
+    a.vzeroupper();
+    a.bytes({0x48, 0x83, 0xC4, 0x08, 0x5D, 0x5B, 0xC3});
+
+    // Copy the code into a fresh buffer, then make it executable
+    // (but not writable)
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t size = (a.code.size() + page - 1) / page * page;
+    void* buf = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    memcpy(buf, a.code.data(), a.code.size());
+    if (mprotect(buf, size, PROT_READ | PROT_EXEC))
+    {
+        munmap(buf, size);
+        return nullptr;
+    }
+    return std::unique_ptr<Jit>(new Jit(buf, size));
+}
+
+Jit::Jit(void* buffer, size_t size)
+    : buffer(buffer), size(size),
+      function(reinterpret_cast<Function>(buffer))
+{
+    // Nothing to do here
+}
+
+Jit::~Jit()
+{
+    munmap(buffer, size);
+}
+
+bool Jit::available()
+{
+    // This also checks that the OS saves ymm registers (via XGETBV)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+}
+
+#else   // !STRAYLIGHT_JIT_X86_64
+
+std::unique_ptr<Jit> Jit::compile(const std::vector<Clause>&,
+                                  const std::vector<Result::Index>&,
+                                  const Backend&)
+{
+    return nullptr;
+}
+
+Jit::Jit(void* buffer, size_t size)
+    : buffer(buffer), size(size), function(nullptr)
+{
+    // Nothing to do here
+}
+
+Jit::~Jit()
+{
+    // Nothing to do here
+}
+
+bool Jit::available()
+{
+    return false;
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+const Backend& Jit::fallbackFor(const Backend& b)
+{
+    if (WIDTH % b.width == 0)
+    {
+        return b;
+    }
+    for (auto f : Backend::available())
+    {
+        if (WIDTH % f->width == 0)
+        {
+            return *f;
+        }
+    }
+    return Backend::scalar();
+}
+
+static std::atomic<bool>& jitEnabled()
+{
+    static std::atomic<bool> e([]{
+        auto s = getenv("STRAYLIGHT_JIT");
+        return s && !strcmp(s, "1"); }());
+    return e;
+}
+
+bool Jit::enabled()
+{
+    return jitEnabled().load();
+}
+
+void Jit::setEnabled(bool e)
+{
+    jitEnabled().store(e);
+}
+
+}   // namespace Kernel
@@ -0,0 +1,180 @@
+#include <cassert>
+
+#include "kernel/eval/pool.hpp"
+
+namespace Kernel {
+
+EvaluatorPool& EvaluatorPool::instance()
+{
+    // This is constructed on first use, so it's destroyed before the
+    // global Cache (which the trees in the pool need when they're freed)
+    static EvaluatorPool pool;
+    return pool;
+}
+
+EvaluatorPool::~EvaluatorPool()
+{
+    clear();
+    assert(entries.empty());
+}
+
+EvaluatorPool::Handle EvaluatorPool::checkout(
+        const Tree t, const std::map<Tree::Id, float>& vars)
+{
+    Evaluator* e = nullptr;
+    std::shared_ptr<const Program> program;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        auto itr = entries.find(t.id());
+        if (itr != entries.end())
+        {
+            auto& entry = itr->second;
+            if (entry.idle.size())
+            {
+                e = entry.idle.back();
+                entry.idle.pop_back();
+                entry.active++;
+                entry.used = ++clock;
+                idle--;
+                counts.hits++;
+            }
+            else
+            {
+                program = entry.program;
+            }
+        }
+    }
+
+    if (e)
+    {
+        // Reset anything that a previous user could have changed
+        e->setMatrix(glm::mat4());
+        if (&e->getBackend() != &Backend::active())
+        {
+            e->setBackend(Backend::active());
+        }
+        e->setJit(Jit::enabled());
+        e->setIntervalMode(Evaluator::INTERVAL_ARITHMETIC);
+        e->resetCounts();
+        for (const auto& v : vars)
+        {
+            e->setVar(v.first, v.second);
+        }
+    }
+    else
+    {
+        // Flatten the tree (unless another evaluator already did)
+        // and build an evaluator without holding the lock
+        if (!program)
+        {
+            program = std::make_shared<Program>(t);
+        }
+        e = new Evaluator(program, vars);
+
+        std::lock_guard<std::mutex> lock(mut);
+        auto& entry = entries.insert(
+                {t.id(), Entry{t, program, {}, 0, 0}}).first->second;
+        entry.active++;
+        entry.used = ++clock;
+        counts.misses++;
+    }
+
+    return Handle(e, Checkin{this, t.id()});
+}
+
+std::vector<EvaluatorPool::Handle> EvaluatorPool::checkout(
+        const Tree t, size_t count, const std::map<Tree::Id, float>& vars)
+{
+    std::vector<Handle> out;
+    for (size_t i=0; i < count; ++i)
+    {
+        out.push_back(checkout(t, vars));
+    }
+    return out;
+}
+
+void EvaluatorPool::checkin(Tree::Id key, Evaluator* e)
+{
+    std::lock_guard<std::mutex> lock(mut);
+
+    auto itr = entries.find(key);
+    assert(itr != entries.end());
+    assert(itr->second.active > 0);
+
+    auto& entry = itr->second;
+    entry.active--;
+    entry.idle.push_back(e);
+    entry.used = ++clock;
+    idle++;
+
+    evict();
+}
+
+void EvaluatorPool::evict()
+{
+    while (idle > capacity)
+    {
+        // Find the least recently used tree with idle evaluators
+        auto lru = entries.end();
+        for (auto itr = entries.begin(); itr != entries.end(); ++itr)
+        {
+            if (itr->second.idle.size() &&
+                (lru == entries.end() || itr->second.used < lru->second.used))
+            {
+                lru = itr;
+            }
+        }
+        assert(lru != entries.end());
+
+        delete lru->second.idle.back();
+        lru->second.idle.pop_back();
+        idle--;
+        counts.evictions++;
+
+        if (lru->second.idle.empty() && lru->second.active == 0)
+        {
+            entries.erase(lru);
+        }
+    }
+}
+
+void EvaluatorPool::setCapacity(size_t c)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    capacity = c;
+    evict();
+}
+
+void EvaluatorPool::clear()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    for (auto itr = entries.begin(); itr != entries.end();)
+    {
+        for (auto e : itr->second.idle)
+        {
+            delete e;
+        }
+        idle -= itr->second.idle.size();
+        itr->second.idle.clear();
+
+        if (itr->second.active == 0)
+        {
+            itr = entries.erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+    assert(idle == 0);
+}
+
+EvaluatorPool::Stats EvaluatorPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Stats out = counts;
+    out.idle = idle;
+    return out;
+}
+
+}   // namespace Kernel
@@ -0,0 +1,268 @@
+#include <cassert>
+#include <unordered_set>
+
+#include "kernel/eval/program.hpp"
+
+namespace Kernel {
+
+Program::Program(const Tree root)
+    : Program(std::vector<Tree>{root})
+{
+    // Nothing to do here
+}
+
+Program::Program(const std::vector<Tree>& roots_)
+{
+    // The dummy clause (0) is mapped to the first result slot
+    trees.push_back(nullptr);
+    update(roots_);
+}
+
+void Program::update(const std::vector<Tree>& roots_)
+{
+    assert(roots_.size());
+
+    auto id = [&](const std::shared_ptr<Tree::Tree_>& t) -> Clause::Id
+        { return t ? clauses.at(t.get()).first : 0; };
+
+    // Flatten nodes that aren't already in the program.  Flattening
+    // depth-first keeps the tape's live width small, which lets
+    // assignSlots reuse more rows.  Each tree's postorder only includes
+    // nodes that earlier trees didn't, so each node comes after its
+    // children (which may already be in the tape).
+    std::vector<Tree> flat;
+    std::unordered_set<Tree::Id> seen;
+    for (const auto& r : roots_)
+    {
+        for (const auto& m : r.postorder([&](Tree::Id t)
+                { return clauses.count(t) || seen.count(t); }))
+        {
+            seen.insert(m.id());
+            flat.push_back(m);
+        }
+    }
+
+    // New clauses are numbered in reverse, so that (as in a freshly built
+    // program) each clause has a smaller id than its arguments.
+    const Clause::Id base = trees.size();
+    trees.resize(base + flat.size());
+    Clause::Id next_id = trees.size();
+
+    std::vector<Clause> fresh;
+    for (const auto& m : flat)
+    {
+        const Clause::Id c = --next_id;
+
+        // Normal clauses end up in the tape
+        if (m->rank > 0)
+        {
+            fresh.push_back({m->op, c, id(m->lhs), id(m->rhs)});
+        }
+        // For constants and variables, record their values (or var ids)
+        // so that Evaluators can store them in the result array
+        else if (m->op == Opcode::CONST)
+        {
+            constants[c] = m->value;
+        }
+        else if (m->op == Opcode::VAR)
+        {
+            vars.left.insert({c, m.id()});
+        }
+        else
+        {
+            assert(m->op == Opcode::VAR_X ||
+                   m->op == Opcode::VAR_Y ||
+                   m->op == Opcode::VAR_Z);
+        }
+        clauses.insert({m.id(), {c, m}});
+        trees[c] = m.id();
+    }
+    assert(next_id == base);
+
+    // Make sure that X, Y, Z have been allocated space
+    // (even if the trees don't use them)
+    for (auto a : {Tree::X(), Tree::Y(), Tree::Z()})
+    {
+        if (clauses.find(a.id()) == clauses.end())
+        {
+            clauses.insert({a.id(), {trees.size(), a}});
+            trees.push_back(a.id());
+        }
+    }
+
+    // Store the index of each tree's root
+    roots.clear();
+    root_ops.clear();
+    for (const auto& r : roots_)
+    {
+        roots.push_back(clauses.at(r.id()).first);
+        root_ops.push_back(r->op);
+    }
+
+    // Build the new tape from the new clauses (which are evaluated last,
+    // as they may use old clauses) followed by the old tape, keeping only
+    // clauses that are used by a root.  As the tape is in reverse
+    // evaluation order, each clause is seen before its arguments, so
+    // liveness is found in a single pass.
+    std::vector<uint8_t> live(trees.size(), false);
+    for (auto r : roots)
+    {
+        live[r] = true;
+    }
+    for (auto a : {Tree::X(), Tree::Y(), Tree::Z()})
+    {
+        live[clauses.at(a.id()).first] = true;
+    }
+
+    std::vector<Clause> next;
+    next.reserve(fresh.size() + tape.size());
+    auto keep = [&](const Clause& c)
+    {
+        if (live[c.id])
+        {
+            live[c.a] = true;
+            live[c.b] = true;
+            next.push_back(c);
+        }
+    };
+    for (auto itr = fresh.rbegin(); itr != fresh.rend(); ++itr)
+    {
+        keep(*itr);
+    }
+    for (const auto& c : tape)
+    {
+        keep(c);
+    }
+    // Clauses that only depend on constants and variables are split
+    // off into the prelude, since their values are the same everywhere
+    tape.clear();
+    prelude.clear();
+    tape.reserve(next.size());
+    for (const auto& c : next)
+    {
+        if (trees[c.id]->flags & Tree::FLAG_LOCATION_AGNOSTIC)
+        {
+            prelude.push_back(c);
+        }
+        else
+        {
+            tape.push_back(c);
+        }
+    }
+
+    // Drop nodes that are no longer used
+    size_t unused = 0;
+    for (Clause::Id c=1; c < trees.size(); ++c)
+    {
+        if (!live[c] && trees[c])
+        {
+            clauses.erase(trees[c]);
+            constants.erase(c);
+            vars.left.erase(c);
+            trees[c] = nullptr;
+        }
+        unused += !trees[c];
+    }
+
+    // Clause ids are never reused, so once most of them are
+    // unused, it's worth renumbering from scratch
+    if (unused > trees.size() / 2)
+    {
+        *this = Program(roots_);
+        return;
+    }
+
+    // Assign clauses to rows in the results array
+    slot.resize(trees.size());
+    assignSlots();
+
+    // Save X, Y, Z slots
+    X = slot[clauses.at(Tree::X().id()).first];
+    Y = slot[clauses.at(Tree::Y().id()).first];
+    Z = slot[clauses.at(Tree::Z().id()).first];
+}
+
+void Program::assignSlots()
+{
+    // This is a linear-scan register allocator over the root tape.  Clauses
+    // are visited in evaluation order; each gets a slot (reusing one from
+    // the free list if possible), then any argument that this clause was
+    // the last to read has its slot returned to the free list.  The output
+    // slot is picked before the arguments are freed, because clause kernels
+    // don't allow their inputs and output to alias.
+    //
+    // Arguments to min and max are never freed: push, specialize, and
+    // friends read them after evaluation, and pushed tapes remap clauses
+    // to them.  Pushed tapes are subsets of the root tape that only ever
+    // read from remapped (pinned) slots, so this assignment is valid for
+    // every tape on the stack.
+    //
+    // Roots are also never freed, since they're read once the whole
+    // tape has been evaluated (and a root can be an argument to another
+    // root's clauses).
+    const auto& t = tape;
+    std::vector<uint8_t> output(slot.size(), false);
+    std::vector<uint8_t> pinned(slot.size(), false);
+    std::vector<size_t> last(slot.size(), 0);
+    for (auto r : roots)
+    {
+        pinned[r] = true;
+    }
+
+    size_t n = 0;
+    for (auto itr = t.rbegin(); itr != t.rend(); ++itr, ++n)
+    {
+        output[itr->id] = true;
+        last[itr->a] = n;
+        last[itr->b] = n;
+        if (itr->op == Opcode::MIN || itr->op == Opcode::MAX)
+        {
+            pinned[itr->a] = true;
+            pinned[itr->b] = true;
+        }
+    }
+
+    // Constants, variables, prelude clauses, and the dummy clause
+    // get their own slots
+    // (and unused ids share the dummy clause's slot, as they're never read)
+    Result::Index slots = 0;
+    for (Clause::Id i=0; i < slot.size(); ++i)
+    {
+        if (!output[i])
+        {
+            slot[i] = (i == 0 || trees[i]) ? slots++ : 0;
+        }
+    }
+
+    std::vector<Result::Index> free;
+    n = 0;
+    for (auto itr = t.rbegin(); itr != t.rend(); ++itr, ++n)
+    {
+        if (free.empty())
+        {
+            slot[itr->id] = slots++;
+        }
+        else
+        {
+            slot[itr->id] = free.back();
+            free.pop_back();
+        }
+
+        auto release = [&](Clause::Id k)
+        {
+            if (output[k] && !pinned[k] && last[k] == n)
+            {
+                free.push_back(slot[k]);
+            }
+        };
+        release(itr->a);
+        if (itr->b != itr->a)
+        {
+            release(itr->b);
+        }
+    }
+
+    row_count = slots;
+}
+
+}   // namespace Kernel
@@ -2,60 +2,67 @@
 
 namespace Kernel {
 
-void Result::resize(Index clauses, Index vars)
+void Result::resize(Index clauses)
 {
-#ifdef __AVX__
-    mf.resize(clauses);
-    mdx.resize(clauses);
-    mdy.resize(clauses);
-    mdz.resize(clauses);
-
-    f  = reinterpret_cast<float(*)[N]>(&mf[0]);
-    dx = reinterpret_cast<float(*)[N]>(&mdx[0]);
-    dy = reinterpret_cast<float(*)[N]>(&mdy[0]);
-    dz = reinterpret_cast<float(*)[N]>(&mdz[0]);
-#else
     f.resize(clauses);
-    dx.resize(clauses);
-    dy.resize(clauses);
-    dz.resize(clauses);
-#endif
     i.resize(clauses);
-    j.resize(clauses);
-    for (auto& d : j)
-    {
-        d.resize(vars);
-    }
+    ambiguous.resize(1);
+
+    // Old derivatives and intervals are no longer meaningful (as clauses
+    // may have moved between rows), but their memory can be reused
+    dx.clear();
+    dy.clear();
+    dz.clear();
+    lower.clear();
+    upper.clear();
+    a.clear();
+    di.clear();
+}
+
+void Result::resizeDerivs()
+{
+    dx.assign(f.size(), Row());
+    dy.assign(f.size(), Row());
+    dz.assign(f.size(), Row());
 }
 
-void Result::fill(float v, Index clause)
+void Result::resizeIntervals()
 {
-    setValue(v, clause);
+    lower.resize(f.size());
+    upper.resize(f.size());
+    a.resize(f.size());
+    di.resize(f.size());
 
-    // Fill the Gradient row with zeros
-    for (auto& d : j[clause])
+    // Constants (and variables) were stored before these arrays existed,
+    // so copy them over from the float array
+    for (Index k=0; k < f.size(); ++k)
     {
-        d = 0;
+        const float v = f[k][0];
+        lower[k].fill(v);
+        upper[k].fill(v);
+        a[k] = Affine(v);
+        di[k].fill(Interval(0.0f));
     }
 }
 
 void Result::setValue(float v, Index clause)
 {
-    for (unsigned i=0; i < N; ++i)
+    f[clause].fill(v);
+    if (!dx.empty())
     {
-        f[clause][i] = v;
-        dx[clause][i] = 0;
-        dy[clause][i] = 0;
-        dz[clause][i] = 0;
+        dx[clause].fill(0);
+        dy[clause].fill(0);
+        dz[clause].fill(0);
     }
 
     i[clause] = Interval(v, v);
-}
-
-void Result::setGradient(Index clause, Index var)
-{
-    // Drop a 1 in the Jacobian row at the var index
-    j[clause][var] = 1;
+    if (!lower.empty())
+    {
+        lower[clause].fill(v);
+        upper[clause].fill(v);
+        a[clause] = Affine(v);
+        di[clause].fill(Interval(0.0f));
+    }
 }
 
 void Result::setDeriv(float x, float y, float z, Index clause)
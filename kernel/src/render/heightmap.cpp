@@ -8,6 +8,7 @@
 #include "kernel/render/heightmap.hpp"
 #include "kernel/eval/result.hpp"
 #include "kernel/eval/evaluator.hpp"
+#include "kernel/eval/pool.hpp"
 
 namespace Kernel {
 
@@ -103,17 +104,41 @@ for (unsigned i=0; i < r.X.size; ++i)           \
 static void pixels(Evaluator* e, const Subregion& r,
                    DepthImage& depth, NormalImage& norm)
 {
-    size_t index = 0;
-
-    // Flatten the region in a particular order
-    // (which needs to be obeyed by anything unflattening results)
-    SUBREGION_ITERATE_XYZ(r)
+    bool full = true;
+    for (unsigned i=0; i < r.X.size && full; ++i)
     {
-        e->setRaw(r.X.pos(i), r.Y.pos(j), r.Z.pos(r.Z.size - k - 1), index++);
+        for (unsigned j=0; j < r.Y.size && full; ++j)
+        {
+            full = depth(r.Y.min + j, r.X.min + i) < r.Z.pos(r.Z.size - 1);
+        }
     }
-    e->applyTransform(index);
 
-    const float* out = e->values(index);
+    size_t index = 0;
+    const float* out;
+    if (full)
+    {
+        // If every column is in front of the depth image, then the points
+        // make up a whole grid (with Z reversed), so clauses that don't
+        // depend on every axis can be evaluated once per row or column
+        float zs[Result::N];
+        for (unsigned k=0; k < r.Z.size; ++k)
+        {
+            zs[k] = r.Z.pos(r.Z.size - k - 1);
+        }
+        out = e->grid(r.X.ptr, r.X.size, r.Y.ptr, r.Y.size, zs, r.Z.size);
+    }
+    else
+    {
+        // Flatten the region in a particular order
+        // (which needs to be obeyed by anything unflattening results)
+        SUBREGION_ITERATE_XYZ(r)
+        {
+            e->setRaw(r.X.pos(i), r.Y.pos(j), r.Z.pos(r.Z.size - k - 1),
+                      index++);
+        }
+        e->applyTransform(index);
+        out = e->values(index);
+    }
 
     index = 0;
 
@@ -185,9 +210,14 @@ static void fill(Evaluator* e, const Subregion& r, DepthImage& depth,
 /*
 * Helper function that reduces a particular matrix block
 * Returns true if finished, false if aborted
+*
+* out is the block's interval result, which was found by the caller
+* in the given lane of a batched evaluation.  If lane is Result::NI, the
+* caller didn't evaluate the block, so we do it here (if needed).
 */
-static bool recurse(Evaluator* e, const Subregion& r, DepthImage& depth,
-                NormalImage& norm, const std::atomic_bool& abort)
+static bool recurse(Evaluator* e, const Subregion& r, Interval out,
+                Result::Index lane, DepthImage& depth, NormalImage& norm,
+                const std::atomic_bool& abort)
 {
     // Stop rendering if the abort flag is set
     if (abort.load())
@@ -211,8 +241,11 @@ static bool recurse(Evaluator* e, const Subregion& r, DepthImage& depth,
         return true;
     }
 
-    // Do the interval evaluation
-    Interval out = e->eval(r.X.bounds, r.Y.bounds, r.Z.bounds);
+    // Do the interval evaluation, if the caller didn't batch it
+    if (lane == Result::NI)
+    {
+        out = e->eval(r.X.bounds, r.Y.bounds, r.Z.bounds);
+    }
 
     // If strictly negative, fill up the block and return
     if (out.upper() < 0)
@@ -223,21 +256,52 @@ static bool recurse(Evaluator* e, const Subregion& r, DepthImage& depth,
     else if (out.lower() <= 0)
     {
         // Disable inactive nodes in the tree
-        e->push();
+        if (lane < Result::NI)
+        {
+            e->push(lane);
+        }
+        else
+        {
+            e->push();
+        }
 
         // Subdivide and recurse
         assert(r.canSplit());
 
         auto rs = r.split();
 
+        // Evaluate both halves in a single pass, in the pair of lanes after
+        // this block's pair (so that they're still there when we come back
+        // up the recursion), unless they'll be rendered pixel-by-pixel.
+        // If we run out of lanes, each half is evaluated on its own.
+        std::array<Interval, 2> is;
+        std::array<Result::Index, 2> lanes = {{Result::NI, Result::NI}};
+        const Result::Index first = (lane < Result::NI)
+            ? (lane / 2 + 1) * 2 : Result::NI;
+        if (first + 2 <= Result::NI &&
+            (rs.first.voxels() > Result::N || rs.second.voxels() > Result::N))
+        {
+            e->set(rs.first.X.bounds, rs.first.Y.bounds,
+                   rs.first.Z.bounds, first);
+            e->set(rs.second.X.bounds, rs.second.Y.bounds,
+                   rs.second.Z.bounds, first + 1);
+            auto batched = e->intervals(2, first);
+            for (unsigned i=0; i < 2; ++i)
+            {
+                is[i] = Interval(batched.lower[first + i],
+                                 batched.upper[first + i]);
+                lanes[i] = first + i;
+            }
+        }
+
         // Since the higher Z region is in the second item of the
         // split, evaluate rs.second then rs.first
-        if (!recurse(e, rs.second, depth, norm, abort))
+        if (!recurse(e, rs.second, is[1], lanes[1], depth, norm, abort))
         {
             e->pop();
             return false;
         }
-        if (!recurse(e, rs.first, depth, norm, abort))
+        if (!recurse(e, rs.first, is[0], lanes[0], depth, norm, abort))
         {
             e->pop();
             return false;
@@ -280,7 +344,13 @@ void render(
 
         futures.push_back(std::async(std::launch::async,
             [itr, region, &depth, &norm, &abort](){
-                recurse(*itr, region, depth, norm, abort);
+                // Evaluate the whole region in lane 0, so that
+                // its subregions are batched in the lanes above it
+                auto e = *itr;
+                e->set(region.X.bounds, region.Y.bounds, region.Z.bounds, 0);
+                auto i = e->intervals(1);
+                recurse(e, region, Interval(i.lower[0], i.upper[0]), 0,
+                        depth, norm, abort);
             }));
         ++itr;
     }
@@ -298,21 +368,19 @@ void render(
 
 std::pair<DepthImage, NormalImage> render(
     const Tree t, Region r, const std::atomic_bool& abort,
-    glm::mat4 m, size_t workers)
+    glm::mat4 m, size_t workers, Evaluator::IntervalMode mode)
 {
+    // Borrow evaluators from the global pool, which returns them
+    // when the handles go out of scope
+    auto handles = EvaluatorPool::instance().checkout(t, workers);
     std::vector<Evaluator*> es;
-    for (size_t i=0; i < workers; ++i)
+    for (auto& h : handles)
     {
-        es.push_back(new Evaluator(t));
+        h->setIntervalMode(mode);
+        es.push_back(h.get());
     }
 
-    auto out = render(es, r, abort, m);
-
-    for (auto e : es)
-    {
-        delete e;
-    }
-    return out;
+    return render(es, r, abort, m);
 }
 
 std::pair<DepthImage, NormalImage> render(
@@ -15,6 +15,12 @@ Octree::Octree(Evaluator* e, const Subregion& r)
     finalize(e);
 }
 
+Octree::Octree(Evaluator* e, const Subregion& r, Interval i, Result::Index lane)
+    : XTree(e, r, i, lane)
+{
+    finalize(e);
+}
+
 Octree::Octree(Evaluator* e, const std::array<Octree*, 8>& cs,
        const Subregion& r)
     : XTree(cs, r)
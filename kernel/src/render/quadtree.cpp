@@ -16,6 +16,12 @@ Quadtree::Quadtree(Evaluator* e, const Subregion& r)
     finalize(e);
 }
 
+Quadtree::Quadtree(Evaluator* e, const Subregion& r, Interval i, Result::Index lane)
+    : XTree(e, r, i, lane)
+{
+    finalize(e);
+}
+
 Quadtree::Quadtree(Evaluator* e, const std::array<Quadtree*, 4>& cs,
        const Subregion& r)
     : XTree(cs, r)
@@ -3,6 +3,7 @@
 #include "kernel/solve/solver.hpp"
 #include "kernel/tree/tree.hpp"
 #include "kernel/eval/evaluator.hpp"
+#include "kernel/eval/pool.hpp"
 
 namespace Kernel {
 
@@ -86,8 +87,8 @@ std::pair<float, Solution> findRoot(
         const Tree& t, const std::map<Tree::Id, float>& vars,
         const glm::vec3 pos, const Mask& mask, unsigned gas)
 {
-    Evaluator e(t, vars);
-    return findRoot(e, pos, mask, gas);
+    auto e = EvaluatorPool::instance().checkout(t, vars);
+    return findRoot(*e, pos, mask, gas);
 }
 
 std::pair<float, Solution> findRoot(
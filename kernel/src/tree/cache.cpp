@@ -45,6 +45,7 @@ Cache::Node Cache::operation(Opcode::Opcode op, Cache::Node lhs,
     {
 #define CHECK_RETURN(func) { auto t = func(op, lhs, rhs); if (t.get() != nullptr) { return t; }}
         CHECK_RETURN(checkIdentity);
+        CHECK_RETURN(checkRewrite);
         CHECK_RETURN(checkCommutative);
     }
 
@@ -194,6 +195,30 @@ Cache::Node Cache::checkIdentity(Opcode::Opcode op, Cache::Node a, Cache::Node b
     return Node();
 }
 
+Cache::Node Cache::checkRewrite(Opcode::Opcode op, Cache::Node a, Cache::Node b)
+{
+    if (Opcode::args(op) == 0)
+    {
+        return Node();
+    }
+
+    // 1 / X becomes recip(X)
+    if (op == Opcode::DIV && a->op == Opcode::CONST && a->value == 1)
+    {
+        return operation(Opcode::RECIP, b);
+    }
+    // recip(sqrt(X)) becomes rsqrt(X)
+    else if (op == Opcode::RECIP && a->op == Opcode::SQRT)
+    {
+        return operation(Opcode::RSQRT, a->lhs);
+    }
+
+    // max(X, -X) (which is what abs() builds) is deliberately left alone:
+    // unlike an ABS clause, it's a min / max, so features (and isInside)
+    // can see both sides of its crease
+    return Node();
+}
+
 Cache::Node Cache::checkCommutative(Opcode::Opcode op, Cache::Node a, Cache::Node b)
 {
     if (Opcode::isCommutative(op))
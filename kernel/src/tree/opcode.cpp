@@ -25,6 +25,9 @@ size_t Opcode::args(Opcode op)
         case ACOS:
         case ATAN:
         case EXP:
+        case ABS:
+        case RECIP:
+        case RSQRT:
         case CONST_VAR:
             return 1;
 
@@ -81,6 +84,9 @@ std::string Opcode::to_str(Opcode op)
         case Opcode::ACOS: return "acos";
         case Opcode::ATAN: return "atan";
         case Opcode::EXP: return "exp";
+        case Opcode::ABS: return "abs";
+        case Opcode::RECIP: return "recip";
+        case Opcode::RSQRT: return "rsqrt";
     }
     assert(false); /* All enumeration values must be handled */
     return "";
@@ -121,6 +127,9 @@ bool Opcode::isCommutative(Opcode op)
         case ACOS:
         case ATAN:
         case EXP:
+        case ABS:
+        case RECIP:
+        case RSQRT:
         case SUB:
         case DIV:
         case ATAN2:
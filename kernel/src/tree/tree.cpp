@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <set>
 #include <list>
+#include <vector>
 #include <cmath>
 #include <cassert>
 
@@ -90,6 +91,46 @@ std::list<Tree> Tree::ordered() const
     return out;
 }
 
+std::list<Tree> Tree::postorder() const
+{
+    return postorder([](Id){ return false; });
+}
+
+std::list<Tree> Tree::postorder(std::function<bool(Id)> skip) const
+{
+    std::set<Id> found = {nullptr};
+
+    // Each node is pushed twice: first to expand its children,
+    // then (once they've been handled) to add it to the output
+    std::vector<std::pair<std::shared_ptr<Tree_>, bool>> todo = {{ptr, false}};
+
+    std::list<Tree> out;
+    while (todo.size())
+    {
+        auto t = todo.back();
+        todo.pop_back();
+
+        if (t.second)
+        {
+            out.push_back(Tree(t.first));
+        }
+        else if (!skip(t.first.get()) && found.insert(t.first.get()).second)
+        {
+            todo.push_back({t.first, true});
+
+            auto a = t.first->lhs;
+            auto b = t.first->rhs;
+            if (a && b && b->rank > a->rank)
+            {
+                std::swap(a, b);
+            }
+            todo.push_back({b, false});
+            todo.push_back({a, false});
+        }
+    }
+    return out;
+}
+
 Tree Tree::remap(Tree X_, Tree Y_, Tree Z_) const
 {
     std::map<Tree::Id, std::shared_ptr<Tree_>> m = {
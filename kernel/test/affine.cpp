@@ -0,0 +1,260 @@
+#include <random>
+
+#include <catch/catch.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "kernel/eval/affine.hpp"
+#include "kernel/eval/evaluator.hpp"
+#include "kernel/render/heightmap.hpp"
+
+#include "util/shapes.hpp"
+
+using namespace Kernel;
+
+TEST_CASE("Affine arithmetic")
+{
+    const std::array<Interval, 3> box = {{{-1, 1}, {2, 4}, {0, 0.5}}};
+    auto x = Affine::transform(box, 1, 0, 0, 0);
+    auto y = Affine::transform(box, 0, 1, 0, 0);
+
+    SECTION("Axes")
+    {
+        REQUIRE(x.bounds().lower() <= -1);
+        REQUIRE(x.bounds().lower() == Approx(-1));
+        REQUIRE(x.bounds().upper() >= 1);
+        REQUIRE(x.bounds().upper() == Approx(1));
+        REQUIRE(y.bounds().lower() <= 2);
+        REQUIRE(y.bounds().lower() == Approx(2));
+        REQUIRE(y.bounds().upper() >= 4);
+        REQUIRE(y.bounds().upper() == Approx(4));
+    }
+
+    SECTION("Correlated values cancel")
+    {
+        // The bounds are only padded by a margin for rounding error
+        auto d = (x + y) - (y + x);
+        REQUIRE(d.bounds().lower() <= 0);
+        REQUIRE(d.bounds().lower() > -1e-6);
+        REQUIRE(d.bounds().upper() >= 0);
+        REQUIRE(d.bounds().upper() < 1e-6);
+    }
+
+    SECTION("Rotation")
+    {
+        // The x coordinate of a box rotated by 45 degrees, then rotated back
+        const float c = sqrt(0.5);
+        auto u = Affine::transform(box, c, -c, 0, 0);
+        auto v = Affine::transform(box, c, c, 0, 0);
+        auto back = Affine(c) * u + Affine(c) * v;
+        REQUIRE(back.bounds().lower() == Approx(-1));
+        REQUIRE(back.bounds().upper() == Approx(1));
+        REQUIRE(back.bounds().lower() <= -1);
+        REQUIRE(back.bounds().upper() >= 1);
+    }
+
+    SECTION("Square")
+    {
+        auto s = square(x).bounds();
+        REQUIRE(s.lower() <= 0);
+        REQUIRE(s.upper() >= 1);
+        REQUIRE(s.upper() == Approx(1));
+    }
+
+    SECTION("Whole")
+    {
+        auto w = Affine::fromInterval(Interval::whole());
+        REQUIRE(w.bounds().lower() == -INFINITY);
+        REQUIRE(w.bounds().upper() == INFINITY);
+        REQUIRE((w * x).bounds().upper() == INFINITY);
+    }
+
+    SECTION("Bounds contain every sample")
+    {
+        std::mt19937 gen(1);
+        std::uniform_real_distribution<float> dist(-1, 1);
+        for (unsigned i=0; i < 1000; ++i)
+        {
+            // Pick a random box and a random point within it
+            std::array<float, 3> lo, hi, p;
+            std::array<Interval, 3> b;
+            for (unsigned j=0; j < 3; ++j)
+            {
+                lo[j] = dist(gen) * 10;
+                hi[j] = lo[j] + std::abs(dist(gen));
+                p[j] = lo[j] + (hi[j] - lo[j]) * (dist(gen) + 1) / 2;
+                b[j] = Interval(lo[j], hi[j]);
+            }
+
+            auto ax = Affine::transform(b, 0.3f, 0.7f, -0.2f, 1);
+            auto ay = Affine::transform(b, -0.7f, 0.3f, 0.1f, 0);
+            auto f = square(ax) * ay - ax * Affine(3) + square(ax - ay);
+
+            const float px = 0.3f * p[0] + 0.7f * p[1] - 0.2f * p[2] + 1;
+            const float py = -0.7f * p[0] + 0.3f * p[1] + 0.1f * p[2];
+            const float pf = px * px * py - px * 3 + (px - py) * (px - py);
+
+            // Allow for float error in computing the sample itself
+            auto bounds = f.bounds();
+            CAPTURE(bounds.lower());
+            CAPTURE(bounds.upper());
+            CAPTURE(pf);
+            REQUIRE(bounds.lower() <= pf + std::abs(pf) * 1e-5);
+            REQUIRE(bounds.upper() >= pf - std::abs(pf) * 1e-5);
+        }
+    }
+}
+
+TEST_CASE("Affine interval mode")
+{
+    SECTION("Tighter than interval arithmetic")
+    {
+        Evaluator e((Tree::X() + Tree::Y()) - (Tree::Y() + Tree::X()));
+        auto i = e.eval({-1, 1}, {-1, 1}, {-1, 1});
+        REQUIRE(i.lower() == -4);
+        REQUIRE(i.upper() == 4);
+
+        e.setIntervalMode(Evaluator::AFFINE_ARITHMETIC);
+        auto a = e.eval({-1, 1}, {-1, 1}, {-1, 1});
+        REQUIRE(a.lower() <= 0);
+        REQUIRE(a.lower() > -1e-6);
+        REQUIRE(a.upper() >= 0);
+        REQUIRE(a.upper() < 1e-6);
+    }
+
+    SECTION("Rotated coordinates")
+    {
+        // A square that's rotated in the tree, then rotated back by the
+        // evaluator's matrix, evaluated over a box that's outside of it.
+        // Interval arithmetic loses track of the two rotations cancelling.
+        auto M = glm::rotate(glm::mat4(), float(M_PI/4), {0, 0, 1});
+        Evaluator e(rectangle(-1, 1, -1, 1, M), glm::inverse(M));
+        auto i = e.eval({1.1, 1.3}, {-0.2, 0.2}, {0, 0});
+        REQUIRE(i.lower() < 0);
+
+        e.setIntervalMode(Evaluator::AFFINE_ARITHMETIC);
+        auto a = e.eval({1.1, 1.3}, {-0.2, 0.2}, {0, 0});
+        REQUIRE(a.lower() > 0);
+    }
+
+    SECTION("Never looser than interval arithmetic")
+    {
+        Evaluator e(sqrt(square(Tree::X()) + 1) * Tree::Y() / (Tree::Z() + 3));
+        auto i = e.eval({-1, 2}, {1, 3}, {0, 1});
+
+        e.setIntervalMode(Evaluator::AFFINE_ARITHMETIC);
+        auto a = e.eval({-1, 2}, {1, 3}, {0, 1});
+        REQUIRE(a.lower() >= i.lower());
+        REQUIRE(a.upper() <= i.upper());
+    }
+
+    SECTION("Batched lanes")
+    {
+        auto M = glm::rotate(glm::mat4(), float(M_PI/6), {0, 0, 1});
+        Evaluator e(min(rectangle(-1, 1, -1, 1), circle(0.5)), M);
+        e.setIntervalMode(Evaluator::AFFINE_ARITHMETIC);
+
+        std::vector<Interval> expected;
+        for (unsigned i=0; i < 4; ++i)
+        {
+            expected.push_back(e.eval({i - 2.0f, i - 1.5f}, {0, 0.5}, {0, 0}));
+            e.set({i - 2.0f, i - 1.5f}, {0, 0.5}, {0, 0}, i + 1);
+        }
+
+        auto out = e.intervals(4, 1);
+        for (unsigned i=0; i < 4; ++i)
+        {
+            REQUIRE(out.lower[i + 1] == expected[i].lower());
+            REQUIRE(out.upper[i + 1] == expected[i].upper());
+        }
+
+        // Pushing into a lane uses its affine bounds
+        e.push(4);
+        REQUIRE(e.utilization() < 1);
+        e.pop();
+    }
+
+    SECTION("Counts")
+    {
+        Evaluator e(circle(1));
+        e.eval({-1, 1}, {-1, 1}, {0, 0});
+        e.set({-1, 0}, {-1, 1}, {0, 0}, 0);
+        e.set({0, 1}, {-1, 1}, {0, 0}, 1);
+        e.intervals(2);
+        e.values(10);
+        e.derivs(5);
+        REQUIRE(e.getCounts().intervals == 3);
+        REQUIRE(e.getCounts().points == 15);
+
+        e.resetCounts();
+        REQUIRE(e.getCounts().intervals == 0);
+        REQUIRE(e.getCounts().points == 0);
+    }
+}
+
+TEST_CASE("Affine arithmetic subdivision savings")
+{
+    struct Shape {
+        std::string name;
+        Tree tree;
+        glm::mat4 M;
+        float size;
+
+        /*  Whether the tree's coordinates are a composition of rotations,
+         *  which interval arithmetic can't bound tightly  */
+        bool composed;
+    };
+
+    const auto rot = glm::rotate(
+            glm::rotate(glm::mat4(), float(M_PI/4), {0, 1, 0}),
+            float(atan(1/sqrt(2))), {1, 0, 0});
+    const auto rz = glm::rotate(glm::mat4(), float(M_PI/6), {0, 0, 1});
+
+    // Rotates a tree about the Z axis (in the tree itself)
+    auto spin = [](Tree t, float a) {
+        return t.remap(cos(a) * Tree::X() + sin(a) * Tree::Y(),
+                       cos(a) * Tree::Y() - sin(a) * Tree::X(), Tree::Z());
+    };
+
+    std::vector<Shape> shapes = {
+        {"circle", circle(1), glm::mat4(), 1.5, false},
+        {"sphere", sphere(1), glm::mat4(), 1.5, false},
+        {"rotated rectangle", rectangle(-1, 1, -0.5, 0.5, rz), rot, 1.5, true},
+        {"rotated menger(1)", menger(1), rot, 2.5, false},
+        {"rotated menger(2)", menger(2), rot, 2.5, false},
+        {"twice-rotated menger(1)", spin(menger(1), M_PI/5), rot, 2.5, true},
+    };
+
+    std::string log;
+    for (auto& s : shapes)
+    {
+        Region r({-s.size, s.size}, {-s.size, s.size}, {-s.size, s.size}, 64);
+        std::atomic_bool abort(false);
+
+        std::array<Evaluator::Counts, 2> counts;
+        std::array<DepthImage, 2> depth;
+        for (auto mode : {Evaluator::INTERVAL_ARITHMETIC,
+                          Evaluator::AFFINE_ARITHMETIC})
+        {
+            Evaluator e(s.tree);
+            e.setIntervalMode(mode);
+            depth[mode] = Heightmap::render({&e}, r, abort, s.M).first;
+            counts[mode] = e.getCounts();
+        }
+
+        log += s.name + ": " +
+            std::to_string(counts[0].intervals) + " -> " +
+            std::to_string(counts[1].intervals) + " interval evaluations, " +
+            std::to_string(counts[0].points) + " -> " +
+            std::to_string(counts[1].points) + " point evaluations\n";
+
+        CAPTURE(s.name);
+        REQUIRE((depth[0] == depth[1]).all());
+        REQUIRE(counts[1].intervals <= counts[0].intervals);
+        REQUIRE(counts[1].points <= counts[0].points);
+        if (s.composed)
+        {
+            REQUIRE(counts[1].intervals < counts[0].intervals);
+        }
+    }
+    WARN(log);
+}
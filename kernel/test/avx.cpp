@@ -1,26 +1,39 @@
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <catch/catch.hpp>
 
 #include "kernel/tree/tree.hpp"
 #include "kernel/eval/evaluator_base.hpp"
-#include "kernel/eval/evaluator_avx.hpp"
+#include "kernel/eval/backend.hpp"
 #include "kernel/eval/result.hpp"
 
 #include "util/shapes.hpp"
 
 using namespace Kernel;
 
-#ifdef __AVX__
+static std::chrono::duration<double> timeValues(EvaluatorBase& e, int n)
+{
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    start = std::chrono::system_clock::now();
+    for (int i=0; i < n; ++i)
+    {
+        e.values(Result::N);
+    }
+    end = std::chrono::system_clock::now();
+    return end - start;
+}
 
-TEST_CASE("Vectorized performance")
+static void checkPerformance(Tree t, const Backend& b)
 {
     // Oversample to get meaningful result
-    const float N = 100;
+    const int N = 100;
 
-    Tree t = menger(3);
     EvaluatorBase e(t);
-    EvaluatorAVX ea(t);
+    EvaluatorBase ea(t);
+    e.setBackend(Backend::scalar());
+    ea.setBackend(b);
 
     for (unsigned i=0; i < Result::N; ++i)
     {
@@ -30,24 +43,10 @@ TEST_CASE("Vectorized performance")
 
     SECTION("Speed")
     {
-        std::chrono::time_point<std::chrono::system_clock> start, end;
-        start = std::chrono::system_clock::now();
-        for (int i=0; i < N; ++i)
-        {
-            e.values(Result::N);
-        }
-        end = std::chrono::system_clock::now();
-        std::chrono::duration<double> ft = end - start;
-
-        start = std::chrono::system_clock::now();
-        for (int i=0; i < N; ++i)
-        {
-            ea.values(Result::N);
-        }
-        end = std::chrono::system_clock::now();
-        std::chrono::duration<double> mt = end - start;
+        auto ft = timeValues(e, N);
+        auto mt = timeValues(ea, N);
 
-        // Theoretically, vectorized performance is up to 8x faster
+        // Theoretically, vectorized performance scales with b.width
         // We'll insist on at least a 2x speedup
         REQUIRE(mt.count() < ft.count()/2);
     }
@@ -76,6 +75,149 @@ TEST_CASE("Vectorized performance")
     }
 }
 
+TEST_CASE("Vectorized performance")
+{
+    Tree t = menger(3);
+
+    for (auto b : Backend::available())
+    {
+        if (b != &Backend::scalar())
+        {
+            SECTION(b->name)
+            {
+                checkPerformance(t, *b);
+            }
+        }
+    }
+}
+
+/*
+ *  Checks that the vectorized and scalar results match, to within a
+ *  relative tolerance (or an absolute tolerance for small values)
+ */
+static bool nearlyEqual(float a, float b, float tol)
+{
+    if (std::isnan(a) || std::isnan(b))
+    {
+        return std::isnan(a) && std::isnan(b);
+    }
+    else if (std::isinf(a) || std::isinf(b))
+    {
+        return a == b;
+    }
+    return fabs(a - b) <= tol * fmax(1, fabs(a));
+}
+
+static void checkOpcode(Tree t, const Backend& b, float lo, float hi,
+                        float vtol=1e-5, float dtol=1e-4)
+{
+    EvaluatorBase e(t);
+    EvaluatorBase ea(t);
+    e.setBackend(Backend::scalar());
+    ea.setBackend(b);
+
+    // Sweep around a circle of increasing radius, so that
+    // two-argument functions see every quadrant
+    for (unsigned i=0; i < Result::N; ++i)
+    {
+        float r = lo + (hi - lo) * i / (Result::N - 1.0f);
+        float x = r;
+        float y = r * cos(i * 0.37f) + 0.5f;
+        e.set(x, y, 0, i);
+        ea.set(x, y, 0, i);
+    }
+
+    auto d = e.derivs(Result::N);
+    auto da = ea.derivs(Result::N);
+
+    for (unsigned i=0; i < Result::N; ++i)
+    {
+        CAPTURE(i);
+        CAPTURE(d.v[i]);
+        CAPTURE(da.v[i]);
+        CAPTURE(d.dx[i]);
+        CAPTURE(da.dx[i]);
+        CAPTURE(d.dy[i]);
+        CAPTURE(da.dy[i]);
+        REQUIRE(nearlyEqual(d.v[i], da.v[i], vtol));
+        REQUIRE(nearlyEqual(d.dx[i], da.dx[i], dtol));
+        REQUIRE(nearlyEqual(d.dy[i], da.dy[i], dtol));
+        REQUIRE(nearlyEqual(d.dz[i], da.dz[i], dtol));
+    }
+}
+
+static void checkTranscendentals(const Backend& b)
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+
+    SECTION("sin")
+    {
+        checkOpcode(Tree(Opcode::SIN, x), b, -100, 100);
+    }
+    SECTION("cos")
+    {
+        checkOpcode(Tree(Opcode::COS, x), b, -100, 100);
+    }
+    SECTION("tan")
+    {
+        checkOpcode(Tree(Opcode::TAN, x), b, -1.4, 1.4);
+    }
+    SECTION("asin")
+    {
+        checkOpcode(Tree(Opcode::ASIN, x), b, -0.99, 0.99);
+    }
+    SECTION("acos")
+    {
+        checkOpcode(Tree(Opcode::ACOS, x), b, -0.99, 0.99);
+    }
+    SECTION("atan")
+    {
+        checkOpcode(Tree(Opcode::ATAN, x), b, -50, 50);
+    }
+    SECTION("atan2")
+    {
+        checkOpcode(Tree(Opcode::ATAN2, y, x), b, -10, 10);
+    }
+    SECTION("exp")
+    {
+        checkOpcode(Tree(Opcode::EXP, x), b, -20, 20);
+    }
+    SECTION("pow")
+    {
+        checkOpcode(Tree(Opcode::POW, x, Tree(3)), b, -5, 5);
+        checkOpcode(Tree(Opcode::POW, x, Tree(4)), b, -5, 5);
+        checkOpcode(Tree(Opcode::POW, x, Tree(-2)), b, 0.1, 5);
+    }
+    SECTION("nth-root")
+    {
+        checkOpcode(Tree(Opcode::NTH_ROOT, x, Tree(3)), b, 0.01, 10);
+    }
+    SECTION("mod")
+    {
+        checkOpcode(Tree(Opcode::MOD, x, Tree(1.3)), b, -5, 5);
+    }
+    SECTION("nanfill")
+    {
+        checkOpcode(Tree(Opcode::NANFILL,
+                         Tree(Opcode::SQRT, x), y), b, -5, 5);
+    }
+}
+
+TEST_CASE("Vectorized transcendental accuracy")
+{
+    for (auto b : Backend::available())
+    {
+        if (b != &Backend::scalar())
+        {
+            SECTION(b->name)
+            {
+                checkTranscendentals(*b);
+            }
+        }
+    }
+}
+
 TEST_CASE("Alignment")
 {
     // Make sure that struct padding works like I think it works
@@ -83,17 +225,56 @@ TEST_CASE("Alignment")
              Result result; } s;
     s.result.resize(2);
 
-    // Check the alignment of the first two members of value array
-    REQUIRE(((intptr_t)(&s.result.mf[0]) & 0x1f) == 0);
-    REQUIRE(((intptr_t)(&s.result.mf[1]) & 0x1f) == 0);
-
-    // Check the derivative arrays too
-    REQUIRE(((intptr_t)(&s.result.mdx[0]) & 0x1f) == 0);
-    REQUIRE(((intptr_t)(&s.result.mdx[1]) & 0x1f) == 0);
-    REQUIRE(((intptr_t)(&s.result.mdy[0]) & 0x1f) == 0);
-    REQUIRE(((intptr_t)(&s.result.mdy[1]) & 0x1f) == 0);
-    REQUIRE(((intptr_t)(&s.result.mdz[0]) & 0x1f) == 0);
-    REQUIRE(((intptr_t)(&s.result.mdz[1]) & 0x1f) == 0);
+    // Check the alignment of the first two rows of the value array,
+    // which must be suitable for the widest (64-byte) vector type
+    REQUIRE(((intptr_t)(&s.result.f[0]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.f[1]) & 0x3f) == 0);
+
+    // Check the derivative arrays too (which are allocated on demand)
+    s.result.resizeDerivs();
+    REQUIRE(((intptr_t)(&s.result.dx[0]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.dx[1]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.dy[0]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.dy[1]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.dz[0]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.dz[1]) & 0x3f) == 0);
+
+    // And the batched interval arrays (also allocated on demand)
+    s.result.resizeIntervals();
+    REQUIRE(((intptr_t)(&s.result.lower[0]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.lower[1]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.upper[0]) & 0x3f) == 0);
+    REQUIRE(((intptr_t)(&s.result.upper[1]) & 0x3f) == 0);
 }
 
-#endif
+TEST_CASE("Backend selection")
+{
+    auto available = Backend::available();
+    REQUIRE(available.size() >= 1);
+    REQUIRE(available.back() == &Backend::scalar());
+
+    // The default backend is the widest one, unless overridden
+    const Backend& prev = Backend::active();
+    if (!getenv("STRAYLIGHT_BACKEND"))
+    {
+        REQUIRE(&prev == available.front());
+    }
+
+    SECTION("Selecting by name")
+    {
+        REQUIRE(Backend::select("scalar"));
+        REQUIRE(&Backend::active() == &Backend::scalar());
+
+        EvaluatorBase e(Tree::X());
+        REQUIRE(&e.getBackend() == &Backend::scalar());
+    }
+
+    SECTION("Invalid name")
+    {
+        REQUIRE(!Backend::select("not-a-backend"));
+        REQUIRE(&Backend::active() == &prev);
+        REQUIRE(Backend::find("not-a-backend") == nullptr);
+    }
+
+    Backend::select(prev.name);
+}
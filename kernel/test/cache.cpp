@@ -102,6 +102,44 @@ TEST_CASE("Cache::var")
     REQUIRE(a != b);
 }
 
+TEST_CASE("Cache::checkRewrite")
+{
+    auto t = Cache::instance();
+
+    SECTION("Reciprocal")
+    {
+        auto a = t->operation(Opcode::DIV, t->constant(1), t->X());
+        REQUIRE(a->op == Opcode::RECIP);
+        REQUIRE(a->lhs == t->X());
+
+        auto b = t->operation(Opcode::DIV, t->constant(2), t->X());
+        REQUIRE(b->op == Opcode::DIV);
+    }
+
+    SECTION("Reciprocal square root")
+    {
+        auto a = t->operation(Opcode::DIV, t->constant(1),
+                              t->operation(Opcode::SQRT, t->X()));
+        REQUIRE(a->op == Opcode::RSQRT);
+        REQUIRE(a->lhs == t->X());
+    }
+
+    SECTION("Absolute value")
+    {
+        // max(X, -X) stays as-is, since features need to see its branches
+        auto a = t->operation(Opcode::MAX, t->X(),
+                              t->operation(Opcode::NEG, t->X()));
+        REQUIRE(a->op == Opcode::MAX);
+    }
+
+    SECTION("Constants")
+    {
+        auto a = t->operation(Opcode::DIV, t->constant(1), t->constant(4));
+        REQUIRE(a->op == Opcode::CONST);
+        REQUIRE(a->value == 0.25);
+    }
+}
+
 TEST_CASE("Cache::checkCommutative")
 {
     auto t = Cache::instance();
@@ -1,4 +1,8 @@
 #include <catch/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <future>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include "kernel/tree/tree.hpp"
@@ -80,6 +84,81 @@ TEST_CASE("Evaluator::gradient")
         REQUIRE(g.at(b.id()) == Approx(2.0f));
         REQUIRE(g.at(c.id()) == Approx(3.0f));
     }
+
+    SECTION("Shared subexpressions")
+    {
+        // Each variable is read by several clauses (and through both
+        // branches of a min), so adjoints have to be summed
+        std::map<Tree::Id, float> vars;
+        std::vector<Tree> vs;
+        Tree t = Tree::X();
+        for (int i=0; i < 200; ++i)
+        {
+            vs.push_back(Tree::var());
+            vars[vs.back().id()] = i * 0.01;
+            t = t + vs.back() * vs.back() * (i % 3) +
+                min(vs.back(), Tree::Y()) * 2;
+        }
+        Evaluator e(t, vars);
+
+        auto g = e.gradient(0, 1, 0);
+        REQUIRE(g.size() == vs.size());
+        for (int i=0; i < 200; ++i)
+        {
+            CAPTURE(i);
+            const float v = i * 0.01;
+            REQUIRE(g.at(vs[i].id()) ==
+                    Approx(2 * v * (i % 3) + (v < 1 ? 2 : 0)));
+        }
+    }
+}
+
+TEST_CASE("Evaluator::gradients")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto a = Tree::var();
+    auto b = Tree::var();
+    auto c = Tree::var();
+    auto unused = Tree::var();
+
+    // This covers every branch of min, plus a transcendental and
+    // a clause that reads the same argument twice
+    auto t = min(a * x + Tree(Opcode::SIN, b * y), c * c - x) + a * a;
+    const std::map<Tree::Id, float> vars =
+        {{a.id(), 0.5}, {b.id(), -1.5}, {c.id(), 2}};
+    const std::vector<Tree::Id> ids = {c.id(), unused.id(), a.id(), b.id()};
+
+    const Result::Index count = 37;
+    auto pos = [](Result::Index i, int axis)
+        { return -2 + 0.11f * ((i * (axis + 3)) % count); };
+
+    for (auto be : Backend::available())
+    {
+        SECTION(be->name)
+        {
+            Evaluator e(t, vars);
+            e.setBackend(*be);
+            for (Result::Index i=0; i < count; ++i)
+            {
+                e.set(pos(i, 0), pos(i, 1), 0, i);
+            }
+            std::vector<float> out(ids.size() * count);
+            e.gradients(ids, count, out.data());
+
+            Evaluator ref(t, vars);
+            ref.setBackend(Backend::scalar());
+            for (Result::Index i=0; i < count; ++i)
+            {
+                CAPTURE(i);
+                auto g = ref.gradient(pos(i, 0), pos(i, 1), 0);
+                REQUIRE(out[0 * count + i] == Approx(g.at(c.id())));
+                REQUIRE(out[1 * count + i] == 0);
+                REQUIRE(out[2 * count + i] == Approx(g.at(a.id())));
+                REQUIRE(out[3 * count + i] == Approx(g.at(b.id())));
+            }
+        }
+    }
 }
 
 TEST_CASE("Evaluator copy-constructor")
@@ -100,6 +179,161 @@ TEST_CASE("Evaluator copy-constructor")
     REQUIRE(g.at(c.id()) == Approx(3.0f));
 }
 
+TEST_CASE("Evaluators sharing a Program")
+{
+    auto a = Tree::var();
+    auto t = min(sphere(0.5), Tree(Opcode::SQRT, Tree::X() * a + Tree::Y()));
+    auto p = std::make_shared<Program>(t);
+
+    // Each thread gets its own Evaluator, with its own variable value
+    std::vector<std::future<float>> futures;
+    for (int i=0; i < 8; ++i)
+    {
+        futures.push_back(std::async(std::launch::async, [=]()
+        {
+            Evaluator e(p, {{a.id(), float(i)}});
+
+            float out = 0;
+            for (int j=0; j < 100; ++j)
+            {
+                e.eval(Interval(-1, 1), Interval(0, 1), Interval(0, 1));
+                e.push();
+                out = e.eval(1, 2, 0);
+                e.pop();
+            }
+            return out;
+        }));
+    }
+
+    for (int i=0; i < 8; ++i)
+    {
+        Evaluator e(t, {{a.id(), float(i)}});
+        REQUIRE(futures[i].get() == e.eval(1, 2, 0));
+    }
+
+    Evaluator e(p, {{a.id(), 0}});
+    REQUIRE(e.getProgram() == p);
+}
+
+TEST_CASE("Multiple outputs")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    // Every shape shares the sphere, and the second shape is
+    // also an argument to the third
+    auto s = sphere(1);
+    auto a = s + x * y;
+    auto b = max(s, z - 0.5);
+    auto c = min(b * 2 + 3, x);
+    std::vector<Tree> shapes = {a, b, c, Tree(3.0f), x};
+
+    Evaluator e(shapes);
+    REQUIRE(e.outputs() == 5);
+
+    // Shared clauses are only in the tape once
+    size_t total = 0;
+    for (auto t : shapes)
+    {
+        total += Program(t).size();
+    }
+    REQUIRE(e.getProgram()->size() < total);
+
+    SECTION("Values")
+    {
+        for (unsigned i=0; i < 10; ++i)
+        {
+            e.set(-1 + 0.2 * i, 0.3 * i, 0.5 - 0.1 * i, i);
+        }
+        auto v = e.values(10);
+        REQUIRE(v == e.valuesOf(0));
+        for (unsigned k=0; k < shapes.size(); ++k)
+        {
+            Evaluator ref(shapes[k]);
+            for (unsigned i=0; i < 10; ++i)
+            {
+                CAPTURE(k);
+                CAPTURE(i);
+                REQUIRE(e.valuesOf(k)[i] ==
+                        ref.eval(-1 + 0.2 * i, 0.3 * i, 0.5 - 0.1 * i));
+            }
+        }
+    }
+
+    SECTION("Derivatives")
+    {
+        auto M = glm::rotate(glm::mat4(), float(M_PI/4), {0, 0, 1});
+        e.setMatrix(M);
+        e.set(0.3, 0.4, 0.5, 0);
+        e.derivs(1);
+        for (unsigned k=0; k < shapes.size(); ++k)
+        {
+            Evaluator ref(shapes[k], M);
+            ref.set(0.3, 0.4, 0.5, 0);
+            auto d = ref.derivs(1);
+            auto o = e.derivsOf(k);
+            CAPTURE(k);
+            REQUIRE(o.v[0] == Approx(d.v[0]));
+            REQUIRE(o.dx[0] == Approx(d.dx[0]));
+            REQUIRE(o.dy[0] == Approx(d.dy[0]));
+            REQUIRE(o.dz[0] == Approx(d.dz[0]));
+        }
+    }
+
+    SECTION("Intervals")
+    {
+        e.eval(Interval(0.1, 0.2), Interval(0.1, 0.2), Interval(2, 3));
+        for (unsigned k=0; k < shapes.size(); ++k)
+        {
+            Evaluator ref(shapes[k]);
+            auto i = ref.eval(Interval(0.1, 0.2), Interval(0.1, 0.2),
+                              Interval(2, 3));
+            CAPTURE(k);
+            REQUIRE(e.intervalOf(k).lower() == i.lower());
+            REQUIRE(e.intervalOf(k).upper() == i.upper());
+        }
+
+        e.set(Interval(0.1, 0.2), Interval(0.1, 0.2), Interval(2, 3), 1);
+        e.intervals(1, 1);
+        REQUIRE(e.intervalsOf(2).lower[1] == e.intervalOf(2).lower());
+        REQUIRE(e.intervalsOf(2).upper[1] == e.intervalOf(2).upper());
+    }
+
+    SECTION("Push")
+    {
+        auto check = [&](std::vector<unsigned> outputs)
+        {
+            e.eval(0.15, 0.15, 2.5);
+            for (auto k : outputs)
+            {
+                CAPTURE(k);
+                REQUIRE(e.valuesOf(k)[0] ==
+                        Evaluator(shapes[k]).eval(0.15, 0.15, 2.5));
+            }
+        };
+
+        // Pruning is per-output: b resolves to z - 0.5
+        e.eval(Interval(0.1, 0.2), Interval(0.1, 0.2), Interval(2, 3));
+        e.push();
+        REQUIRE(e.utilization() < 1);
+        check({0, 1, 2, 3, 4});
+
+        // Dropping the first two outputs leaves b (for c),
+        // but not a or the sphere
+        const double u = e.utilization();
+        e.eval(Interval(0.1, 0.2), Interval(0.1, 0.2), Interval(2, 3));
+        e.push({false, false, true, true, true});
+        REQUIRE(e.utilization() < u);
+        check({2, 3, 4});
+        e.pop();
+
+        e.pop();
+        REQUIRE(e.utilization() == 1);
+        check({0, 1, 2, 3, 4});
+    }
+}
+
 TEST_CASE("Evaluator::setVar")
 {
     // Deliberately construct out of order
@@ -119,6 +353,55 @@ TEST_CASE("Evaluator::setVar")
     REQUIRE(e.eval(0, 0, 0) == Approx(35));
 }
 
+TEST_CASE("Location-agnostic prelude")
+{
+    auto v = Tree::var();
+    auto w = Tree::var();
+    auto t = Tree::X() * Tree(Opcode::COS, v) + Tree(Opcode::SIN, v) * w;
+
+    // Only the clauses that use X are in the tape
+    Evaluator e(t, {{v.id(), 0}, {w.id(), 2}});
+    REQUIRE(e.getProgram()->size() == 2);
+
+    auto check = [&](float vv, float ww)
+    {
+        CAPTURE(vv);
+        CAPTURE(ww);
+        const float x = 1.5;
+        REQUIRE(e.eval(x, 0, 0) == Approx(x * cos(vv) + sin(vv) * ww));
+
+        auto i = e.eval(Interval(1, 2), Interval(0, 0), Interval(0, 0));
+        REQUIRE(i.lower() == Approx(std::min(cos(vv), 2 * cos(vv)) +
+                                    sin(vv) * ww));
+        REQUIRE(i.upper() == Approx(std::max(cos(vv), 2 * cos(vv)) +
+                                    sin(vv) * ww));
+
+        e.set(x, 0, 0, 0);
+        REQUIRE(e.derivs(1).dx[0] == Approx(cos(vv)));
+
+        auto g = e.gradient(x, 0, 0);
+        REQUIRE(g.at(v.id()) == Approx(-x * sin(vv) + cos(vv) * ww));
+        REQUIRE(g.at(w.id()) == Approx(sin(vv)));
+    };
+    check(0, 2);
+
+    // The prelude is re-run whenever a variable changes
+    e.setVar(v.id(), 0.5);
+    check(0.5, 2);
+    e.updateVars({{v.id(), 1}, {w.id(), -3}});
+    check(1, -3);
+
+    SECTION("Trees with no location dependence")
+    {
+        Evaluator f(v * w, {{v.id(), 3}, {w.id(), 4}});
+        REQUIRE(f.getProgram()->size() == 0);
+        REQUIRE(f.eval(1, 2, 3) == 12);
+        f.setVar(w.id(), 5);
+        REQUIRE(f.eval(1, 2, 3) == 15);
+        REQUIRE(f.gradient(1, 2, 3).at(v.id()) == 5);
+    }
+}
+
 TEST_CASE("Evaluator::varValues")
 {
     // Deliberately construct out of order
@@ -139,6 +422,118 @@ TEST_CASE("Evaluator::varValues")
     }
 }
 
+TEST_CASE("Evaluator::setTree")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+    auto v = Tree::var();
+
+    // A big unchanged subtree, plus a small part that gets edited
+    Tree base = x;
+    for (int i=0; i < 20; ++i)
+    {
+        base = base * 0.5 + Tree(Opcode::SIN, y * i);
+    }
+    Evaluator e(min(base, sphere(1)) * v, {{v.id(), 2}});
+
+    auto check = [&](Tree t, const std::map<Tree::Id, float>& vars)
+    {
+        Evaluator ref(t, vars);
+        REQUIRE(e.getProgram()->size() == ref.getProgram()->size());
+        for (int i=0; i < 10; ++i)
+        {
+            const float p = -1 + 0.2 * i;
+            CAPTURE(i);
+            REQUIRE(e.eval(p, 0.5 * p, 0.3) == Approx(ref.eval(p, 0.5 * p, 0.3)));
+
+            auto a = e.eval(Interval(p, p + 0.1), Interval(0, 0.1),
+                            Interval(0.3, 0.4));
+            auto b = ref.eval(Interval(p, p + 0.1), Interval(0, 0.1),
+                              Interval(0.3, 0.4));
+            REQUIRE(a.lower() == b.lower());
+            REQUIRE(a.upper() == b.upper());
+        }
+
+        auto g = e.gradient(0.2, 0.3, 0.4);
+        auto h = ref.gradient(0.2, 0.3, 0.4);
+        REQUIRE(g.size() == h.size());
+        for (auto k : h)
+        {
+            REQUIRE(g.at(k.first) == Approx(k.second));
+        }
+
+        // Derivatives are seeded again after each edit
+        e.set(0.2, 0.3, 0.4, 0);
+        ref.set(0.2, 0.3, 0.4, 0);
+        auto d = e.derivs(1);
+        auto r = ref.derivs(1);
+        REQUIRE(d.dx[0] == Approx(r.dx[0]));
+        REQUIRE(d.dy[0] == Approx(r.dy[0]));
+        REQUIRE(d.dz[0] == Approx(r.dz[0]));
+
+        // Pushing still works
+        e.eval(Interval(-0.1, 0.1), Interval(-0.1, 0.1), Interval(0.2, 0.3));
+        e.push();
+        REQUIRE(e.eval(0, 0, 0.25) == Approx(ref.eval(0, 0, 0.25)));
+        e.pop();
+    };
+
+    SECTION("Editing a subtree")
+    {
+        // Variables keep their values
+        auto t = min(base, sphere(1.5)) * v;
+        e.setTree(t);
+        check(t, {{v.id(), 2}});
+
+        // New variables need values
+        auto w = Tree::var();
+        t = min(base, sphere(1.5) + w) * v;
+        e.setTree(t, {{w.id(), 0.25}});
+        check(t, {{v.id(), 2}, {w.id(), 0.25}});
+
+        // Removed variables are dropped
+        t = min(base, max(x, y) - 1) * 3;
+        e.setTree(t);
+        check(t, {});
+    }
+
+    SECTION("Many edits")
+    {
+        // This eventually renumbers the program from scratch
+        for (int i=0; i < 20; ++i)
+        {
+            auto t = min(base + i, sphere(1 + 0.1 * i) * v);
+            e.setTree(t, {{v.id(), float(i)}});
+            check(t, {{v.id(), float(i)}});
+        }
+    }
+
+    SECTION("Multiple trees")
+    {
+        std::vector<Tree> ts = {base, sphere(1), base * z};
+        e.setTrees(ts);
+        REQUIRE(e.outputs() == 3);
+        e.eval(0.3, 0.4, 0.5);
+        for (unsigned k=0; k < ts.size(); ++k)
+        {
+            REQUIRE(e.valuesOf(k)[0] == Approx(Evaluator(ts[k]).eval(0.3, 0.4, 0.5)));
+        }
+    }
+
+    SECTION("Shared programs")
+    {
+        Evaluator f(e.getProgram(), {{v.id(), 2}});
+        const float before = f.eval(0.3, 0.4, 0.5);
+
+        auto t = base * v;
+        e.setTree(t);
+        check(t, {{v.id(), 2}});
+        REQUIRE(e.getProgram() != f.getProgram());
+        REQUIRE(f.eval(0.3, 0.4, 0.5) == before);
+    }
+}
+
 TEST_CASE("Float evaluation")
 {
     SECTION("X + 1")
@@ -188,6 +583,758 @@ TEST_CASE("Push / pop behavior")
     REQUIRE(e.eval(1.0f, 2.0f, 0.0f) == 2);
 }
 
+TEST_CASE("Tape cache")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    Evaluator e(min(x + 1, y * 2));
+
+    // Pushes into a box, checking the result at its center
+    auto check = [&](Interval bx, Interval by)
+    {
+        e.eval(bx, by, Interval(0, 0));
+        e.push();
+        const float px = (bx.lower() + bx.upper()) / 2;
+        const float py = (by.lower() + by.upper()) / 2;
+        REQUIRE(e.eval(px, py, 0) == std::fmin(px + 1, py * 2));
+        e.pop();
+    };
+
+    SECTION("Hits")
+    {
+        check({-5, -4}, {8, 9});
+        REQUIRE(e.getCounts().tape_misses == 1);
+        REQUIRE(e.getCounts().tape_hits == 0);
+
+        // This box resolves the same branch, so it reuses the tape
+        check({-6, -5}, {7, 8});
+        REQUIRE(e.getCounts().tape_misses == 1);
+        REQUIRE(e.getCounts().tape_hits == 1);
+
+        // This one doesn't
+        check({8, 9}, {-5, -4});
+        REQUIRE(e.getCounts().tape_misses == 2);
+        REQUIRE(e.getCounts().tape_hits == 1);
+    }
+
+    SECTION("Nested")
+    {
+        // Nothing is resolved in the outer box
+        e.eval(Interval(-1, 1), Interval(-1, 1), Interval(0, 0));
+        e.push();
+        REQUIRE(e.utilization() == 1);
+
+        // Cached tapes are keyed by the tape that they were pushed from,
+        // so this doesn't reuse the tape from the root
+        check({-5, -4}, {8, 9});
+        check({0.5, 1}, {-1, -0.5});
+        check({0.6, 1}, {-1, -0.6});
+        REQUIRE(e.getCounts().tape_misses == 3);
+        REQUIRE(e.getCounts().tape_hits == 1);
+        e.pop();
+
+        e.eval(Interval(-1, 1), Interval(-1, 1), Interval(0, 0));
+        e.push();
+        check({-5, -4}, {8, 9});
+        REQUIRE(e.getCounts().tape_misses == 3);
+        REQUIRE(e.getCounts().tape_hits == 3);
+        e.pop();
+    }
+
+    SECTION("Disabled")
+    {
+        e.setTapeCacheSize(0);
+        check({-5, -4}, {8, 9});
+        check({-6, -5}, {7, 8});
+        REQUIRE(e.getCounts().tape_misses == 2);
+        REQUIRE(e.getCounts().tape_hits == 0);
+    }
+
+    SECTION("Eviction")
+    {
+        // Each pushed tape is one clause, so only one fits at a time
+        e.setTapeCacheSize(1);
+        check({-5, -4}, {8, 9});
+        check({8, 9}, {-5, -4});
+        check({-6, -5}, {7, 8});
+        REQUIRE(e.getCounts().tape_hits == 0);
+        check({-7, -6}, {7, 8});
+        REQUIRE(e.getCounts().tape_hits == 1);
+    }
+}
+
+TEST_CASE("Push performance")
+{
+    // A union of many spheres, which is pruned to a handful of clauses
+    // near any one of them
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+    Tree t(1e6);
+    for (int i=0; i < 1000; ++i)
+    {
+        const float cx = i % 10, cy = (i / 10) % 10, cz = i / 100;
+        t = min(t, sqrt(square(x - cx) + square(y - cy) + square(z - cz))
+                   - 0.3);
+    }
+    Evaluator e(t);
+    e.setTapeCacheSize(0);
+
+    // Push down towards the sphere at the origin, as in an octree
+    unsigned depth = 0;
+    for (float r=8; r > 0.1; r /= 2)
+    {
+        e.eval(Interval(-0.1, r), Interval(-0.1, r), Interval(-0.1, r));
+        e.push();
+        depth++;
+    }
+    REQUIRE(e.utilization() < 0.01);
+
+    // Then time repeated pushes at the bottom of the stack
+    const int n = 10000;
+    const auto start = std::chrono::system_clock::now();
+    for (int i=0; i < n; ++i)
+    {
+        e.eval(Interval(-0.1, 0.05), Interval(-0.1, 0.05), Interval(-0.1, 0.05));
+        e.push();
+        e.pop();
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::system_clock::now() - start;
+
+    REQUIRE(e.eval(0, 0, 0) == Approx(-0.3));
+    for (unsigned i=0; i < depth; ++i)
+    {
+        e.pop();
+    }
+    REQUIRE(e.eval(5, 5, 5) == Approx(-0.3));
+
+    std::string log = "\nPushed at depth " + std::to_string(depth) + " in " +
+           std::to_string(elapsed.count() / n * 1e6) + " us per push";
+    WARN(log);
+}
+
+TEST_CASE("Pushing chains of min / max")
+{
+    // Neither min here can be pruned by comparing its two branches,
+    // but X + 5 is never below X within the box, so it's dropped
+    auto x = Tree::X();
+    auto y = Tree::Y();
+
+    SECTION("min")
+    {
+        auto t = min(x, min(y, x + 5));
+        Evaluator e(t);
+        Evaluator ref(t);
+
+        e.eval(Interval(0, 1), Interval(0.5, 5.5), Interval(0, 0));
+        e.push();
+        CAPTURE(e.utilization());
+        REQUIRE(e.utilization() < 1);
+
+        for (float px : {0.0f, 0.25f, 0.5f, 1.0f})
+        {
+            for (float py : {0.5f, 0.75f, 2.0f, 5.5f})
+            {
+                REQUIRE(e.eval(px, py, 0) == ref.eval(px, py, 0));
+            }
+        }
+    }
+
+    SECTION("max")
+    {
+        auto t = max(x, max(y, x - 5));
+        Evaluator e(t);
+        Evaluator ref(t);
+
+        e.eval(Interval(0, 1), Interval(-4.5, 0.5), Interval(0, 0));
+        e.push();
+        CAPTURE(e.utilization());
+        REQUIRE(e.utilization() < 1);
+
+        for (float px : {0.0f, 0.25f, 0.5f, 1.0f})
+        {
+            for (float py : {-4.5f, -1.0f, 0.0f, 0.5f})
+            {
+                REQUIRE(e.eval(px, py, 0) == ref.eval(px, py, 0));
+            }
+        }
+    }
+
+    SECTION("Shared clauses")
+    {
+        // The inner min is also read by the multiplication, so it
+        // has to keep both branches
+        auto m = min(y, x + 5);
+        Evaluator e(min(x, m) + m * 2);
+
+        e.eval(Interval(0, 1), Interval(0.5, 5.5), Interval(0, 0));
+        e.push();
+        REQUIRE(e.eval(0.5, 5.5, 0) == 0.5 + 11);
+    }
+}
+
+TEST_CASE("Batched interval evaluation")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    // This mixes opcodes with batched kernels and ones (like SIN)
+    // that fall back to evaluating lanes one at a time
+    auto t = min(menger(2),
+                 Tree(Opcode::SQRT, Tree(Opcode::SQUARE, x) + y * z) / (z - 3)
+                 + Tree(Opcode::SIN, x) + Tree(Opcode::ABS, x - y));
+
+    // Use an offset, to check that other lanes are left alone
+    const Result::Index first = 3;
+    const Result::Index count = 13;
+
+    auto box = [](Result::Index i, int axis)
+    {
+        float lo = -1.9f + 0.31f * ((i * (axis + 2)) % count);
+        return Interval(lo, lo + 0.17f * (axis + 1));
+    };
+
+    for (auto b : Backend::available())
+    {
+        SECTION(b->name)
+        {
+            Evaluator e(t);
+            e.setBackend(*b);
+
+            for (Result::Index i=0; i < count; ++i)
+            {
+                e.set(box(i, 0), box(i, 1), box(i, 2), first + i);
+            }
+            e.set(Interval(100, 101), Interval(100, 101), Interval(100, 101),
+                  first - 1);
+            auto out = e.intervals(count, first);
+
+            Evaluator ref(t);
+            ref.setBackend(*b);
+            for (Result::Index i=0; i < count; ++i)
+            {
+                auto r = ref.eval(box(i, 0), box(i, 1), box(i, 2));
+                CAPTURE(i);
+                CAPTURE(r.lower());
+                CAPTURE(r.upper());
+                CAPTURE(out.lower[first + i]);
+                CAPTURE(out.upper[first + i]);
+
+                // Boost returns an empty (NaN) interval in some cases
+                // (e.g. dividing by an interval that contains zero),
+                // where batched kernels return a valid bound instead
+                if (!std::isnan(r.lower()))
+                {
+                    REQUIRE(out.lower[first + i] <= r.lower());
+                    REQUIRE(out.upper[first + i] >= r.upper());
+                }
+
+                // Pushing into a lane should prune at least as well as a
+                // scalar push into the same box (batched results can be a
+                // little wider), and give the same results inside the box
+                ref.push();
+                e.push(first + i);
+                REQUIRE(e.utilization() >= ref.utilization());
+
+                const float px = box(i, 0).lower() + 0.01f;
+                const float py = box(i, 1).lower() + 0.01f;
+                const float pz = box(i, 2).lower() + 0.01f;
+                const float v = e.eval(px, py, pz);
+                const float w = ref.eval(px, py, pz);
+                REQUIRE((v == w || (std::isnan(v) && std::isnan(w))));
+
+                e.pop();
+                ref.pop();
+            }
+
+            // The lane below first shouldn't have been evaluated
+            REQUIRE(out.lower[first - 1] == 0);
+            REQUIRE(out.upper[first - 1] == 0);
+        }
+    }
+}
+
+TEST_CASE("Interval pruning by opcode")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+
+    // Subdivides [-2, 2] x [-2, 2] as a quadtree, pushing into every box
+    // that the interval result doesn't resolve, and checks that results
+    // contain the shape's values at a few points in each box
+    auto run = [&](const std::string& name, Tree t)
+    {
+        Evaluator e(t);
+        Evaluator ref(t);
+        unsigned boxes = 0;
+        unsigned ambiguous = 0;
+        double utilization = 0;
+
+        std::function<void(Interval, Interval, unsigned)> recurse =
+            [&](Interval X, Interval Y, unsigned depth)
+        {
+            boxes++;
+            auto i = e.eval(X, Y, Interval(0, 0));
+            const float mx = (X.lower() + X.upper()) / 2;
+            const float my = (Y.lower() + Y.upper()) / 2;
+            for (float px : {X.lower(), mx, X.upper()})
+            {
+                for (float py : {Y.lower(), my, Y.upper()})
+                {
+                    const float v = ref.eval(px, py, 0);
+                    CAPTURE(name);
+                    CAPTURE(px);
+                    CAPTURE(py);
+                    CAPTURE(v);
+                    CAPTURE(i.lower());
+                    CAPTURE(i.upper());
+                    REQUIRE(v >= i.lower() - 1e-5);
+                    REQUIRE(v <= i.upper() + 1e-5);
+                }
+            }
+            if (i.lower() > 0 || i.upper() < 0)
+            {
+                return;
+            }
+
+            e.push();
+            if (depth == 0)
+            {
+                ambiguous++;
+                utilization += e.utilization();
+                REQUIRE(e.eval(mx, my, 0) == Approx(ref.eval(mx, my, 0)));
+            }
+            else
+            {
+                recurse(Interval(X.lower(), mx), Interval(Y.lower(), my), depth - 1);
+                recurse(Interval(mx, X.upper()), Interval(Y.lower(), my), depth - 1);
+                recurse(Interval(X.lower(), mx), Interval(my, Y.upper()), depth - 1);
+                recurse(Interval(mx, X.upper()), Interval(my, Y.upper()), depth - 1);
+            }
+            e.pop();
+        };
+        recurse(Interval(-2, 2), Interval(-2, 2), 6);
+
+        std::string log = "\n" + name + ": " + std::to_string(boxes) +
+            " boxes, " + std::to_string(ambiguous) + " unresolved, " +
+            std::to_string(ambiguous ? utilization / ambiguous : 0) +
+            " mean utilization";
+        WARN(log);
+    };
+
+    auto circle = [](Tree cx, Tree cy, float r)
+        { return sqrt(square(cx) + square(cy)) - r; };
+
+    SECTION("mod")
+    {
+        // A grid of circles, unioned with a larger one
+        run("mod", min(circle(Tree(Opcode::MOD, x, Tree(1.0f)) - 0.5,
+                              Tree(Opcode::MOD, y, Tree(1.0f)) - 0.5, 0.3),
+                       circle(x - 1, y - 1, 0.75)));
+    }
+    SECTION("pow")
+    {
+        // A superellipse
+        auto p = Tree(4.0f);
+        run("pow", Tree(Opcode::POW, x, p) + Tree(Opcode::POW, y, p) - 1);
+    }
+    SECTION("nth-root")
+    {
+        run("nth-root", min(Tree(Opcode::NTH_ROOT, square(x) + square(y),
+                                 Tree(2.0f)) - 1,
+                            circle(x - 1.5, y, 0.25)));
+    }
+    SECTION("atan2")
+    {
+        // A wedge, cut from a ring
+        run("atan2", max(abs(Tree(Opcode::ATAN2, y, x) - 1) - 0.5,
+                         abs(circle(x, y, 1.25)) - 0.5));
+    }
+    SECTION("nan-fill")
+    {
+        // A hemisphere's height, which is NaN outside of the unit circle
+        run("nan-fill", min(0.5 - Tree(Opcode::NANFILL,
+                                 Tree(Opcode::SQRT, 1 - square(x) - square(y)),
+                                 Tree(0.0f)),
+                            circle(x + 1.5, y, 0.25)));
+    }
+}
+
+TEST_CASE("Mean value interval evaluation")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    SECTION("Tighter on small boxes")
+    {
+        // x^2 - x over [0.4, 0.6] is in [-0.25, -0.24], but interval
+        // arithmetic gives [-0.44, -0.04]
+        Evaluator e(square(x) - x);
+        auto i = e.eval({0.4, 0.6}, {0, 0}, {0, 0});
+
+        e.setIntervalMode(Evaluator::MEAN_VALUE);
+        auto m = e.eval({0.4, 0.6}, {0, 0}, {0, 0});
+        REQUIRE(m.lower() >= i.lower());
+        REQUIRE(m.upper() <= i.upper());
+        REQUIRE(m.lower() <= -0.25);
+        REQUIRE(m.lower() > -0.3);
+        REQUIRE(m.upper() >= -0.24);
+        REQUIRE(m.upper() < -0.2);
+    }
+
+    SECTION("Through a matrix")
+    {
+        auto M = glm::rotate(glm::mat4(), float(M_PI/3), {0, 0, 1});
+        Evaluator e(square(x) - x, M);
+        auto i = e.eval({0.4, 0.5}, {-0.1, 0}, {0, 0});
+
+        e.setIntervalMode(Evaluator::MEAN_VALUE);
+        auto m = e.eval({0.4, 0.5}, {-0.1, 0}, {0, 0});
+        const float mw = m.upper() - m.lower();
+        const float iw = i.upper() - i.lower();
+        REQUIRE(mw < iw);
+    }
+
+    SECTION("Discontinuities")
+    {
+        // The mean value form can't be used across a jump,
+        // so this must match interval arithmetic
+        Evaluator e(Tree(Opcode::MOD, x, Tree(1.0f)) + square(x) - x);
+        auto i = e.eval({0.9, 1.1}, {0, 0}, {0, 0});
+
+        e.setIntervalMode(Evaluator::MEAN_VALUE);
+        auto m = e.eval({0.9, 1.1}, {0, 0}, {0, 0});
+        REQUIRE(m.lower() == i.lower());
+        REQUIRE(m.upper() == i.upper());
+    }
+
+    SECTION("Contains every sample")
+    {
+        auto t = min(sphere(1) * Tree(Opcode::SIN, x * y),
+                     Tree(Opcode::SQRT, square(x) + 1) / (z - 3) +
+                     Tree(Opcode::ATAN2, y, x + 2));
+        Evaluator e(t);
+        e.setIntervalMode(Evaluator::MEAN_VALUE);
+
+        for (int i=0; i < 50; ++i)
+        {
+            const float lo = -1.3f + 0.05f * i;
+            const Interval b(lo, lo + 0.1f);
+            auto out = e.eval(b, b, b);
+            for (int j=0; j <= 4; ++j)
+            {
+                const float p = lo + 0.025f * j;
+                const float v = e.eval(p, p, p);
+                CAPTURE(i);
+                CAPTURE(j);
+                CAPTURE(v);
+                CAPTURE(out.lower());
+                CAPTURE(out.upper());
+                REQUIRE(v >= out.lower() - 1e-6);
+                REQUIRE(v <= out.upper() + 1e-6);
+            }
+        }
+    }
+
+    SECTION("Batched lanes")
+    {
+        Evaluator e(min(sphere(1), square(x) - x + y * z));
+        e.setIntervalMode(Evaluator::MEAN_VALUE);
+
+        std::vector<Interval> expected;
+        for (unsigned i=0; i < 4; ++i)
+        {
+            const Interval b(0.2f * i, 0.2f * i + 0.1f);
+            expected.push_back(e.eval(b, b, b));
+            e.set(b, b, b, i);
+        }
+
+        auto out = e.intervals(4);
+        for (unsigned i=0; i < 4; ++i)
+        {
+            REQUIRE(out.lower[i] == expected[i].lower());
+            REQUIRE(out.upper[i] == expected[i].upper());
+        }
+    }
+}
+
+TEST_CASE("Result slot reuse")
+{
+    // Exposes the number of result rows
+    struct Rows : public Evaluator
+    {
+        using Evaluator::Evaluator;
+        size_t rows() const { return result.f.size(); }
+        size_t clauses() const { return tape->t.size(); }
+    };
+
+    // A long chain of operations only needs a handful of live values
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    Tree t = x;
+    for (int i=0; i < 100; ++i)
+    {
+        t = t * 0.5 + x * y;
+    }
+    t = min(t, Tree(Opcode::SQRT, x * x + y * y));
+
+    Rows e(t);
+    CAPTURE(e.rows());
+    CAPTURE(e.clauses());
+    REQUIRE(e.clauses() > 200);
+    REQUIRE(e.rows() < 16);
+
+    auto expected = [](float x, float y)
+    {
+        float t = x;
+        for (int i=0; i < 100; ++i)
+        {
+            t = t * 0.5f + x * y;
+        }
+        return std::fmin(t, std::sqrt(x * x + y * y));
+    };
+    REQUIRE(e.eval(1.5, -2, 0) == Approx(expected(1.5, -2)));
+    REQUIRE(e.eval(-3, 0.25, 0) == Approx(expected(-3, 0.25)));
+
+    // Arguments to min are kept around for push
+    e.eval(Interval(0.9, 1), Interval(0.9, 1), Interval(0, 0));
+    e.push();
+    REQUIRE(e.utilization() < 1);
+    REQUIRE(e.eval(0.95, 0.95, 0) == Approx(expected(0.95, 0.95)));
+    e.pop();
+
+    auto g = e.gradient(1, 2, 0);
+    REQUIRE(g.size() == 0);
+}
+
+TEST_CASE("Superinstruction fusion")
+{
+    // Exposes the number of interpreter steps
+    struct Fusing : public Evaluator
+    {
+        using Evaluator::Evaluator;
+        size_t clauses() const { return tape->t.size(); }
+        size_t steps() const { return tape->fused.size(); }
+    };
+
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    SECTION("Patterns")
+    {
+        // Each of these should become a single superinstruction
+        for (auto t : {sqrt(square(x) + square(y) + square(z)),
+                       sqrt(square(z) + (square(x) + square(y))),
+                       sqrt(square(x) + square(y)),
+                       square(x) + square(y),
+                       square(x - y),
+                       x * y + z,
+                       z + x * y})
+        {
+            Fusing e(t);
+            e.eval(1.5, -2, 0.5);
+            CAPTURE(e.clauses());
+            REQUIRE(e.clauses() > 1);
+            REQUIRE(e.steps() == 1);
+        }
+
+        Fusing e(sqrt(square(x) + square(y) + square(z)));
+        REQUIRE(e.eval(1, 2, 2) == 3);
+    }
+
+    SECTION("Shared intermediates")
+    {
+        // x^2 is read twice, so it can't be folded into x^2 * y + x^2
+        auto sq = square(x);
+        Fusing e(sq * y + sq);
+        REQUIRE(e.eval(3, 2, 0) == 27);
+        REQUIRE(e.steps() == 2);
+
+        // Arguments to min are read by push, so they're always written out
+        Fusing f(min(x * y, x * y + z));
+        REQUIRE(f.eval(1, 2, 3) == 2);
+        REQUIRE(f.steps() == 3);
+    }
+
+    SECTION("Against unfused evaluation")
+    {
+        auto t = min(sqrt(square(x - 0.5) + square(y) + square(z)) - 1,
+                     max(square(x + 1) + square(y * z), x * y + z * 2));
+
+        for (auto b : Backend::available())
+        {
+            CAPTURE(b->name);
+            Fusing e(t);
+            e.setBackend(*b);
+            e.setJit(false);
+
+            // derivs doesn't use superinstructions, so it's a reference
+            auto check = [&]()
+            {
+                const Result::Index count = 253;
+                for (Result::Index i=0; i < count; ++i)
+                {
+                    e.set(-1.1f + 0.013f * i, 0.9f - 0.007f * i,
+                          0.3f + 0.011f * (i % 17), i);
+                }
+                std::vector<float> v(e.values(count), e.values(count) + count);
+                REQUIRE(e.steps() < e.clauses());
+                auto w = e.derivs(count).v;
+                for (Result::Index i=0; i < count; ++i)
+                {
+                    CAPTURE(i);
+                    REQUIRE(v[i] == Approx(w[i]));
+                }
+            };
+
+            check();
+
+            // Pushed tapes have their own superinstructions
+            e.eval(Interval(2, 3), Interval(0, 0.1), Interval(0, 0.1));
+            e.push();
+            REQUIRE(e.utilization() < 1);
+            check();
+            e.pop();
+            check();
+        }
+    }
+}
+
+TEST_CASE("JIT evaluation")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    // This uses every opcode, so it mixes natively compiled clauses
+    // with calls into the fallback kernels
+    if (Jit::available())
+    {
+        REQUIRE(Jit::compile({}, {}, Backend::scalar()));
+    }
+
+    auto t = min(
+        max(Tree(Opcode::SQRT, Tree(Opcode::SQUARE, x) + y * z) / (z - 3),
+            -Tree(Opcode::SIN, x) + Tree(Opcode::COS, y)),
+        Tree(Opcode::TAN, x) + Tree(Opcode::ASIN, y) + Tree(Opcode::ACOS, z)
+        + Tree(Opcode::ATAN, x * y) + Tree(Opcode::EXP, z)
+        + Tree(Opcode::ATAN2, x, y) + Tree(Opcode::POW, x, Tree(2))
+        + Tree(Opcode::NTH_ROOT, y, Tree(3)) + Tree(Opcode::MOD, z, Tree(0.3))
+        + Tree(Opcode::NANFILL, Tree(Opcode::SQRT, x), y)
+        + Tree(Opcode::ABS, y) + Tree(Opcode::RECIP, z + 2)
+        + Tree(Opcode::RSQRT, square(x) + 1));
+
+    for (auto b : Backend::available())
+    {
+        SECTION(b->name)
+        {
+            Evaluator e(t);
+            e.setBackend(*b);
+            e.setJit(true);
+
+            Evaluator ref(t);
+            ref.setBackend(*b);
+            ref.setJit(false);
+
+            // Checks a full batch, evaluating enough times that the current
+            // tape is compiled (if the JIT is available and b isn't scalar)
+            auto check = [&]()
+            {
+                const Result::Index count = 253;
+                for (Result::Index i=0; i < count; ++i)
+                {
+                    const float px = -1.1f + 0.013f * i;
+                    const float py = 0.9f - 0.007f * i;
+                    const float pz = 0.3f + 0.011f * (i % 17);
+                    e.set(px, py, pz, i);
+                    ref.set(px, py, pz, i);
+                }
+
+                auto w = ref.values(count);
+                for (unsigned n=0; n < Jit::THRESHOLD + 1; ++n)
+                {
+                    auto v = e.values(count);
+                    for (Result::Index i=0; i < count; ++i)
+                    {
+                        CAPTURE(n);
+                        CAPTURE(i);
+                        CAPTURE(v[i]);
+                        CAPTURE(w[i]);
+                        REQUIRE((v[i] == Approx(w[i]) ||
+                                 (std::isnan(v[i]) && std::isnan(w[i]))));
+                    }
+                }
+            };
+
+            check();
+
+            // Pushed tapes are compiled separately
+            e.eval(Interval(-1, -0.5), Interval(0.2, 0.5), Interval(0, 1));
+            ref.eval(Interval(-1, -0.5), Interval(0.2, 0.5), Interval(0, 1));
+            e.push();
+            ref.push();
+            REQUIRE(e.utilization() < 1);
+            check();
+
+            e.pop();
+            ref.pop();
+            check();
+        }
+    }
+}
+
+TEST_CASE("JIT rounding")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    // x * y + z is fused into a MULADD, which must round the same way
+    // as the JIT (and every other path), so results don't change once
+    // the tape is compiled
+    auto t = x * y + z;
+
+    for (auto b : Backend::available())
+    {
+        CAPTURE(b->name);
+        Evaluator e(t);
+        e.setBackend(*b);
+        e.setJit(true);
+
+        const Result::Index count = 64;
+        for (Result::Index i=0; i < count; ++i)
+        {
+            e.set(0.1f + 0.013f * i, -0.7f + 0.029f * i, 0.01f * i, i);
+        }
+
+        std::vector<float> first(count);
+        auto v = e.values(count);
+        std::copy(v, v + count, first.begin());
+
+        auto d = e.derivs(count);
+        for (Result::Index i=0; i < count; ++i)
+        {
+            CAPTURE(i);
+            REQUIRE(d.v[i] == first[i]);
+        }
+
+        for (unsigned n=0; n < Jit::THRESHOLD + 1; ++n)
+        {
+            v = e.values(count);
+            for (Result::Index i=0; i < count; ++i)
+            {
+                CAPTURE(n);
+                CAPTURE(i);
+                REQUIRE(v[i] == first[i]);
+            }
+        }
+    }
+}
+
 TEST_CASE("Matrix evaluation")
 {
     auto t = Tree::X();
@@ -247,6 +1394,72 @@ TEST_CASE("Matrix normals")
     }
 }
 
+TEST_CASE("Evaluator::grid")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+    auto v = Tree::var();
+
+    // A cylinder (XY only) cut by slabs along Z, plus terms using every
+    // axis, a variable, and a unary clause
+    auto t = min(max(sqrt(x * x + y * y) - v, z * z - 0.5),
+                 x * y * z + Tree(Opcode::SIN, z));
+
+    const std::array<float, 5> xs = {{-1, -0.25, 0, 0.5, 1.5}};
+    const std::array<float, 3> ys = {{-2, 0.75, 1}};
+    const std::array<float, 4> zs = {{-1, -0.5, 0.25, 2}};
+
+    auto check = [&](const Tree& tree, const glm::mat4& M)
+    {
+        for (auto be : Backend::available())
+        {
+            CAPTURE(be->name);
+            Evaluator e(tree, M, {{v.id(), 0.75}});
+            e.setBackend(*be);
+            auto out = e.grid(xs.data(), xs.size(), ys.data(), ys.size(),
+                              zs.data(), zs.size());
+
+            Evaluator ref(tree, M, {{v.id(), 0.75}});
+            for (unsigned i=0; i < xs.size(); ++i)
+            {
+                for (unsigned j=0; j < ys.size(); ++j)
+                {
+                    for (unsigned k=0; k < zs.size(); ++k)
+                    {
+                        CAPTURE(i);
+                        CAPTURE(j);
+                        CAPTURE(k);
+                        REQUIRE(out[(i * ys.size() + j) * zs.size() + k] ==
+                                Approx(ref.eval(xs[i], ys[j], zs[k])));
+                    }
+                }
+            }
+        }
+    };
+
+    SECTION("Default matrix")
+    {
+        check(t, glm::mat4());
+    }
+
+    SECTION("Scale and offset")
+    {
+        check(t, glm::translate(glm::scale(glm::mat4(), {0.5, 2.0, 1.5}),
+                                {0.25, -0.5, 1.0}));
+    }
+
+    SECTION("Rotation")
+    {
+        check(t, glm::rotate(glm::mat4(), 0.3f, {0.0, 0.0, 1.0}));
+    }
+
+    SECTION("Constant")
+    {
+        check(Tree(3.5), glm::mat4());
+    }
+}
+
 TEST_CASE("Evaluator::derivs")
 {
     SECTION("X")
@@ -299,6 +1512,60 @@ TEST_CASE("Evaluator::derivs")
     }
 }
 
+TEST_CASE("Absolute value and reciprocals")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+
+    // f(x, y) = |x| + 1 / y + 1 / sqrt(y)
+    auto t = Tree(Opcode::ABS, x) + 1 / y + 1 / sqrt(y);
+    REQUIRE(Program(t).size() == 5);
+
+    auto f = [](float x, float y)
+        { return std::fabs(x) + 1 / y + 1 / std::sqrt(y); };
+
+    for (auto b : Backend::available())
+    {
+        CAPTURE(b->name);
+        Evaluator e(t);
+        e.setBackend(*b);
+
+        e.set(-2, 4, 0, 0);
+        e.set(3, 0.25, 0, 1);
+        auto v = e.values(2);
+        REQUIRE(v[0] == Approx(f(-2, 4)));
+        REQUIRE(v[1] == Approx(f(3, 0.25)));
+
+        // d/dx = sign(x), d/dy = -1 / y^2 - 1 / (2 y^1.5)
+        auto d = e.derivs(2);
+        REQUIRE(d.dx[0] == -1);
+        REQUIRE(d.dx[1] == 1);
+        REQUIRE(d.dy[0] == Approx(-1 / 16.0 - 1 / 16.0));
+        REQUIRE(d.dy[1] == Approx(-16 - 4));
+        REQUIRE(d.dz[0] == 0);
+
+        // Intervals contain every sample from the box
+        auto i = e.eval(Interval(-1, 2), Interval(0.5, 4), Interval(0, 0));
+        REQUIRE(i.lower() <= f(0, 4));
+        REQUIRE(i.upper() >= f(2, 0.5));
+        REQUIRE(i.lower() == Approx(f(0, 4)));
+        REQUIRE(i.upper() == Approx(f(2, 0.5)));
+
+        e.set(Interval(-3, -1), Interval(1, 4), Interval(0, 0), 0);
+        auto is = e.intervals(1);
+        REQUIRE(is.lower[0] <= f(-1, 4));
+        REQUIRE(is.upper[0] >= f(-3, 1));
+    }
+
+    SECTION("Gradient")
+    {
+        auto a = Tree::var();
+        Evaluator e(Tree(Opcode::ABS, a) + 1 / a, {{a.id(), -2}});
+        auto g = e.gradient(0, 0, 0);
+        REQUIRE(g.at(a.id()) == Approx(-1 - 0.25));
+    }
+}
+
 TEST_CASE("Evaluator::specialize")
 {
     Evaluator e(min(Tree::X(), Tree::Y()));
@@ -368,6 +1635,17 @@ TEST_CASE("Evaluator::featuresAt")
         REQUIRE((i++)->deriv == glm::vec3(-1, 0, 0));
     }
 
+    SECTION("Two features (abs)")
+    {
+        // abs() builds max(X, -X), so its crease is visible here
+        Evaluator e(abs(Tree::X()) - Tree::Y());
+        auto fs = e.featuresAt(0, 0, 0);
+        REQUIRE(fs.size() == 2);
+        auto i = fs.begin();
+        REQUIRE((i++)->deriv == glm::vec3(1, -1, 0));
+        REQUIRE((i++)->deriv == glm::vec3(-1, -1, 0));
+    }
+
     SECTION("Three features")
     {
         Evaluator e(min(Tree::X(), min(Tree::Y(), Tree::Z())));
@@ -409,6 +1687,40 @@ TEST_CASE("Evaluator::getAmbiguous")
     REQUIRE(b.size() == 2);
     REQUIRE(b.count(0) == 1);
     REQUIRE(b.count(3) == 1);
+
+    // derivs marks the same points as it goes
+    for (auto be : Backend::available())
+    {
+        e.setBackend(*be);
+        auto ds = e.derivs(4);
+        CAPTURE(be->name);
+        REQUIRE(ds.ambiguous[0]);
+        REQUIRE(!ds.ambiguous[1]);
+        REQUIRE(!ds.ambiguous[2]);
+        REQUIRE(ds.ambiguous[3]);
+    }
+}
+
+TEST_CASE("Evaluator::getAmbiguous (abs)")
+{
+    // abs() must keep its crease visible to ambiguity checks
+    Evaluator e(abs(Tree::X()) - Tree::Y());
+    e.set(0, 0, 0, 0);
+    e.set(1, 0, 0, 1);
+
+    e.values(2);
+    auto a = e.getAmbiguous(2);
+    REQUIRE(a.size() == 1);
+    REQUIRE(a.count(0) == 1);
+
+    for (auto be : Backend::available())
+    {
+        e.setBackend(*be);
+        auto ds = e.derivs(2);
+        CAPTURE(be->name);
+        REQUIRE(ds.ambiguous[0]);
+        REQUIRE(!ds.ambiguous[1]);
+    }
 }
 
 TEST_CASE("Evaluator::push(Feature)")
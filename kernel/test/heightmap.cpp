@@ -249,6 +249,37 @@ TEST_CASE("Normal clipping ")
     REQUIRE((norm == 0xffff7f7f || norm == 0).all());
 }
 
+TEST_CASE("Mean value interval mode")
+{
+    // A smooth blob, where interval arithmetic overestimates badly
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+    Tree t = square(x) + square(y) + square(z) - x * y * z * 2 - 1;
+    Region r({-1.5, 1.5}, {-1.5, 1.5}, {-1.5, 1.5}, 64);
+    std::atomic_bool abort(false);
+
+    std::array<Evaluator::Counts, 2> counts;
+    std::array<DepthImage, 2> depth;
+    unsigned i = 0;
+    for (auto mode : {Evaluator::INTERVAL_ARITHMETIC, Evaluator::MEAN_VALUE})
+    {
+        Evaluator e(t);
+        e.setIntervalMode(mode);
+        depth[i] = Heightmap::render({&e}, r, abort).first;
+        counts[i++] = e.getCounts();
+    }
+
+    WARN("Mean value form: " + std::to_string(counts[0].intervals) + " -> " +
+         std::to_string(counts[1].intervals) + " interval evaluations, " +
+         std::to_string(counts[0].points) + " -> " +
+         std::to_string(counts[1].points) + " point evaluations");
+
+    REQUIRE((depth[0] == depth[1]).all());
+    REQUIRE(counts[1].intervals < counts[0].intervals);
+    REQUIRE(counts[1].points < counts[0].points);
+}
+
 TEST_CASE("Performance")
 {
     std::chrono::time_point<std::chrono::system_clock> start, end;
@@ -0,0 +1,463 @@
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <catch/catch.hpp>
+#include <boost/numeric/interval.hpp>
+
+#include "kernel/eval/interval.hpp"
+
+using namespace Kernel;
+
+// This is the boost interval type that Kernel::Interval replaced, which
+// we use as a reference implementation (it uses directed rounding)
+typedef boost::numeric::interval<float,
+    boost::numeric::interval_lib::policies<
+        boost::numeric::interval_lib::save_state<
+            boost::numeric::interval_lib::rounded_transc_std<float>>,
+        boost::numeric::interval_lib::checking_base<float>>> Reference;
+
+/*
+ *  Returns a set of intervals covering all of the sign cases, with
+ *  zero and infinite bounds, plus a batch of random ones
+ */
+static std::vector<std::pair<float, float>> samples()
+{
+    std::vector<float> special = {
+        -INFINITY, -1e30f, -3.5f, -1.0f, -0.1f, 0.0f,
+        1e-7f, 0.1f, 1.0f, 2.0f, 3.5f, 1e30f, INFINITY};
+
+    std::vector<std::pair<float, float>> out;
+    for (auto a : special)
+    {
+        for (auto b : special)
+        {
+            if (a <= b)
+            {
+                out.push_back({a, b});
+            }
+        }
+    }
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> mantissa(-1, 1);
+    std::uniform_int_distribution<int> exponent(-20, 20);
+    for (int i=0; i < 200; ++i)
+    {
+        float a = std::ldexp(mantissa(gen), exponent(gen));
+        float b = std::ldexp(mantissa(gen), exponent(gen));
+        out.push_back({std::fmin(a, b), std::fmax(a, b)});
+    }
+    return out;
+}
+
+/*
+ *  Checks that the two intervals have exactly the same bounds
+ *  (or are both empty)
+ */
+static void checkSame(const Interval& i, const Reference& r)
+{
+    CAPTURE(i.lower());
+    CAPTURE(i.upper());
+    CAPTURE(r.lower());
+    CAPTURE(r.upper());
+    if (boost::numeric::empty(r))
+    {
+        REQUIRE(i.isEmpty());
+    }
+    else
+    {
+        REQUIRE(i.lower() == r.lower());
+        REQUIRE(i.upper() == r.upper());
+    }
+}
+
+/*
+ *  Checks that the result contains f evaluated (in double precision)
+ *  across the input interval, and is no more than a few ulps wider
+ *  than the reference result
+ */
+static void checkClose(const Interval& i, const Reference& r,
+                       std::function<double(double)> f, float lo, float hi)
+{
+    CAPTURE(lo);
+    CAPTURE(hi);
+    CAPTURE(i.lower());
+    CAPTURE(i.upper());
+    CAPTURE(r.lower());
+    CAPTURE(r.upper());
+
+    if (std::isnan(r.lower()))
+    {
+        REQUIRE(i.isEmpty());
+        return;
+    }
+    REQUIRE(!i.isEmpty());
+
+    // The reference can come out with its bounds crossed (as float libm
+    // functions don't always respect the rounding mode), in which case
+    // we only check that our result contains the true values
+    if (r.lower() <= r.upper())
+    {
+        auto tol = [](float v) { return 1e-6f * std::fmax(1.0f, std::abs(v)); };
+        REQUIRE(i.lower() >= r.lower() - tol(r.lower()));
+        REQUIRE(i.upper() <= r.upper() + tol(r.upper()));
+    }
+
+    if (std::isfinite(lo) && std::isfinite(hi))
+    {
+        for (int j=0; j <= 64; ++j)
+        {
+            const double x = std::fmin(hi, lo + (double(hi) - lo) * j / 64);
+            const double v = f(x);
+            if (!std::isnan(v))
+            {
+                CAPTURE(x);
+                CAPTURE(v);
+                REQUIRE(i.lower() <= v);
+                REQUIRE(i.upper() >= v);
+            }
+        }
+    }
+}
+
+TEST_CASE("Interval arithmetic matches boost")
+{
+    auto ss = samples();
+
+    SECTION("Binary operators")
+    {
+        for (auto a : ss)
+        {
+            for (auto b : ss)
+            {
+                Interval ia(a.first, a.second), ib(b.first, b.second);
+                Reference ra(a.first, a.second), rb(b.first, b.second);
+
+                // Boost gives NaN bounds for (inf - inf); we return empty
+                if (std::isinf(a.first + b.first) ||
+                    std::isinf(a.second + b.second))
+                {
+                    continue;
+                }
+
+                checkSame(ia + ib, ra + rb);
+                checkSame(ia - ib, ra - rb);
+                checkSame(ia * ib, ra * rb);
+                checkSame(ia / ib, ra / rb);
+                checkSame(min(ia, ib), boost::numeric::min(ra, rb));
+                checkSame(max(ia, ib), boost::numeric::max(ra, rb));
+            }
+        }
+    }
+
+    SECTION("Unary functions")
+    {
+        for (auto a : ss)
+        {
+            Interval ia(a.first, a.second);
+            Reference ra(a.first, a.second);
+
+            checkSame(-ia, -ra);
+            checkSame(square(ia), boost::numeric::square(ra));
+            checkSame(sqrt(ia), boost::numeric::sqrt(ra));
+        }
+    }
+
+    SECTION("Rounding")
+    {
+        // 0.1 isn't exactly representable, so these can't be tight
+        Interval a(0.1f, 0.1f);
+        auto b = a + Interval(0.2f, 0.2f);
+        REQUIRE(b.lower() < b.upper());
+        REQUIRE(b.lower() <= 0.3);
+        REQUIRE(b.upper() >= 0.3);
+
+        // Exact results aren't widened
+        auto c = Interval(1, 2) + 1;
+        REQUIRE(c.lower() == 2);
+        REQUIRE(c.upper() == 3);
+
+        // Bounds given as doubles are rounded outwards
+        Interval d(0.1, 0.1);
+        REQUIRE(d.lower() < d.upper());
+        REQUIRE(d.lower() <= 0.1);
+        REQUIRE(d.upper() >= 0.1);
+    }
+}
+
+/*
+ *  Runs checkClose for every sample interval with modest bounds (the
+ *  reference implementation uses float libm functions, which aren't
+ *  accurate for huge arguments)
+ */
+static void checkFunction(std::function<Interval(Interval)> f,
+                          std::function<Reference(Reference)> g,
+                          std::function<double(double)> h)
+{
+    for (auto a : samples())
+    {
+        if (std::abs(a.first) <= 1e6 && std::abs(a.second) <= 1e6)
+        {
+            checkClose(f(Interval(a.first, a.second)),
+                       g(Reference(a.first, a.second)),
+                       h, a.first, a.second);
+        }
+    }
+}
+
+TEST_CASE("Interval transcendentals match boost")
+{
+    SECTION("sin")
+    {
+        checkFunction([](Interval i) { return sin(i); },
+                      [](Reference r) { return boost::numeric::sin(r); },
+                      [](double x) { return std::sin(x); });
+    }
+    SECTION("cos")
+    {
+        checkFunction([](Interval i) { return cos(i); },
+                      [](Reference r) { return boost::numeric::cos(r); },
+                      [](double x) { return std::cos(x); });
+    }
+    SECTION("tan")
+    {
+        checkFunction([](Interval i) { return tan(i); },
+                      [](Reference r) { return boost::numeric::tan(r); },
+                      [](double x) { return std::tan(x); });
+    }
+    SECTION("asin")
+    {
+        checkFunction([](Interval i) { return asin(i); },
+                      [](Reference r) { return boost::numeric::asin(r); },
+                      [](double x) { return std::asin(x); });
+    }
+    SECTION("acos")
+    {
+        checkFunction([](Interval i) { return acos(i); },
+                      [](Reference r) { return boost::numeric::acos(r); },
+                      [](double x) { return std::acos(x); });
+    }
+    SECTION("atan")
+    {
+        checkFunction([](Interval i) { return atan(i); },
+                      [](Reference r) { return boost::numeric::atan(r); },
+                      [](double x) { return std::atan(x); });
+    }
+    SECTION("exp")
+    {
+        checkFunction([](Interval i) { return exp(i); },
+                      [](Reference r) { return boost::numeric::exp(r); },
+                      [](double x) { return std::exp(x); });
+    }
+    SECTION("pow")
+    {
+        for (int p : {2, 3, -2})
+        {
+            CAPTURE(p);
+            checkFunction([=](Interval i) { return pow(i, p); },
+                          [=](Reference r) { return boost::numeric::pow(r, p); },
+                          [=](double x) { return std::pow(x, p); });
+        }
+    }
+    SECTION("nth_root")
+    {
+        for (int n : {2, 3})
+        {
+            CAPTURE(n);
+            checkFunction(
+                [=](Interval i) { return nth_root(i, n); },
+                [=](Reference r) { return boost::numeric::nth_root(r, n); },
+                [=](double x) { return (n == 3) ? std::cbrt(x)
+                                                : std::sqrt(x); });
+        }
+    }
+}
+
+TEST_CASE("Interval atan2")
+{
+    auto check = [](Interval y, Interval x, double ty, double tx)
+    {
+        auto out = atan2(y, x);
+        const double v = std::atan2(ty, tx);
+        CAPTURE(out.lower());
+        CAPTURE(out.upper());
+        CAPTURE(v);
+        REQUIRE(out.lower() <= v);
+        REQUIRE(out.upper() >= v);
+    };
+
+    // One point from each of the quadrants and half-planes
+    check(Interval(1, 2), Interval(1, 2), 1.5, 1.1);
+    check(Interval(-2, -1), Interval(1, 2), -1.5, 1.1);
+    check(Interval(-1, 1), Interval(1, 2), 0.3, 1.9);
+    check(Interval(1, 2), Interval(-2, -1), 1.9, -1.2);
+    check(Interval(-2, -1), Interval(-2, -1), -1.9, -1.2);
+    check(Interval(-1, 1), Interval(-2, -1), 0.9, -1.2);
+    check(Interval(1, 2), Interval(-1, 1), 1.3, 0.7);
+    check(Interval(-2, -1), Interval(-1, 1), -1.3, -0.7);
+    check(Interval(-1, 1), Interval(-1, 1), -0.3, -0.9);
+}
+
+TEST_CASE("Interval mod / pow / nth_root / nanfill")
+{
+    // Checks that out contains f at points spread across a and b
+    auto check = [](Interval out, Interval a, Interval b,
+                    std::function<float(float, float)> f)
+    {
+        for (int i=0; i <= 32; ++i)
+        {
+            for (int j=0; j <= 4; ++j)
+            {
+                const float x = std::fmin(a.upper(),
+                        a.lower() + (a.upper() - a.lower()) * i / 32);
+                const float y = std::fmin(b.upper(),
+                        b.lower() + (b.upper() - b.lower()) * j / 4);
+                const float v = f(x, y);
+                if (!std::isnan(v))
+                {
+                    CAPTURE(x);
+                    CAPTURE(y);
+                    CAPTURE(v);
+                    CAPTURE(out.lower());
+                    CAPTURE(out.upper());
+                    REQUIRE(out.lower() <= v);
+                    REQUIRE(out.upper() >= v);
+                }
+            }
+        }
+    };
+
+    auto ss = samples();
+
+    SECTION("mod")
+    {
+        // The scalar evaluator's floored modulo
+        auto f = [](float a, float b)
+        {
+            float out = std::fmod(a, b);
+            while (out < 0)
+            {
+                out += b;
+            }
+            return out;
+        };
+        for (float p : {1.0f, 0.3f, 2.5f, 1e-3f})
+        {
+            for (auto a : ss)
+            {
+                CAPTURE(p);
+                CAPTURE(a.first);
+                CAPTURE(a.second);
+                if (std::isfinite(a.first) && std::isfinite(a.second))
+                {
+                    const Interval ia(a.first, a.second);
+                    check(mod(ia, p), ia, p, f);
+                }
+            }
+        }
+        for (auto a : ss)
+        {
+            if (std::isfinite(a.first) && std::isfinite(a.second) &&
+                a.first >= 0)
+            {
+                const Interval ia(a.first, a.second);
+                const Interval b(2, 3);
+                check(mod(ia, b), ia, b, f);
+            }
+        }
+
+        // Within a single period, the result is a shifted copy of a
+        for (auto a : {Interval(0.2, 0.4), Interval(3.2, 3.4),
+                       Interval(-0.8, -0.6)})
+        {
+            auto out = mod(a, 1.0f);
+            REQUIRE(out.lower() == Approx(0.2));
+            REQUIRE(out.upper() == Approx(0.4));
+        }
+        auto out = mod(Interval(0.9, 1.1), 1.0f);
+        REQUIRE(out.lower() == 0);
+        REQUIRE(out.upper() == 1);
+    }
+
+    SECTION("pow")
+    {
+        auto f = [](float a, float b) { return std::pow(a, b); };
+        for (auto b : {Interval(0.5), Interval(1.5), Interval(-0.5),
+                       Interval(0), Interval(1.5, 2.5), Interval(-3, 2)})
+        {
+            for (auto a : ss)
+            {
+                CAPTURE(b.lower());
+                CAPTURE(b.upper());
+                CAPTURE(a.first);
+                CAPTURE(a.second);
+                if (std::isfinite(a.first) && std::isfinite(a.second))
+                {
+                    const Interval ia(a.first, a.second);
+                    check(pow(ia, b), ia, b, f);
+                }
+            }
+        }
+
+        auto out = pow(Interval(4, 9), Interval(0.5));
+        REQUIRE(out.lower() == Approx(2));
+        REQUIRE(out.upper() == Approx(3));
+
+        out = pow(Interval(-1, 4), Interval(0.5));
+        REQUIRE(out.lower() == 0);
+        REQUIRE(out.upper() == Approx(2));
+
+        REQUIRE(pow(Interval(-8, -1), Interval(0.5)).isEmpty());
+
+        out = pow(Interval(-2, -1), Interval(1.5, 2.5));
+        REQUIRE(out.lower() == Approx(1));
+        REQUIRE(out.upper() == Approx(4));
+
+        out = pow(Interval(0, 0), Interval(0));
+        REQUIRE(out.lower() == 1);
+        REQUIRE(out.upper() == 1);
+    }
+
+    SECTION("nth_root")
+    {
+        auto f = [](float a, float n) { return std::pow(a, 1.0f / n); };
+        for (auto n : {Interval(2), Interval(3), Interval(2, 4)})
+        {
+            for (auto a : ss)
+            {
+                CAPTURE(n.lower());
+                CAPTURE(n.upper());
+                CAPTURE(a.first);
+                CAPTURE(a.second);
+                if (std::isfinite(a.first) && std::isfinite(a.second))
+                {
+                    const Interval ia(a.first, a.second);
+                    check(nth_root(ia, n), ia, n, f);
+                }
+            }
+        }
+
+        // As in the evaluators, roots of negative numbers are NaN
+        auto out = nth_root(Interval(-8, 27), Interval(3));
+        REQUIRE(out.lower() == 0);
+        REQUIRE(out.upper() == Approx(3));
+    }
+
+    SECTION("nanfill")
+    {
+        auto out = nanfill(Interval::empty(), Interval(1, 2));
+        REQUIRE(out.lower() == 1);
+        REQUIRE(out.upper() == 2);
+
+        out = nanfill(Interval(0, 1), Interval::empty());
+        REQUIRE(out.lower() == 0);
+        REQUIRE(out.upper() == 1);
+
+        // a may have been NaN somewhere in the box
+        out = nanfill(Interval(0, 1), Interval(5, 6));
+        REQUIRE(out.lower() == 0);
+        REQUIRE(out.upper() == 6);
+    }
+}
@@ -0,0 +1,127 @@
+#include <catch/catch.hpp>
+
+#include "kernel/eval/pool.hpp"
+#include "kernel/render/heightmap.hpp"
+
+#include "util/shapes.hpp"
+
+using namespace Kernel;
+
+TEST_CASE("EvaluatorPool checkout / checkin")
+{
+    EvaluatorPool pool(2);
+    auto t = sphere(1);
+
+    Evaluator* first;
+    {
+        auto e = pool.checkout(t);
+        first = e.get();
+        REQUIRE(e->eval(0, 0, 0) == -1);
+
+        auto s = pool.stats();
+        REQUIRE(s.hits == 0);
+        REQUIRE(s.misses == 1);
+        REQUIRE(s.idle == 0);
+    }
+    REQUIRE(pool.stats().idle == 1);
+
+    SECTION("Reuse")
+    {
+        auto e = pool.checkout(t);
+        REQUIRE(e.get() == first);
+        REQUIRE(e->eval(1, 0, 0) == 0);
+
+        auto s = pool.stats();
+        REQUIRE(s.hits == 1);
+        REQUIRE(s.misses == 1);
+    }
+
+    SECTION("State is reset")
+    {
+        {
+            auto e = pool.checkout(t);
+            e->setMatrix(glm::mat4(2));
+            e->setBackend(Backend::scalar());
+        }
+        auto e = pool.checkout(t);
+        REQUIRE(e->eval(1, 0, 0) == 0);
+        REQUIRE(&e->getBackend() == &Backend::active());
+    }
+
+    SECTION("Variables")
+    {
+        auto v = Tree::var();
+        auto u = Tree(Opcode::ADD, v, Tree::X());
+        {
+            auto e = pool.checkout(u, {{v.id(), 1}});
+            REQUIRE(e->eval(1, 0, 0) == 2);
+        }
+        auto e = pool.checkout(u, {{v.id(), 3}});
+        REQUIRE(e->eval(1, 0, 0) == 4);
+        REQUIRE(pool.stats().hits == 1);
+    }
+
+    SECTION("Multiple checkouts")
+    {
+        auto es = pool.checkout(t, 3);
+        REQUIRE(es.size() == 3);
+        REQUIRE(es[0].get() != es[1].get());
+        REQUIRE(es[1].get() != es[2].get());
+        REQUIRE(es[0]->getProgram() == es[1]->getProgram());
+        REQUIRE(pool.stats().hits == 1);
+        REQUIRE(pool.stats().misses == 3);
+
+        es.clear();
+        auto s = pool.stats();
+        REQUIRE(s.idle == 2);
+        REQUIRE(s.evictions == 1);
+    }
+
+    SECTION("Least recently used trees are evicted")
+    {
+        auto a = circle(1);
+        auto b = circle(2);
+        pool.checkout(a);
+        pool.checkout(b);
+        REQUIRE(pool.stats().evictions == 1);
+
+        // t was the least recently used, so it should have been evicted
+        pool.checkout(a);
+        pool.checkout(b);
+        REQUIRE(pool.stats().hits == 2);
+        pool.checkout(t);
+        REQUIRE(pool.stats().hits == 2);
+    }
+
+    SECTION("Capacity")
+    {
+        pool.setCapacity(0);
+        REQUIRE(pool.stats().idle == 0);
+        REQUIRE(pool.stats().evictions == 1);
+    }
+
+    SECTION("Clear")
+    {
+        pool.clear();
+        REQUIRE(pool.stats().idle == 0);
+        pool.checkout(t);
+        REQUIRE(pool.stats().misses == 2);
+    }
+}
+
+TEST_CASE("Repeated renders reuse pooled evaluators")
+{
+    auto& pool = EvaluatorPool::instance();
+    auto t = sphere(0.5);
+    Region r({-1, 1}, {-1, 1}, {-1, 1}, 10);
+    std::atomic_bool abort(false);
+
+    auto a = Heightmap::render(t, r, abort, glm::mat4(), 4);
+    const auto before = pool.stats();
+    auto b = Heightmap::render(t, r, abort, glm::mat4(), 4);
+    const auto after = pool.stats();
+
+    REQUIRE(after.hits == before.hits + 4);
+    REQUIRE(after.misses == before.misses);
+    REQUIRE((a.first == b.first).all());
+}